@@ -10,4 +10,9 @@ struct Intersection {
   DirectX::SimpleMath::Vector2 uv;
   Material *material;
   RenderObject *hitObject;
+  // Traversal already rejected or accepted the hit by the opacity of its
+  // material, the closure must not pass through again
+  bool alphaTested = false;
+  // Width of the ray footprint in uv units, 0 when unknown
+  float footprint = 0.0f;
 };
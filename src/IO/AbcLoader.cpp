@@ -2,6 +2,7 @@
 
 #include "SceneLoader.h"
 
+#include "AbcStream.h"
 #include "../Objects/Mesh.h"
 #include "../Objects/Timeline.h"
 
@@ -231,7 +232,8 @@ void visitProperties(ICompoundProperty iParent, std::string &ioIndent) {
 
 //-*****************************************************************************
 void visitObject(IObject iObj, std::string iIndent, BaseObject *parent,
-                 std::vector<BaseObject *> &result) {
+                 std::vector<BaseObject *> &result,
+                 std::shared_ptr<AbcStream> stream) {
   // Object has a name, a full name, some meta data,
   // and then it has a compound property full of properties.
   std::string path = iObj.getFullName();
@@ -265,9 +267,16 @@ void visitObject(IObject iObj, std::string iIndent, BaseObject *parent,
     std::vector<Vector3> normals;
     std::vector<Vector2> uvs;
     readMeshData(mesh, tris, verts, normals, uvs);
-    newParent =
-        new Mesh(Vector3(0, 0, 0), tris, verts, normals, uvs, false, parent);
-    std::cout << "Loading mesh" << std::endl;
+    // Changing topology isn't streamed, those meshes keep their first sample
+    if (mesh.getNumSamples() > 1 &&
+        mesh.getTopologyVariance() != Alembic::AbcGeom::kHeterogenousTopology) {
+      newParent = new AbcMesh(stream, stream->Add(mesh), tris, verts, normals, uvs, parent);
+      std::cout << "Loading deforming mesh" << std::endl;
+    } else {
+      newParent =
+          new Mesh(Vector3(0, 0, 0), tris, verts, normals, uvs, false, parent);
+      std::cout << "Loading mesh" << std::endl;
+    }
   }
 
   if (hasTransform) {
@@ -312,7 +321,7 @@ void visitObject(IObject iObj, std::string iIndent, BaseObject *parent,
   // now the child objects
   for (size_t i = 0; i < iObj.getNumChildren(); i++) {
     visitObject(IObject(iObj, iObj.getChildHeader(i).getName()), iIndent,
-                newParent, result);
+                newParent, result, stream);
   }
   iIndent = oldIndent;
 }
@@ -354,7 +363,7 @@ bool LoadAbc(std::string abcFile, BaseObject **root,
 
   std::vector<BaseObject *> objs;
 
-  visitObject(archive.getTop(), "", nullptr, objs);
+  visitObject(archive.getTop(), "", nullptr, objs, std::make_shared<AbcStream>());
 
   if (objs.size() == 0)
     return false;
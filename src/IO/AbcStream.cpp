@@ -0,0 +1,99 @@
+#include "AbcStream.h"
+#include <algorithm>
+#include <iterator>
+
+using namespace DirectX::SimpleMath;
+
+AbcStream::~AbcStream() {
+  if (m_Prefetch.joinable()) {
+    m_Prefetch.join();
+  }
+}
+
+int AbcStream::Add(Alembic::AbcGeom::IPolyMeshSchema schema) {
+  m_SampleCount = std::max(m_SampleCount, int(schema.getNumSamples()));
+  m_Schemas.push_back(schema);
+  return int(m_Schemas.size()) - 1;
+}
+
+void AbcStream::Read(int frame, std::vector<std::vector<Vector3>> &positions) const {
+  positions.resize(m_Schemas.size());
+  for (size_t i = 0; i < m_Schemas.size(); i++) {
+    // Frames map to sample indices like the transform timelines
+    int last = int(m_Schemas[i].getNumSamples()) - 1;
+    Alembic::AbcGeom::ISampleSelector selector(
+        Alembic::AbcGeom::index_t(std::max(0, std::min(frame, last))));
+    auto samples = m_Schemas[i].getPositionsProperty().getValue(selector);
+
+    auto &mesh = positions[i];
+    mesh.resize(samples->size());
+    for (size_t j = 0; j < samples->size(); j++) {
+      auto p = samples->get()[j];
+      mesh[j] = Vector3(p.x, p.y, p.z);
+    }
+  }
+}
+
+const std::vector<Vector3> &AbcStream::GetPositions(int index, int frame) {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  // Frames past the ends read the first or last sample
+  frame = std::max(0, std::min(frame, m_SampleCount - 1));
+
+  auto it = m_Frames.find(frame);
+  if (it == m_Frames.end()) {
+    if (m_Prefetch.joinable()) {
+      m_Prefetch.join();
+    }
+
+    it = m_Frames.emplace(frame, std::vector<std::vector<Vector3>>()).first;
+    if (m_PrefetchFrame == frame) {
+      std::swap(it->second, m_PrefetchPositions);
+    } else {
+      Read(frame, it->second);
+    }
+
+    // Drop the frames furthest from this one
+    while (m_Frames.size() > CACHED_FRAMES) {
+      auto first = m_Frames.begin(), last = std::prev(m_Frames.end());
+      m_Frames.erase(frame - first->first >= last->first - frame ? first : last);
+    }
+
+    // Playback moves forward, read the next frame while this one renders
+    m_PrefetchFrame = -1;
+    int next = frame + 1;
+    if (next < m_SampleCount && !m_Frames.count(next)) {
+      m_PrefetchFrame = next;
+      m_Prefetch = std::thread([this, next] { Read(next, m_PrefetchPositions); });
+    }
+  }
+
+  return it->second[index];
+}
+
+AbcMesh::AbcMesh(std::shared_ptr<AbcStream> _stream, int _streamIndex,
+                 std::vector<Triangle> &_tris, std::vector<Vector3> &_verts,
+                 std::vector<Vector3> &_normals, std::vector<Vector2> &_uvs,
+                 BaseObject *parent)
+    : Mesh(Vector3(0, 0, 0), _tris, _verts, _normals, _uvs, false, parent),
+      m_Stream(_stream), m_StreamIndex(_streamIndex) {}
+
+void AbcMesh::SetTime(int frameIndex) {
+  BaseObject::SetTime(frameIndex);
+
+  // Same size keeps the buffer Embree refits from
+  auto &positions = m_Stream->GetPositions(m_StreamIndex, frameIndex);
+  if (positions.size() == m_Vertices.size()) {
+    std::copy(positions.begin(), positions.end(), m_Vertices.begin());
+  }
+}
+
+const Vector3 *AbcMesh::GetVertexBufferAt(int frameIndex) {
+  // Read straight from the stream, a later frame is prepared while the
+  // current one still renders with m_Vertices
+  auto &positions = m_Stream->GetPositions(m_StreamIndex, frameIndex);
+  if (positions.size() != m_Vertices.size()) {
+    return m_Vertices.data();
+  }
+  return positions.data();
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "../Objects/Mesh.h"
+#include <Alembic/AbcGeom/All.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CACHED_FRAMES 4
+
+/********************************************
+** AbcStream
+** Per frame vertex positions of the deforming
+** meshes of one Alembic archive. While a frame
+** renders, a background thread already reads
+** the next one.
+*********************************************/
+
+class AbcStream {
+  std::vector<Alembic::AbcGeom::IPolyMeshSchema> m_Schemas;
+  int m_SampleCount;
+
+  std::mutex m_Mutex;
+  std::thread m_Prefetch;
+  int m_PrefetchFrame;
+  // Positions of the last few frames, motion blur also reads the frames
+  // around the current one
+  std::map<int, std::vector<std::vector<DirectX::SimpleMath::Vector3>>> m_Frames;
+  std::vector<std::vector<DirectX::SimpleMath::Vector3>> m_PrefetchPositions;
+
+  void Read(int frame, std::vector<std::vector<DirectX::SimpleMath::Vector3>> &positions) const;
+
+public:
+  AbcStream() : m_SampleCount(0), m_PrefetchFrame(-1) {}
+  ~AbcStream();
+
+  // Registers a mesh, returns its index
+  int Add(Alembic::AbcGeom::IPolyMeshSchema schema);
+
+  // Positions of a mesh at a frame. The first call for a new frame swaps in
+  // the prefetched positions or reads them, then prefetches the next frame.
+  // Valid until CACHED_FRAMES other frames were requested.
+  const std::vector<DirectX::SimpleMath::Vector3> &GetPositions(int index, int frame);
+};
+
+/********************************************
+** AbcMesh
+** Mesh with constant topology whose positions
+** follow the samples of an Alembic cache.
+*********************************************/
+
+class AbcMesh : public Mesh {
+  std::shared_ptr<AbcStream> m_Stream;
+  int m_StreamIndex;
+
+public:
+  AbcMesh(std::shared_ptr<AbcStream> _stream, int _streamIndex,
+          std::vector<Triangle> &_tris, std::vector<DirectX::SimpleMath::Vector3> &_verts,
+          std::vector<DirectX::SimpleMath::Vector3> &_normals,
+          std::vector<DirectX::SimpleMath::Vector2> &_uvs, BaseObject *parent = nullptr);
+
+  void SetTime(int frameIndex) override;
+
+  bool IsDeforming() const override { return true; }
+  const DirectX::SimpleMath::Vector3 *GetVertexBufferAt(int frameIndex) override;
+};
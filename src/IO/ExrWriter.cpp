@@ -0,0 +1,88 @@
+#include "ExrWriter.h"
+#include "tinyexr.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+void ExrWriter::AddLayer(const std::string &name, const std::string &channels,
+                         const float *data, int stride, bool half) {
+  m_Layers.push_back({name, channels, data, stride, half});
+}
+
+bool ExrWriter::Write(const std::string &filename) const {
+  struct Channel {
+    std::string Name;
+    const Layer *Source;
+    int Offset;
+  };
+
+  std::vector<Channel> channels;
+  for (auto &layer : m_Layers) {
+    for (int c = 0; c < int(layer.Channels.size()); c++) {
+      std::string name(1, layer.Channels[c]);
+      if (!layer.Name.empty()) {
+        name = layer.Name + "." + name;
+      }
+      channels.push_back({name, &layer, c});
+    }
+  }
+
+  // Readers expect the channels sorted by name
+  std::sort(channels.begin(), channels.end(),
+            [](const Channel &a, const Channel &b) { return a.Name < b.Name; });
+
+  int channelCount = int(channels.size());
+  int pixelCount = m_Width * m_Height;
+
+  std::vector<EXRChannelInfo> infos(channelCount);
+  std::vector<int> pixelTypes(channelCount, TINYEXR_PIXELTYPE_FLOAT);
+  std::vector<int> requestedTypes(channelCount);
+  std::vector<std::vector<float>> planes(channelCount);
+  std::vector<unsigned char *> images(channelCount);
+
+  // tinyexr takes one plane per channel, interleaved layers are split up
+#pragma omp parallel for
+  for (int i = 0; i < channelCount; i++) {
+    const Channel &channel = channels[i];
+    std::memset(&infos[i], 0, sizeof(EXRChannelInfo));
+    std::strncpy(infos[i].name, channel.Name.c_str(), sizeof(infos[i].name) - 1);
+    requestedTypes[i] =
+        channel.Source->Half ? TINYEXR_PIXELTYPE_HALF : TINYEXR_PIXELTYPE_FLOAT;
+
+    const float *src = channel.Source->Data + channel.Offset;
+    if (channel.Source->Stride == 1) {
+      images[i] = (unsigned char *)src;
+      continue;
+    }
+
+    auto &plane = planes[i];
+    plane.resize(pixelCount);
+    for (int p = 0; p < pixelCount; p++) {
+      plane[p] = src[size_t(p) * channel.Source->Stride];
+    }
+    images[i] = (unsigned char *)plane.data();
+  }
+
+  EXRHeader header;
+  InitEXRHeader(&header);
+  header.num_channels = channelCount;
+  header.channels = infos.data();
+  header.pixel_types = pixelTypes.data();
+  header.requested_pixel_types = requestedTypes.data();
+  header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIP;
+
+  EXRImage image;
+  InitEXRImage(&image);
+  image.num_channels = channelCount;
+  image.images = images.data();
+  image.width = m_Width;
+  image.height = m_Height;
+
+  const char *err = nullptr;
+  if (SaveEXRImageToFile(&image, &header, filename.c_str(), &err) != TINYEXR_SUCCESS) {
+    std::cerr << "Couldn't write " << filename << ": " << (err ? err : "unknown error")
+              << std::endl;
+    return false;
+  }
+  return true;
+}
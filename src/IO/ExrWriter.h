@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "../SimpleMath.h"
+
+/********************************************
+** ExrWriter
+** Collects images as the layers of a single
+** OpenEXR file. Channels are stored ZIP
+** compressed, tinyexr compresses the scanline
+** blocks in parallel.
+*********************************************/
+
+class ExrWriter {
+private:
+  struct Layer {
+    std::string Name;
+    std::string Channels;
+    const float *Data;
+    int Stride;
+    bool Half;
+  };
+
+  int m_Width;
+  int m_Height;
+  std::vector<Layer> m_Layers;
+
+public:
+  ExrWriter(int width, int height) : m_Width(width), m_Height(height) {}
+
+  // Channels are named <name>.<channel>, or just <channel> for an unnamed
+  // (beauty) layer. Data holds 'stride' floats per pixel, the channels are
+  // the first of them. It has to stay valid until Write.
+  void AddLayer(const std::string &name, const std::string &channels,
+                const float *data, int stride, bool half);
+
+  void AddLayer(const std::string &name, const DirectX::SimpleMath::Color *data,
+                bool alpha, bool half) {
+    AddLayer(name, alpha ? "RGBA" : "RGB", (const float *)data, 4, half);
+  }
+
+  bool Write(const std::string &filename) const;
+};
@@ -20,6 +20,7 @@
 #include "../Rendering/Materials/SpecularMaterial.h"
 #include "../Rendering/Materials/EmissionMaterial.h"
 #include "../Rendering/Materials/TransparentMaterial.h"
+#include "../Rendering/Materials/MicrofacetMaterial.h"
 
 #include "../Objects/BaseObject.h"
 #include "../Objects/Sphere.h"
@@ -34,6 +35,7 @@
 #include "../Rendering/Textures/Texture.h"
 #include "../Rendering/Textures/ConstantColor.h"
 #include "../Rendering/Textures/ImageTexture.h"
+#include "../Rendering/Textures/TiledImageTexture.h"
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
@@ -217,6 +219,22 @@ bool LoadZSF(std::istream& sceneStream, std::string sceneFileName, std::vector<B
                 GetValue<float>(values, "ks", 0.5f),
                 GetValue<float>(values, "kt", 0.0f),
                 GetValue<float>(values, "roughness", 0.0f));
+        } else if (type == "conductor") {
+            if (values.count("eta") && values.count("k")) {
+                return new MicrofacetMaterial(colorTex, GetValue<float>(values, "roughness", 0.0f),
+                    GetValue<Color>(values, "eta"), GetValue<Color>(values, "k"));
+            }
+            return new MicrofacetMaterial(MaterialKind::Conductor, colorTex,
+                GetValue<float>(values, "roughness", 0.0f), 1.0f,
+                GetValue<Color>(values, "f0", Color(1.0f, 1.0f, 1.0f)));
+        } else if (type == "dielectric") {
+            return new MicrofacetMaterial(MaterialKind::Dielectric, colorTex,
+                GetValue<float>(values, "roughness", 0.0f),
+                GetValue<float>(values, "ior", 1.5f));
+        } else if (type == "plastic") {
+            return new MicrofacetMaterial(MaterialKind::Plastic, colorTex,
+                GetValue<float>(values, "roughness", 0.0f),
+                GetValue<float>(values, "ior", 1.5f));
         } else {
             std::cout << "Unknown material type: " << type << std::endl;
             return nullptr;
@@ -308,6 +326,7 @@ bool LoadZSF(std::istream& sceneStream, std::string sceneFileName, std::vector<B
             return false;
         }
 
+        (*cam)->SetShutter(GetValue<float>(values, "shutter", 0.0f));
         (*cam)->SetPosition(GetValue<Vector3>(values, "position"));
         auto rotation = GetValue<Vector3>(values, "rotation");
         (*cam)->SetRotation(rotation);
@@ -1086,6 +1105,15 @@ std::shared_ptr<Texture> GetTextureFromColorSource(MitsubaColorSource* colorSour
         case MitsubaColorSource::Type::Texture:
         {
             auto texSource = (MitsubaColorSourceTexture*)colorSource;
+
+            auto tiledData = TextureCache::Instance().GetTiled(texSource->filename);
+            if (tiledData) {
+                auto tex = std::make_shared<TiledImageTexture>(tiledData);
+                tex->filterMode = TextureFilterMode::Trilinear;
+                tex->wrapMode = TextureWrapMode::Wrap;
+                return tex;
+            }
+
             auto texData = TextureCache::Instance().Get(texSource->filename);
             if (!texData) {
                 std::cerr << "Couldn't load texture: " << texSource->filename << std::endl;
@@ -1101,6 +1129,23 @@ std::shared_ptr<Texture> GetTextureFromColorSource(MitsubaColorSource* colorSour
     }
 }
 
+// Relative index of refraction, missing values default to glass
+float GetRelativeIOR(float intIOR, float extIOR) {
+    return intIOR > 0.0f && extIOR > 0.0f ? intIOR / extIOR : 1.5f;
+}
+
+// Conductor with the complex index of refraction when both parts are given
+// as colors, a white mirror otherwise
+Material* GetConductor(std::shared_ptr<Texture> tint, float alpha,
+                       MitsubaColorSource* eta, MitsubaColorSource* k) {
+    if (!eta || !k || eta->type != MitsubaColorSource::Type::RGB ||
+        k->type != MitsubaColorSource::Type::RGB) {
+        return new MicrofacetMaterial(MaterialKind::Conductor, tint, alpha, 1.0f);
+    }
+    return new MicrofacetMaterial(tint, alpha, ((MitsubaColorSourceRGB*)eta)->color,
+                                  ((MitsubaColorSourceRGB*)k)->color);
+}
+
 Material* GetMaterialFromBsdf(MitsubaBsdf* bsdf) {
     switch (bsdf->type) {
         case MitsubaBsdf::Type::Diffuse:
@@ -1128,14 +1173,16 @@ Material* GetMaterialFromBsdf(MitsubaBsdf* bsdf) {
 
             auto reflectance = conductorMat->specularReflectance.get();
             auto reflectanceTex = GetTextureFromColorSource(reflectance);
-            return new SpecularMaterial(std::make_shared<ConstantColor>(Color(0.0f, 0.0f, 0.0f)), reflectanceTex, 0, 1, 0, conductorMat->alpha);
+            return GetConductor(reflectanceTex, conductorMat->alpha,
+                                conductorMat->eta.get(), conductorMat->k.get());
         }
         case MitsubaBsdf::Type::Conductor: {
             auto conductorMat = (MitsubaBsdfConductor*)bsdf;
 
             auto reflectance = conductorMat->specularReflectance.get();
             auto reflectanceTex = GetTextureFromColorSource(reflectance);
-            return new SpecularMaterial(std::make_shared<ConstantColor>(Color(0.0f, 0.0f, 0.0f)), reflectanceTex, 0, 1, 0, 0);
+            return GetConductor(reflectanceTex, MIN_ALPHA,
+                                conductorMat->eta.get(), conductorMat->k.get());
         }
         case MitsubaBsdf::Type::RoughPlastic: {
             auto plasticMat = (MitsubaBsdfRoughPlastic*)bsdf;
@@ -1143,7 +1190,8 @@ Material* GetMaterialFromBsdf(MitsubaBsdf* bsdf) {
             auto reflectance = plasticMat->diffuseReflectance.get();
             auto reflectanceTex = GetTextureFromColorSource(reflectance);
 
-            return new SpecularMaterial(reflectanceTex, std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), 0.8f, 0.2f, 0.0f, plasticMat->alpha * 0.01f);
+            return new MicrofacetMaterial(MaterialKind::Plastic, reflectanceTex, plasticMat->alpha,
+                                          GetRelativeIOR(plasticMat->intIOR, plasticMat->extIOR));
         }
         case MitsubaBsdf::Type::Plastic: {
             auto plasticMat = (MitsubaBsdfPlastic*)bsdf;
@@ -1151,15 +1199,18 @@ Material* GetMaterialFromBsdf(MitsubaBsdf* bsdf) {
             auto reflectance = plasticMat->diffuseReflectance.get();
             auto reflectanceTex = GetTextureFromColorSource(reflectance);
 
-            return new SpecularMaterial(reflectanceTex, std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), 0.8f, 0.2f, 0.0f, 0);
+            return new MicrofacetMaterial(MaterialKind::Plastic, reflectanceTex, MIN_ALPHA,
+                                          GetRelativeIOR(plasticMat->intIOR, plasticMat->extIOR));
         }
         case MitsubaBsdf::Type::Dielectric: {
             auto dielectricMat = (MitsubaBsdfDielectric*)bsdf;
-            return new SpecularMaterial(std::make_shared<ConstantColor>(Color(0.0f, 0.0f, 0.0f)), std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), 0, 0.3f, 0.7f, 0);
+            return new MicrofacetMaterial(MaterialKind::Dielectric, std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), MIN_ALPHA,
+                                          GetRelativeIOR(dielectricMat->intIOR, dielectricMat->extIOR));
         }
         case MitsubaBsdf::Type::RoughDielectric: {
             auto dielectricMat = (MitsubaBsdfRoughDielectric*)bsdf;
-            return new SpecularMaterial(std::make_shared<ConstantColor>(Color(0.0f, 0.0f, 0.0f)), std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), 0, 0.3f, 0.7f, 0.1f * dielectricMat->alpha);
+            return new MicrofacetMaterial(MaterialKind::Dielectric, std::make_shared<ConstantColor>(Color(1.0f, 1.0f, 1.0f)), dielectricMat->alpha,
+                                          GetRelativeIOR(dielectricMat->intIOR, dielectricMat->extIOR));
         }
         case MitsubaBsdf::Type::ThinDielectric: {
             auto dielectricMat = (MitsubaBsdfThinDielectric*)bsdf;
@@ -1211,14 +1262,20 @@ bool LoadMitsuba(std::istream& sceneStream, std::string sceneFileName, std::vect
 
                 auto envmap = (MitsubaEmitterEnvmap*)emitter;
                 
-                auto texData = TextureCache::Instance().Get(envmap->filename);
-                if (!texData) {
-                    std::cerr << "Couldn't load environment map: " << envmap->filename << std::endl;
-                    continue;
+                std::shared_ptr<Texture> emissiveTex;
+                auto tiledData = TextureCache::Instance().GetTiled(envmap->filename);
+                if (tiledData) {
+                    emissiveTex = std::make_shared<TiledImageTexture>(tiledData);
+                } else {
+                    auto texData = TextureCache::Instance().Get(envmap->filename);
+                    if (!texData) {
+                        std::cerr << "Couldn't load environment map: " << envmap->filename << std::endl;
+                        continue;
+                    }
+                    emissiveTex = std::make_shared<ImageTexture>(texData);
                 }
                 
                 RenderObject* renderObj = new Sphere(Vector3(0, 0, 0), 10000);
-                auto emissiveTex = std::make_shared<ImageTexture>(texData);
                 renderObj->SetMaterial(new EmissionMaterial(emissiveTex, 1.0f));
 
                 loadedObjects.push_back(renderObj);
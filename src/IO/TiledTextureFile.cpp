@@ -0,0 +1,363 @@
+#include "TiledTextureFile.h"
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace DirectX::SimpleMath;
+
+static const char TILED_TEXTURE_MAGIC[4] = {'Z', 'T', 'X', '1'};
+static const uint32_t TILED_TEXTURE_VERSION = 1;
+
+// Levels start on page boundaries so a tile never shares a page with the
+// previous level.
+static const uint64_t TILED_TEXTURE_ALIGNMENT = 4096;
+
+/********************************************
+** MappedFile
+** Read only memory mapping of a whole file.
+*********************************************/
+class MappedFile {
+private:
+#ifdef _WIN32
+  HANDLE m_File = INVALID_HANDLE_VALUE;
+  HANDLE m_Mapping = nullptr;
+#else
+  int m_File = -1;
+#endif
+  const uint8_t *m_Data = nullptr;
+  size_t m_Size = 0;
+
+public:
+  bool Open(const std::string &filename) {
+#ifdef _WIN32
+    m_File = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                         nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS,
+                         nullptr);
+    if (m_File == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_File, &size);
+    m_Size = (size_t)size.QuadPart;
+
+    m_Mapping =
+        CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_Mapping) {
+      return false;
+    }
+
+    m_Data = (const uint8_t *)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_File = open(filename.c_str(), O_RDONLY);
+    if (m_File < 0) {
+      return false;
+    }
+
+    struct stat fileStat;
+    fstat(m_File, &fileStat);
+    m_Size = (size_t)fileStat.st_size;
+
+    void *data = mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, m_File, 0);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+
+    // Texture lookups jump around, read-ahead would only pull in tiles
+    // nobody asked for.
+    madvise(data, m_Size, MADV_RANDOM);
+    m_Data = (const uint8_t *)data;
+#endif
+    return m_Data != nullptr;
+  }
+
+  const uint8_t *Data() const { return m_Data; }
+  size_t Size() const { return m_Size; }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (m_Data)
+      UnmapViewOfFile(m_Data);
+    if (m_Mapping)
+      CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+      CloseHandle(m_File);
+#else
+    if (m_Data)
+      munmap((void *)m_Data, m_Size);
+    if (m_File >= 0)
+      close(m_File);
+#endif
+  }
+};
+
+static uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, 4);
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent <= 0) {
+    // Denormals are not worth the trouble for texture data
+    return (uint16_t)sign;
+  }
+
+  if (exponent >= 31) {
+    // Inf and NaN both end up as Inf
+    return (uint16_t)(sign | 0x7c00);
+  }
+
+  // Round to nearest
+  mantissa += 0x1000;
+  if (mantissa & 0x800000) {
+    mantissa = 0;
+    exponent++;
+    if (exponent >= 31) {
+      return (uint16_t)(sign | 0x7c00);
+    }
+  }
+
+  return (uint16_t)(sign | (exponent << 10) | (mantissa >> 13));
+}
+
+static float HalfToFloat(uint16_t value) {
+  uint32_t sign = uint32_t(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+
+  uint32_t bits;
+  if (exponent == 0) {
+    bits = sign;
+  } else if (exponent == 31) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, 4);
+  return result;
+}
+
+static uint64_t AlignUp(uint64_t value) {
+  return (value + TILED_TEXTURE_ALIGNMENT - 1) & ~(TILED_TEXTURE_ALIGNMENT - 1);
+}
+
+TiledTextureFile::TiledTextureFile()
+    : m_Header(nullptr), m_Levels(nullptr), m_TexelSize(0), m_TileBytes(0) {}
+
+TiledTextureFile::~TiledTextureFile() {}
+
+std::shared_ptr<const TiledTextureFile>
+TiledTextureFile::Open(const std::string &filename) {
+  std::unique_ptr<MappedFile> file(new MappedFile());
+  if (!file->Open(filename)) {
+    return nullptr;
+  }
+
+  if (file->Size() < sizeof(TiledTextureHeader)) {
+    std::cerr << "Invalid tiled texture: " << filename << std::endl;
+    return nullptr;
+  }
+
+  auto header = (const TiledTextureHeader *)file->Data();
+  if (memcmp(header->Magic, TILED_TEXTURE_MAGIC, 4) != 0 ||
+      header->Version != TILED_TEXTURE_VERSION) {
+    std::cerr << "Invalid tiled texture: " << filename << std::endl;
+    return nullptr;
+  }
+
+  // A full MIP chain of a 32 bit sized image has at most 32 levels, the
+  // tile size bound keeps the tile byte count from overflowing
+  if (header->LevelCount == 0 || header->LevelCount > 32 || header->TileSize == 0 ||
+      header->TileSize > 65536 ||
+      (header->Format != TiledTextureFormat::Float &&
+       header->Format != TiledTextureFormat::Half)) {
+    std::cerr << "Invalid tiled texture: " << filename << std::endl;
+    return nullptr;
+  }
+
+  uint64_t tableEnd =
+      sizeof(TiledTextureHeader) + uint64_t(header->LevelCount) * sizeof(TiledTextureLevel);
+  if (file->Size() < tableEnd) {
+    std::cerr << "Truncated tiled texture: " << filename << std::endl;
+    return nullptr;
+  }
+
+  std::shared_ptr<TiledTextureFile> result(new TiledTextureFile());
+  result->m_Header = header;
+  result->m_Levels = (const TiledTextureLevel *)(file->Data() +
+                                                 sizeof(TiledTextureHeader));
+  result->m_TexelSize = header->Format == TiledTextureFormat::Half
+                            ? 4 * sizeof(uint16_t)
+                            : 4 * sizeof(float);
+  result->m_TileBytes =
+      result->m_TexelSize * header->TileSize * header->TileSize;
+
+  // Fetch trusts the level table, every tile it can address has to be
+  // inside the mapping
+  for (uint32_t i = 0; i < header->LevelCount; i++) {
+    const auto &level = result->m_Levels[i];
+    if (level.Width == 0 || level.Height == 0 ||
+        level.TilesX != (uint64_t(level.Width) + header->TileSize - 1) / header->TileSize ||
+        level.TilesY != (uint64_t(level.Height) + header->TileSize - 1) / header->TileSize ||
+        level.Offset < tableEnd) {
+      std::cerr << "Invalid tiled texture: " << filename << std::endl;
+      return nullptr;
+    }
+
+    // Divide instead of multiplying, a broken header must not overflow
+    if (level.Offset > file->Size() ||
+        (file->Size() - level.Offset) / result->m_TileBytes / level.TilesY < level.TilesX) {
+      std::cerr << "Truncated tiled texture: " << filename << std::endl;
+      return nullptr;
+    }
+  }
+
+  result->m_File = std::move(file);
+  return result;
+}
+
+Color TiledTextureFile::Fetch(int level, int x, int y) const {
+  const auto &lvl = m_Levels[level];
+  int tileSize = m_Header->TileSize;
+
+  int tileX = x / tileSize;
+  int tileY = y / tileSize;
+  int texelIndex = (x - tileX * tileSize) + (y - tileY * tileSize) * tileSize;
+
+  const uint8_t *tile = m_File->Data() + lvl.Offset +
+                        (tileX + size_t(tileY) * lvl.TilesX) * m_TileBytes;
+  const uint8_t *texel = tile + texelIndex * m_TexelSize;
+
+  if (m_Header->Format == TiledTextureFormat::Half) {
+    const uint16_t *h = (const uint16_t *)texel;
+    return Color(HalfToFloat(h[0]), HalfToFloat(h[1]), HalfToFloat(h[2]),
+                 HalfToFloat(h[3]));
+  }
+
+  return Color((const float *)texel);
+}
+
+bool TiledTextureFile::Write(const std::string &filename, const Color *pixels,
+                             int width, int height, int tileSize,
+                             TiledTextureFormat format) {
+  // Build the MIP chain with a 2x2 box filter
+  std::vector<std::vector<Color>> levels;
+  std::vector<std::pair<int, int>> sizes;
+  levels.emplace_back(pixels, pixels + width * height);
+  sizes.push_back({width, height});
+
+  while (sizes.back().first > 1 || sizes.back().second > 1) {
+    int srcW = sizes.back().first;
+    int srcH = sizes.back().second;
+    int dstW = std::max(1, srcW / 2);
+    int dstH = std::max(1, srcH / 2);
+    const auto &src = levels.back();
+
+    std::vector<Color> dst(dstW * dstH);
+    for (int y = 0; y < dstH; y++) {
+      for (int x = 0; x < dstW; x++) {
+        int x0 = std::min(x * 2, srcW - 1), x1 = std::min(x * 2 + 1, srcW - 1);
+        int y0 = std::min(y * 2, srcH - 1), y1 = std::min(y * 2 + 1, srcH - 1);
+        dst[x + y * dstW] = (src[x0 + y0 * srcW] + src[x1 + y0 * srcW] +
+                             src[x0 + y1 * srcW] + src[x1 + y1 * srcW]) *
+                            0.25f;
+      }
+    }
+
+    levels.push_back(std::move(dst));
+    sizes.push_back({dstW, dstH});
+  }
+
+  size_t texelSize =
+      format == TiledTextureFormat::Half ? 4 * sizeof(uint16_t) : 4 * sizeof(float);
+  size_t tileBytes = texelSize * tileSize * tileSize;
+
+  TiledTextureHeader header;
+  memcpy(header.Magic, TILED_TEXTURE_MAGIC, 4);
+  header.Version = TILED_TEXTURE_VERSION;
+  header.Width = width;
+  header.Height = height;
+  header.TileSize = tileSize;
+  header.LevelCount = (uint32_t)levels.size();
+  header.Format = format;
+  header.Reserved = 0;
+
+  std::vector<TiledTextureLevel> levelInfos(levels.size());
+  uint64_t offset = AlignUp(sizeof(TiledTextureHeader) +
+                            sizeof(TiledTextureLevel) * levels.size());
+  for (size_t i = 0; i < levels.size(); i++) {
+    auto &info = levelInfos[i];
+    info.Width = sizes[i].first;
+    info.Height = sizes[i].second;
+    info.TilesX = (info.Width + tileSize - 1) / tileSize;
+    info.TilesY = (info.Height + tileSize - 1) / tileSize;
+    info.Offset = offset;
+    offset = AlignUp(offset + uint64_t(info.TilesX) * info.TilesY * tileBytes);
+  }
+
+  FILE *f = fopen(filename.c_str(), "wb");
+  if (!f) {
+    std::cerr << "Couldn't open " << filename << " for writing." << std::endl;
+    return false;
+  }
+
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(levelInfos.data(), sizeof(TiledTextureLevel), levelInfos.size(), f);
+
+  std::vector<uint8_t> tile(tileBytes);
+  for (size_t i = 0; i < levels.size(); i++) {
+    const auto &info = levelInfos[i];
+    const auto &level = levels[i];
+
+    fseek(f, (long)info.Offset, SEEK_SET);
+
+    for (uint32_t ty = 0; ty < info.TilesY; ty++) {
+      for (uint32_t tx = 0; tx < info.TilesX; tx++) {
+        // Border tiles are padded by repeating the last row/column
+        for (int y = 0; y < tileSize; y++) {
+          for (int x = 0; x < tileSize; x++) {
+            int srcX = std::min<int>(tx * tileSize + x, info.Width - 1);
+            int srcY = std::min<int>(ty * tileSize + y, info.Height - 1);
+            const Color &c = level[srcX + srcY * info.Width];
+            uint8_t *texel = tile.data() + (x + y * tileSize) * texelSize;
+
+            if (format == TiledTextureFormat::Half) {
+              uint16_t h[4] = {FloatToHalf(c.x), FloatToHalf(c.y),
+                               FloatToHalf(c.z), FloatToHalf(c.w)};
+              memcpy(texel, h, sizeof(h));
+            } else {
+              memcpy(texel, &c, 4 * sizeof(float));
+            }
+          }
+        }
+        fwrite(tile.data(), 1, tileBytes, f);
+      }
+    }
+  }
+
+  // Pad the file so the last level ends on the alignment as well
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  if ((uint64_t)size < offset) {
+    fseek(f, (long)offset - 1, SEEK_SET);
+    fputc(0, f);
+  }
+
+  fclose(f);
+  return true;
+}
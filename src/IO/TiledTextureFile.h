@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "../SimpleMath.h"
+
+/********************************************
+** TiledTextureFile
+** Pre-tiled, MIP-mapped texture container
+** (.ztx). Written offline by zaphod_tex and
+** memory mapped by the renderer, so texels
+** are paged in by the OS on first access
+** instead of being decoded up front.
+*********************************************/
+
+enum class TiledTextureFormat : uint32_t {
+  Float = 0, // 4 x 32 bit float per texel
+  Half = 1   // 4 x 16 bit float per texel
+};
+
+struct TiledTextureHeader {
+  char Magic[4];
+  uint32_t Version;
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t TileSize;
+  uint32_t LevelCount;
+  TiledTextureFormat Format;
+  uint32_t Reserved;
+};
+
+struct TiledTextureLevel {
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t TilesX;
+  uint32_t TilesY;
+  uint64_t Offset;
+};
+
+class MappedFile;
+
+class TiledTextureFile {
+private:
+  std::unique_ptr<MappedFile> m_File;
+  const TiledTextureHeader *m_Header;
+  const TiledTextureLevel *m_Levels;
+  size_t m_TexelSize;
+  size_t m_TileBytes;
+
+  TiledTextureFile();
+
+public:
+  ~TiledTextureFile();
+
+  static std::shared_ptr<const TiledTextureFile> Open(const std::string &filename);
+
+  // Writes a full MIP chain of the given RGBA image.
+  static bool Write(const std::string &filename,
+                    const DirectX::SimpleMath::Color *pixels, int width,
+                    int height, int tileSize, TiledTextureFormat format);
+
+  int GetWidth(int level = 0) const { return m_Levels[level].Width; }
+  int GetHeight(int level = 0) const { return m_Levels[level].Height; }
+  int GetLevelCount() const { return m_Header->LevelCount; }
+
+  DirectX::SimpleMath::Color Fetch(int level, int x, int y) const;
+};
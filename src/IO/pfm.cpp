@@ -52,16 +52,14 @@ float *read_pfm_file3(const char *filename, int *w, int *h) {
 
 void write_pfm_file3(const char *filename, float *depth, int w, int h) {
   FILE *f = fopen(filename, "wb");
+  if (!f) { printf("Couldn't open %s for writing.\n", filename); return; }
 
   double scale = 1.0;
   if (is_little_endian()) { scale = -scale; }
 
   fprintf(f, "PF\n%d %d\n%lf\n", w, h, scale);
   int channels = 3;
-  for (int i = 0; i < w*h*channels; i++) {
-    float d = depth[i];
-    fwrite((void *) &d, 1, 4, f);
-  }
+  fwrite((void *) depth, 4, (size_t)w*h*channels, f);
   fclose(f);
 }
 
@@ -103,14 +101,12 @@ float *read_pfm_file(const char *filename, int *w, int *h) {
 
 void write_pfm_file(const char *filename, float *depth, int w, int h) {
   FILE *f = fopen(filename, "wb");
+  if (!f) { printf("Couldn't open %s for writing.\n", filename); return; }
 
   double scale = 1.0;
   if (is_little_endian()) { scale = -scale; }
 
   fprintf(f, "Pf\n%d %d\n%lf\n", w, h, scale);
-  for (int i = 0; i < w*h; i++) {
-    float d = depth[i];
-    fwrite((void *) &d, 1, 4, f);
-  }
+  fwrite((void *) depth, 4, (size_t)w*h, f);
   fclose(f);
 }
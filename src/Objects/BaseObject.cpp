@@ -3,7 +3,8 @@
 
 using namespace DirectX::SimpleMath;
 
-BaseObject::BaseObject(BaseObject *parent) : m_Parent(parent) {
+BaseObject::BaseObject(BaseObject *parent)
+    : m_Parent(parent), m_Hierarchy(nullptr), m_TransformIndex(-1) {
   m_Scale = Vector3(1, 1, 1);
   m_Rotation = Quaternion::CreateFromYawPitchRoll(0, 0, 0);
   m_Position = Vector3(0, 0, 0);
@@ -13,6 +14,9 @@ BaseObject::BaseObject(BaseObject *parent) : m_Parent(parent) {
 }
 
 Matrix BaseObject::GetTransformInv() {
+	if (m_Hierarchy) {
+		return m_Hierarchy->GetWorldInverse(m_TransformIndex);
+	}
 	if (!IsTransformDirty()) {
 		return m_TransformInverse;
 	}
@@ -23,15 +27,16 @@ Matrix BaseObject::GetTransformInv() {
 }
 
 Matrix BaseObject::GetTransform() {
+  if (m_Hierarchy) {
+    return m_Hierarchy->GetWorld(m_TransformIndex);
+  }
   if (!IsTransformDirty()) {
     return m_Transform;
   }
 
   Matrix parentTransform =
       m_Parent ? m_Parent->GetTransform() : Matrix::Identity();
-  m_Transform = Matrix::CreateScale(m_Scale) *
-                Matrix::CreateFromQuaternion(m_Rotation) *
-                Matrix::CreateTranslation(m_Position) * parentTransform;
+  m_Transform = GetLocalTransform() * parentTransform;
 
   m_TransformIsDirty = false;
 	m_TransformInverse = m_Transform.Invert();
@@ -39,6 +44,24 @@ Matrix BaseObject::GetTransform() {
   return m_Transform;
 }
 
+Matrix BaseObject::GetLocalTransform() const {
+  return Matrix::CreateScale(m_Scale) * Matrix::CreateFromQuaternion(m_Rotation) *
+         Matrix::CreateTranslation(m_Position);
+}
+
+Matrix BaseObject::GetTransformAt(float time) const {
+  Vector3 scale = m_ScaleTimeline.keyframes.size() ? m_ScaleTimeline.Evaluate(time) : m_Scale;
+  Quaternion rotation =
+      m_RotationTimeline.keyframes.size() ? m_RotationTimeline.Evaluate(time) : m_Rotation;
+  Vector3 position =
+      m_PositionTimeline.keyframes.size() ? m_PositionTimeline.Evaluate(time) : m_Position;
+
+  Matrix parentTransform =
+      m_Parent ? m_Parent->GetTransformAt(time) : Matrix::Identity();
+  return Matrix::CreateScale(scale) * Matrix::CreateFromQuaternion(rotation) *
+         Matrix::CreateTranslation(position) * parentTransform;
+}
+
 float BaseObject::GetWeight() const { return m_Weight; }
 
 void BaseObject::SetRotation(Vector3 _rot) {
@@ -3,6 +3,7 @@
 #include <random>
 #include <memory>
 #include "Timeline.h"
+#include "TransformHierarchy.h"
 
 struct Intersection;
 struct Triangle;
@@ -21,6 +22,11 @@ private:
   DirectX::SimpleMath::Matrix m_Transform;
 	DirectX::SimpleMath::Matrix m_TransformInverse;
 
+  // Precomputed world transforms once the object is part of a scene
+  const TransformHierarchy *m_Hierarchy;
+  int m_TransformIndex;
+  friend class TransformHierarchy;
+
   Timeline<DirectX::SimpleMath::Vector3> m_PositionTimeline;
   Timeline<DirectX::SimpleMath::Quaternion> m_RotationTimeline;
   Timeline<DirectX::SimpleMath::Vector3> m_ScaleTimeline;
@@ -40,8 +46,20 @@ public:
     return m_TransformIsDirty || (m_Parent && m_Parent->IsTransformDirty());
   }
 
+  // A timeline of this object or a parent has more than one keyframe
+  bool IsAnimated() const {
+    return m_PositionTimeline.keyframes.size() > 1 || m_RotationTimeline.keyframes.size() > 1 ||
+           m_ScaleTimeline.keyframes.size() > 1 || (m_Parent && m_Parent->IsAnimated());
+  }
+
+	// World transform, read from the hierarchy of the scene once attached.
+	// Attached objects only pick up changes after TransformHierarchy::Update.
 	DirectX::SimpleMath::Matrix GetTransformInv();
   DirectX::SimpleMath::Matrix GetTransform();
+  // Scale, rotation and translation relative to the parent
+  DirectX::SimpleMath::Matrix GetLocalTransform() const;
+  // Transform at a fractional frame, leaves the current state alone
+  DirectX::SimpleMath::Matrix GetTransformAt(float time) const;
   void SetParent(BaseObject *parent);
   float GetWeight() const;
 
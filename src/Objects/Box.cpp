@@ -14,10 +14,16 @@ void Box::SetPosition(Vector3 _pos) {
   BaseObject::SetPosition(_pos);
 }
 
+// World space area of the face pairs, a face stays a parallelogram under
+// any affine transform
 float Box::CalculateWeight() {
-  m_SampleWeights[0] = m_Box.Extents.y * m_Box.Extents.z * 8;
-  m_SampleWeights[1] = m_Box.Extents.x * m_Box.Extents.z * 8;
-  m_SampleWeights[2] = m_Box.Extents.x * m_Box.Extents.y * 8;
+  auto transform = GetTransform();
+  Vector3 x = Vector3::TransformNormal(Vector3(2 * m_Box.Extents.x, 0, 0), transform);
+  Vector3 y = Vector3::TransformNormal(Vector3(0, 2 * m_Box.Extents.y, 0), transform);
+  Vector3 z = Vector3::TransformNormal(Vector3(0, 0, 2 * m_Box.Extents.z), transform);
+  m_SampleWeights[0] = y.Cross(z).Length() * 2;
+  m_SampleWeights[1] = x.Cross(z).Length() * 2;
+  m_SampleWeights[2] = x.Cross(y).Length() * 2;
 
   m_SampleDist = std::discrete_distribution<>(
       {m_SampleWeights[0], m_SampleWeights[1], m_SampleWeights[2]});
@@ -25,7 +31,7 @@ float Box::CalculateWeight() {
   return m_Weight;
 }
 
-Ray Box::Sample(std::default_random_engine &rnd) {
+Ray Box::Sample(RandomEngine &rnd) {
   auto axis = m_SampleDist(rnd);
   std::uniform_real_distribution<float> dist(-1, 1);
 
@@ -55,9 +61,10 @@ Ray Box::Sample(std::default_random_engine &rnd) {
     break;
   }
 
-  auto transform = GetTransform();
-  result.position = Vector3::Transform(result.position, transform);
-  result.direction = Vector3::TransformNormal(result.direction, transform);
+  result.position = Vector3::Transform(result.position, GetTransform());
+  // Normals take the inverse transpose, scaled boxes keep their faces
+  result.direction = Vector3::TransformNormal(result.direction, GetTransformInv().Transpose());
+  result.direction.Normalize();
   return result;
 }
 
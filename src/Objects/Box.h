@@ -16,5 +16,5 @@ public:
                  Intersection &_intersect)  override;
   float CalculateWeight() override;
   DirectX::SimpleMath::Ray
-  Sample(std::default_random_engine &rnd) override;
+  Sample(RandomEngine &rnd) override;
 };
@@ -24,16 +24,18 @@ float TriArea(Vector3 a, Vector3 b, Vector3 c) {
 	return (b - a).Cross(c - a).Length() / 2;
 }
 
+// World space area, Sample draws from the transformed triangles
 float Mesh::CalculateWeight() {
 	m_Weight = 0;
 
 	std::vector<float> triWeights;
 	triWeights.reserve(m_Triangles.size());
 
+	auto transform = GetTransform();
 	for (auto tri : m_Triangles) {
-		auto a = m_Vertices[tri.m_Indices[0]];
-		auto b = m_Vertices[tri.m_Indices[1]];
-		auto c = m_Vertices[tri.m_Indices[2]];
+		auto a = Vector3::Transform(m_Vertices[tri.m_Indices[0]], transform);
+		auto b = Vector3::Transform(m_Vertices[tri.m_Indices[1]], transform);
+		auto c = Vector3::Transform(m_Vertices[tri.m_Indices[2]], transform);
 
 		float weight = TriArea(a, b, c);
 		triWeights.push_back(weight);
@@ -46,7 +48,7 @@ float Mesh::CalculateWeight() {
   return m_Weight;
 }
 
-Ray Mesh::Sample(std::default_random_engine &rnd) { 
+Ray Mesh::Sample(RandomEngine &rnd) { 
 	auto triIndex = m_TriSampleWeights(rnd);
 
 	auto tri = m_Triangles[triIndex];
@@ -61,24 +63,22 @@ Ray Mesh::Sample(std::default_random_engine &rnd) {
 		v = 1.0f - v;
 	}
 
-	auto a = m_Vertices[tri.m_Indices[0]];
-	auto b = m_Vertices[tri.m_Indices[1]];
-	auto c = m_Vertices[tri.m_Indices[2]];
+	// Uniform in world space as well, the transform is affine
+	auto transform = GetTransform();
+	auto a = Vector3::Transform(m_Vertices[tri.m_Indices[0]], transform);
+	auto b = Vector3::Transform(m_Vertices[tri.m_Indices[1]], transform);
+	auto c = Vector3::Transform(m_Vertices[tri.m_Indices[2]], transform);
 
 	auto ab = b - a;
 	auto ac = c - a;
 
-	auto pos = a + ab * u + ac * v;
-
 	auto norm = ab.Cross(ac);
 	norm.Normalize();
 
-	auto transform = GetTransform();
-
 	Ray r;
 
-	r.position = Vector3::Transform(pos, transform);
-	r.direction = Vector3::TransformNormal(norm, transform);
+	r.position = a + ab * u + ac * v;
+	r.direction = norm;
 
 	return r;
 }
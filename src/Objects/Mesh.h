@@ -5,7 +5,7 @@
 #include "../Geometry/Triangle.h"
 
 class Mesh : public RenderObject {
-private:
+protected:
   std::vector<Triangle> m_Triangles;
   std::vector<DirectX::SimpleMath::Vector3> m_Vertices;
   std::vector<DirectX::SimpleMath::Vector3> m_Normals;
@@ -26,7 +26,7 @@ public:
   float CalculateWeight() override;
 
   DirectX::SimpleMath::Ray
-  Sample(std::default_random_engine &rnd) override;
+  Sample(RandomEngine &rnd) override;
 
   virtual bool HasBuffers() const { return true; }
   virtual const DirectX::SimpleMath::Vector3 *GetVertexBuffer() const override {
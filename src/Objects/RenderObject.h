@@ -1,6 +1,7 @@
 #pragma once
 #include "../SimpleMath.h"
 #include <random>
+#include "../Rendering/RandomEngine.h"
 #include <memory>
 #include "BaseObject.h"
 #include "../Rendering/Materials/Material.h"
@@ -17,7 +18,7 @@ public:
 	RenderObject(BaseObject* _parent);
 
   virtual float CalculateWeight() = 0;
-  virtual DirectX::SimpleMath::Ray Sample(std::default_random_engine &rnd) = 0;
+  virtual DirectX::SimpleMath::Ray Sample(RandomEngine &rnd) = 0;
   virtual bool Intersect(const DirectX::SimpleMath::Ray &_ray,
                          Intersection &_intersect) = 0;
 
@@ -28,6 +29,14 @@ public:
   virtual size_t GetTriangleCount() const { return 0; }
   virtual const DirectX::SimpleMath::Vector2* GetUVBuffer() const { return nullptr; }
 
+  // Vertex positions change between frames, the topology stays
+  virtual bool IsDeforming() const { return false; }
+  // Vertex positions at a frame, while the object itself stays at the
+  // current one
+  virtual const DirectX::SimpleMath::Vector3* GetVertexBufferAt(int frameIndex) {
+    return GetVertexBuffer();
+  }
+
 	void SetMaterial(Material *_mat);
 	Material *GetMaterial() const;
 };
@@ -1,5 +1,6 @@
 #include "Sphere.h"
 #include "../Geometry/Intersection.h"
+#include <algorithm>
 
 using namespace DirectX::SimpleMath;
 
@@ -49,23 +50,28 @@ bool Sphere::Intersect(const Ray &_ray, Intersection &_intersect) {
   return false;
 }
 
+// World space surface area, spheres are only scaled uniformly
 float Sphere::CalculateWeight() {
-  m_Weight = 4 * m_Sphere.Radius * DirectX::XM_PI * DirectX::XM_PI;
+  float scale = Vector3::TransformNormal(Vector3(1, 0, 0), GetTransform()).Length();
+  float radius = m_Sphere.Radius * scale;
+  m_Weight = 4 * DirectX::XM_PI * radius * radius;
   return m_Weight;
 }
 
-Ray Sphere::Sample(std::default_random_engine &rnd) {
+// Uniform over the surface area
+Ray Sphere::Sample(RandomEngine &rnd) {
   std::uniform_real_distribution<float> dist(0, 1);
   float omega = dist(rnd) * DirectX::XM_2PI;
-  float phi = dist(rnd) * DirectX::XM_PI;
+  float z = 1.0f - 2.0f * dist(rnd);
+  float r = sqrtf(std::max(0.0f, 1.0f - z * z));
 
   Ray result;
-  result.direction =
-      Vector3(sinf(phi) * cosf(omega), sinf(phi) * sinf(omega), cosf(phi));
+  result.direction = Vector3(r * cosf(omega), r * sinf(omega), z);
   result.position = result.direction * m_Sphere.Radius;
 
   auto transform = GetTransform();
   result.position = Vector3::Transform(result.position, transform);
   result.direction = Vector3::TransformNormal(result.direction, transform);
+  result.direction.Normalize();
   return result;
 }
\ No newline at end of file
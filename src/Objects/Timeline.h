@@ -24,22 +24,59 @@ inline DirectX::SimpleMath::Quaternion interpolate<DirectX::SimpleMath::Quaterni
 template <typename ValueType> struct Timeline {
   std::vector<Keyframe<ValueType>> keyframes;
 
-  ValueType EvaluateAtFrame(int index) {
-    auto it = std::find_if(std::begin(keyframes), std::end(keyframes),
-                           [index](Keyframe<ValueType> frame) {
-                             return frame.FrameIndex > index;
-                           });
-    if (it == keyframes.end())
-      return keyframes[keyframes.size() - 1].Value;
-    if (it - std::begin(keyframes) == 0)
+  // Segment of the last EvaluateAtFrame, playback mostly moves forward so
+  // the next frame lands in it or the one after
+  int cursor = 0;
+
+  ValueType EvaluateAtFrame(int index) { return Evaluate(float(index), cursor); }
+
+  // Value at a fractional frame, for times within the shutter
+  ValueType Evaluate(float time) const {
+    return Interpolate(FindSegment(time, -2), time);
+  }
+
+  // Same with a caller owned cursor, updated to the segment of time
+  ValueType Evaluate(float time, int &_cursor) const {
+    _cursor = FindSegment(time, _cursor);
+    return Interpolate(_cursor, time);
+  }
+
+private:
+  // Index of the last keyframe at or before time, -1 before the first. The
+  // hint and its successor are tried before a binary search, hints outside
+  // [-1, count) are ignored.
+  int FindSegment(float time, int hint) const {
+    int count = int(keyframes.size());
+    auto contains = [&](int segment) {
+      return (segment < 0 || keyframes[segment].FrameIndex <= time) &&
+             (segment + 1 >= count || keyframes[segment + 1].FrameIndex > time);
+    };
+    if (hint >= -1 && hint < count) {
+      if (contains(hint))
+        return hint;
+      if (hint + 1 < count && contains(hint + 1))
+        return hint + 1;
+    }
+
+    auto it = std::upper_bound(std::begin(keyframes), std::end(keyframes), time,
+                               [](float t, const Keyframe<ValueType> &frame) {
+                                 return t < frame.FrameIndex;
+                               });
+    return int(it - std::begin(keyframes)) - 1;
+  }
+
+  ValueType Interpolate(int segment, float time) const {
+    if (segment < 0)
       return keyframes[0].Value;
+    if (segment + 1 >= int(keyframes.size()))
+      return keyframes[keyframes.size() - 1].Value;
 
-    auto startFrame = it - 1;
-    auto endFrame = it;
+    const auto &startFrame = keyframes[segment];
+    const auto &endFrame = keyframes[segment + 1];
 
-    float t = float(index - startFrame->FrameIndex) /
-              (endFrame->FrameIndex - startFrame->FrameIndex);
+    float t = (time - startFrame.FrameIndex) /
+              (endFrame.FrameIndex - startFrame.FrameIndex);
 
-    return interpolate(startFrame->Value, endFrame->Value, t);
+    return interpolate(startFrame.Value, endFrame.Value, t);
   }
 };
\ No newline at end of file
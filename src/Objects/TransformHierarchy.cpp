@@ -0,0 +1,73 @@
+#include "TransformHierarchy.h"
+#include "BaseObject.h"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace DirectX::SimpleMath;
+
+void TransformHierarchy::Build(const std::vector<BaseObject *> &_objects) {
+  // Depth of every object, parents missing from the list are added
+  std::unordered_map<BaseObject *, int> depths;
+  std::vector<BaseObject *> objects;
+  for (auto obj : _objects) {
+    std::vector<BaseObject *> chain;
+    for (auto o = obj; o && !depths.count(o); o = o->m_Parent) {
+      chain.push_back(o);
+    }
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+      auto parent = (*it)->m_Parent;
+      depths[*it] = parent ? depths[parent] + 1 : 0;
+      objects.push_back(*it);
+    }
+  }
+
+  std::stable_sort(objects.begin(), objects.end(),
+                   [&](BaseObject *a, BaseObject *b) { return depths[a] < depths[b]; });
+
+  m_Objects = objects;
+  m_Parents.assign(objects.size(), -1);
+  m_LevelStarts.clear();
+  // Identity like the matrices of unmoved objects, the first Update only
+  // has to fill in what differs
+  m_World.assign(objects.size(), Matrix::Identity());
+  m_WorldInverse.assign(objects.size(), Matrix::Identity());
+
+  for (int i = 0; i < int(objects.size()); i++) {
+    if (i == 0 || depths[objects[i]] != depths[objects[i - 1]]) {
+      m_LevelStarts.push_back(i);
+    }
+    objects[i]->m_Hierarchy = this;
+    objects[i]->m_TransformIndex = i;
+  }
+  m_LevelStarts.push_back(int(objects.size()));
+
+  for (int i = 0; i < int(objects.size()); i++) {
+    if (objects[i]->m_Parent) {
+      m_Parents[i] = objects[i]->m_Parent->m_TransformIndex;
+    }
+  }
+}
+
+bool TransformHierarchy::Update() {
+  bool moved = false;
+
+  for (size_t level = 0; level + 1 < m_LevelStarts.size(); level++) {
+    int begin = m_LevelStarts[level];
+    int end = m_LevelStarts[level + 1];
+
+#pragma omp parallel for schedule(static) reduction(|| : moved)
+    for (int i = begin; i < end; i++) {
+      Matrix world = m_Objects[i]->GetLocalTransform();
+      if (m_Parents[i] >= 0) {
+        world = world * m_World[m_Parents[i]];
+      }
+      if (world != m_World[i]) {
+        m_World[i] = world;
+        m_WorldInverse[i] = world.Invert();
+        moved = true;
+      }
+    }
+  }
+
+  return moved;
+}
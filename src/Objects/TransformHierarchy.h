@@ -0,0 +1,39 @@
+#pragma once
+#include "../SimpleMath.h"
+#include <vector>
+
+class BaseObject;
+
+/********************************************
+** TransformHierarchy
+** World matrices and their inverses of all
+** scene objects in one array, ordered by depth
+** so every parent comes before its children.
+** Recomputed once per frame, one parallel
+** loop per level. Attached objects read their
+** transforms from here.
+*********************************************/
+
+class TransformHierarchy {
+  std::vector<BaseObject *> m_Objects;
+  // Index of the parent of each entry, -1 for roots
+  std::vector<int> m_Parents;
+  // First entry of every depth level, plus the end
+  std::vector<int> m_LevelStarts;
+
+  std::vector<DirectX::SimpleMath::Matrix> m_World;
+  std::vector<DirectX::SimpleMath::Matrix> m_WorldInverse;
+
+public:
+  // Attaches the objects and all their parents
+  void Build(const std::vector<BaseObject *> &_objects);
+
+  // Recomputes the world matrices from the local transforms, true if any
+  // of them changed
+  bool Update();
+
+  const DirectX::SimpleMath::Matrix &GetWorld(int _index) const { return m_World[_index]; }
+  const DirectX::SimpleMath::Matrix &GetWorldInverse(int _index) const {
+    return m_WorldInverse[_index];
+  }
+};
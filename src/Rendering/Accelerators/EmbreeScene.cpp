@@ -2,6 +2,13 @@
 #include "../../Objects/RenderObject.h"
 #include "../../Geometry/Intersection.h"
 #include "../../Geometry/Triangle.h"
+#include "../Materials/TransparentMaterial.h"
+#include "../Statistics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
 
 using namespace DirectX::SimpleMath;
 
@@ -39,52 +46,207 @@ void error_handler(const RTCError code, const char *str) {
   exit(1);
 }
 
-EmbreeScene::EmbreeScene() {
+static Vector2 InterpolateUV(const RenderObject *obj, unsigned primID, float u, float v) {
+  auto uvBuffer = obj->GetUVBuffer();
+  if (!uvBuffer) {
+    return {0, 0};
+  }
+
+  auto face = obj->GetIndexBuffer()[primID];
+  auto uv0 = uvBuffer[face.m_Indices[0]];
+  auto uv1 = uvBuffer[face.m_Indices[1]];
+  auto uv2 = uvBuffer[face.m_Indices[2]];
+  return (1.0f - u - v) * uv0 + u * uv1 + v * uv2;
+}
+
+// Texture space length per world space length on a triangle, from twice
+// its uv area and twice its world area (the length of the Embree normal)
+static float UVScale(const RenderObject *obj, unsigned primID, float worldArea) {
+  auto uvBuffer = obj->GetUVBuffer();
+  if (!uvBuffer || worldArea <= 0.0f) {
+    return 0.0f;
+  }
+
+  auto face = obj->GetIndexBuffer()[primID];
+  Vector2 e1 = uvBuffer[face.m_Indices[1]] - uvBuffer[face.m_Indices[0]];
+  Vector2 e2 = uvBuffer[face.m_Indices[2]] - uvBuffer[face.m_Indices[0]];
+  return std::sqrt(std::abs(e1.x * e2.y - e1.y * e2.x) / worldArea);
+}
+
+// Uniform number in [0, 1) from the ray and the candidate hit. Every ray
+// gets its own cut-out pattern, but retracing a ray gives the same answer.
+static float HitHash(const RTCRay &ray) {
+  uint32_t bits[7];
+  std::memcpy(bits, ray.org, 3 * sizeof(float));
+  std::memcpy(bits + 3, ray.dir, 3 * sizeof(float));
+  bits[6] = ray.primID;
+
+  uint32_t h = 0x7F4A7C15u;
+  for (uint32_t b : bits) {
+    h = (h ^ b) * 0x9E3779B9u;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+  }
+  return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// Intersection and occlusion filter of geometry with a transparent
+// material, rejects hits with the passthrough probability of its opacity
+// during traversal instead of spending a path bounce on them
+static void AlphaFilter(void *userPtr, RTCRay &ray) {
+  auto obj = (const RenderObject *)userPtr;
+  auto material = (const TransparentMaterial *)obj->GetMaterial();
+
+  Color opacity = material->Opacity->Sample(InterpolateUV(obj, ray.primID, ray.u, ray.v));
+  float passthrough = opacity.ToVector3().Dot(Vector3(1.0f / 3.0f));
+  if (HitHash(ray) < passthrough) {
+    STAT_INC(AlphaRejections);
+    ray.geomID = RTC_INVALID_GEOMETRY_ID;
+  }
+}
+
+EmbreeScene::EmbreeScene() : m_LastCommitTime(0) {
   m_Device = rtcNewDevice(nullptr);
   rtcDeviceSetErrorFunction(m_Device, error_handler);
   m_Scene = rtcDeviceNewScene(m_Device, RTC_SCENE_STATIC, RTC_INTERSECT1);
 }
 
-void EmbreeScene::Clear()
+void EmbreeScene::Clear(bool dynamic)
 {
 	rtcDeleteScene(m_Scene);
-	m_Scene = rtcDeviceNewScene(m_Device, RTC_SCENE_STATIC, RTC_INTERSECT1);
+	m_Scene = rtcDeviceNewScene(m_Device, dynamic ? RTC_SCENE_DYNAMIC : RTC_SCENE_STATIC,
+	                            RTC_INTERSECT1);
+	m_Deformable.clear();
+}
+
+// Transforms evenly spread over the shutter, a single one if nothing moves
+// or deforms
+static std::vector<Matrix> MotionTransforms(RenderObject *obj, int frameIndex, float shutter) {
+  std::vector<Matrix> transforms;
+  if (shutter > 0) {
+    for (int i = 0; i < MOTION_STEPS; i++) {
+      float t = float(i) / (MOTION_STEPS - 1) - 0.5f;
+      transforms.push_back(obj->GetTransformAt(frameIndex + t * shutter));
+    }
+    if (!obj->IsDeforming() &&
+        std::all_of(transforms.begin(), transforms.end(),
+                    [&](const Matrix &m) { return m == transforms[0]; })) {
+      transforms.clear();
+    }
+  }
+  if (transforms.empty()) {
+    transforms.push_back(obj->GetTransformAt(float(frameIndex)));
+  }
+  return transforms;
 }
 
-bool EmbreeScene::AddObject(RenderObject *obj) {
+// Deforming objects blend the vertices of the frames around each step, so
+// one BVH covers the whole shutter
+static void WriteVertices(RTCScene scene, unsigned geomID, RenderObject *obj, int frameIndex,
+                          float shutter, const std::vector<Matrix> &transforms) {
+  size_t count = obj->GetVertexCount();
+  auto vertexPtr = obj->GetVertexBufferAt(frameIndex);
+
+  // GetVertexBufferAt may only hold one frame, copy each before the next
+  std::vector<std::vector<Vector3>> frames;
+  int firstFrame = int(std::floor(frameIndex - 0.5f * shutter));
+  if (obj->IsDeforming() && transforms.size() > 1) {
+    int lastFrame = int(std::ceil(frameIndex + 0.5f * shutter));
+    for (int frame = firstFrame; frame <= lastFrame; frame++) {
+      auto positions = obj->GetVertexBufferAt(frame);
+      frames.emplace_back(positions, positions + count);
+    }
+  }
+
+  for (size_t step = 0; step < transforms.size(); step++) {
+    auto buffer = (RTCBufferType)(RTC_VERTEX_BUFFER0 + step);
+    Vector4 *vertices = (Vector4 *)rtcMapBuffer(scene, geomID, buffer);
+
+    if (frames.empty()) {
+      for (size_t i = 0; i < count; i++) {
+        Vector3 v = Vector3::Transform(vertexPtr[i], transforms[step]);
+        vertices[i] = Vector4(v.x, v.y, v.z, 0);
+      }
+    } else {
+      float time = frameIndex + (float(step) / (transforms.size() - 1) - 0.5f) * shutter;
+      int frame = std::min(int(std::floor(time)) - firstFrame, int(frames.size()) - 2);
+      float alpha = time - (firstFrame + frame);
+      const auto &from = frames[frame], &to = frames[frame + 1];
+
+      for (size_t i = 0; i < count; i++) {
+        Vector3 v = Vector3::Transform(Vector3::Lerp(from[i], to[i], alpha), transforms[step]);
+        vertices[i] = Vector4(v.x, v.y, v.z, 0);
+      }
+    }
+
+    rtcUnmapBuffer(scene, geomID, buffer);
+  }
+}
+
+bool EmbreeScene::AddObject(RenderObject *obj, int frameIndex, float shutter, bool deformable) {
   if (!obj->HasBuffers()) {
     return false;
   }
 
-  auto vertexPtr = (Vector3 *)obj->GetVertexBuffer();
   auto indexPtr = (Triangle *)obj->GetIndexBuffer();
+  auto transforms = MotionTransforms(obj, frameIndex, shutter);
 
-  unsigned geomID =
-      rtcNewTriangleMesh(m_Scene, RTC_GEOMETRY_STATIC, obj->GetTriangleCount(),
-                         obj->GetVertexCount());
-  auto transform = obj->GetTransform();
-
-  Vector4 *vertices =
-      (Vector4 *)rtcMapBuffer(m_Scene, geomID, RTC_VERTEX_BUFFER);
+  unsigned geomID = rtcNewTriangleMesh(
+      m_Scene, deformable ? RTC_GEOMETRY_DEFORMABLE : RTC_GEOMETRY_STATIC,
+      obj->GetTriangleCount(), obj->GetVertexCount(), transforms.size());
+  WriteVertices(m_Scene, geomID, obj, frameIndex, shutter, transforms);
 
-  for (size_t i = 0; i < obj->GetVertexCount(); i++) {
-    Vector3 v = Vector3::Transform(vertexPtr[i], transform);
-    vertices[i] = Vector4(v.x, v.y, v.z, 0);
+  if (deformable) {
+    m_Deformable[obj] = {geomID, transforms.size(), obj->GetVertexCount(), indexPtr};
   }
 
-  rtcUnmapBuffer(m_Scene, geomID, RTC_VERTEX_BUFFER);
-
   rtcSetBuffer(m_Scene, geomID, RTC_INDEX_BUFFER, indexPtr, 0,
                3 * sizeof(uint32_t));
 
   rtcSetUserData(m_Scene, geomID, obj);
 
+  if (obj->GetMaterial()->kind == MaterialKind::Transparent) {
+    rtcSetIntersectionFilterFunction(m_Scene, geomID, AlphaFilter);
+    rtcSetOcclusionFilterFunction(m_Scene, geomID, AlphaFilter);
+  }
+
   return true;
 }
 
-void EmbreeScene::CommitScene() { rtcCommit(m_Scene); }
+bool EmbreeScene::UpdateObject(RenderObject *obj, int frameIndex, float shutter) {
+  if (!obj->HasBuffers()) {
+    return true;
+  }
 
-bool EmbreeScene::Trace(const DirectX::SimpleMath::Ray &_ray,
+  auto it = m_Deformable.find(obj);
+  if (it == m_Deformable.end()) {
+    return false;
+  }
+
+  const Geometry &geometry = it->second;
+  auto transforms = MotionTransforms(obj, frameIndex, shutter);
+  if (transforms.size() != geometry.TimeSteps || obj->GetVertexCount() != geometry.VertexCount ||
+      obj->GetIndexBuffer() != geometry.Indices) {
+    return false;
+  }
+
+  WriteVertices(m_Scene, geometry.ID, obj, frameIndex, shutter, transforms);
+  for (size_t step = 0; step < transforms.size(); step++) {
+    rtcUpdateBuffer(m_Scene, geometry.ID, (RTCBufferType)(RTC_VERTEX_BUFFER0 + step));
+  }
+  return true;
+}
+
+void EmbreeScene::CommitScene() {
+  auto start = std::chrono::high_resolution_clock::now();
+  rtcCommit(m_Scene);
+  m_LastCommitTime = std::chrono::duration<double>(
+                         std::chrono::high_resolution_clock::now() - start)
+                         .count();
+}
+
+bool EmbreeScene::Trace(const DirectX::SimpleMath::Ray &_ray, float _time, float _spread,
                         Intersection &minIntersect) const {
   RTCRay ray;
   ray.org[0] = _ray.position.x;
@@ -101,7 +263,7 @@ bool EmbreeScene::Trace(const DirectX::SimpleMath::Ray &_ray,
   ray.primID = RTC_INVALID_GEOMETRY_ID;
   ray.instID = RTC_INVALID_GEOMETRY_ID;
   ray.mask = 0xFFFFFFFF;
-  ray.time = 0.f;
+  ray.time = _time;
 
   rtcIntersect(m_Scene, ray);
 
@@ -117,28 +279,47 @@ bool EmbreeScene::Trace(const DirectX::SimpleMath::Ray &_ray,
   minIntersect.position = rayPos + ray.tfar * rayDir;
 
   minIntersect.normal = Vector3(ray.Ng);
+  float worldArea = minIntersect.normal.Length();
   minIntersect.normal.Normalize();
 
   minIntersect.hitObject = (RenderObject *)rtcGetUserData(m_Scene, ray.geomID);
+  minIntersect.uv = InterpolateUV(minIntersect.hitObject, ray.primID, ray.u, ray.v);
 
-  auto face = minIntersect.hitObject->GetIndexBuffer()[ray.primID];
+  // Ray cone of the spread angle, stretched on surfaces seen at an angle
+  float cosTheta = std::max(std::abs(minIntersect.normal.Dot(rayDir)), 1e-3f);
+  float distance = ray.tfar * Vector3(ray.dir).Length();
+  minIntersect.footprint = _spread * distance / cosTheta *
+                           UVScale(minIntersect.hitObject, ray.primID, worldArea);
 
-  auto uvBuffer = minIntersect.hitObject->GetUVBuffer();
-
-  if (uvBuffer) {
-    auto uv0 = uvBuffer[face.m_Indices[0]];
-    auto uv1 = uvBuffer[face.m_Indices[1]];
-    auto uv2 = uvBuffer[face.m_Indices[2]];
-
-    minIntersect.uv = (1.0f - ray.u - ray.v) * uv0 + ray.u * uv1 + ray.v * uv2;
-  } else {
-    minIntersect.uv = {0, 0};
-  }
-  
   minIntersect.material = minIntersect.hitObject->GetMaterial();
+  minIntersect.alphaTested = minIntersect.material->kind == MaterialKind::Transparent;
   return true;
 }
 
+bool EmbreeScene::Occluded(const DirectX::SimpleMath::Ray &_ray, float _time,
+                           float _distance) const {
+  RTCRay ray;
+  ray.org[0] = _ray.position.x;
+  ray.org[1] = _ray.position.y;
+  ray.org[2] = _ray.position.z;
+
+  ray.dir[0] = _ray.direction.x;
+  ray.dir[1] = _ray.direction.y;
+  ray.dir[2] = _ray.direction.z;
+
+  ray.tnear = 0.001f;
+  ray.tfar = _distance;
+  ray.geomID = RTC_INVALID_GEOMETRY_ID;
+  ray.primID = RTC_INVALID_GEOMETRY_ID;
+  ray.instID = RTC_INVALID_GEOMETRY_ID;
+  ray.mask = 0xFFFFFFFF;
+  ray.time = _time;
+
+  // Embree sets geomID to 0 on a hit
+  rtcOccluded(m_Scene, ray);
+  return ray.geomID == 0;
+}
+
 EmbreeScene::~EmbreeScene() {
   rtcDeleteScene(m_Scene);
   rtcDeleteDevice(m_Device);
@@ -2,6 +2,10 @@
 #include <embree2/rtcore.h>
 #include <embree2/rtcore_ray.h>
 #include "../../SimpleMath.h"
+#include <unordered_map>
+
+// Time steps of the geometry of objects that move while the shutter is open
+#define MOTION_STEPS 5
 
 class RenderObject;
 struct Intersection;
@@ -10,13 +14,40 @@ class EmbreeScene {
 private:
   RTCDevice m_Device;
   RTCScene m_Scene;
+  double m_LastCommitTime;
+
+  // Deformable geometry that UpdateObject can rewrite
+  struct Geometry {
+    unsigned ID;
+    size_t TimeSteps;
+    size_t VertexCount;
+    const void *Indices;
+  };
+  std::unordered_map<RenderObject *, Geometry> m_Deformable;
 
 public:
   EmbreeScene();
-  void Clear();
-  bool AddObject(RenderObject* obj);
+  // Dynamic scenes refit deformable geometry on commit instead of
+  // rebuilding the whole BVH
+  void Clear(bool dynamic = false);
+  // Adds the object as it is at the frame, without touching its current
+  // state. Objects moving or deforming while the shutter (in frames,
+  // centered on the frame) is open get motion blurred geometry, rays pick
+  // their position with the time of Trace and Occluded.
+  bool AddObject(RenderObject* obj, int frameIndex = 0, float shutter = 0,
+                 bool deformable = false);
+  // Rewrites the vertices of a deformable object in place, false if it has
+  // to be added again because its buffers or time steps changed
+  bool UpdateObject(RenderObject* obj, int frameIndex, float shutter);
   void CommitScene();
-  bool Trace(const DirectX::SimpleMath::Ray &_ray, Intersection &minIntersect) const;
+  // Duration of the last CommitScene call (BVH build) in seconds
+  double GetLastCommitTime() const { return m_LastCommitTime; }
+  // _time in [0, 1] over the shutter, _spread the angle of the ray cone
+  // that gives the footprint of the hit
+  bool Trace(const DirectX::SimpleMath::Ray &_ray, float _time, float _spread,
+             Intersection &minIntersect) const;
+  // Any hit query, true if something lies closer than _distance
+  bool Occluded(const DirectX::SimpleMath::Ray &_ray, float _time, float _distance) const;
   ~EmbreeScene();
 };
 
@@ -0,0 +1,127 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/********************************************
+** HashGrid
+** Spatial hash of spheres for photon and
+** vertex merging lookups. Every sphere is
+** stored in all cells it overlaps so a query
+** only reads a single bucket. Built with a
+** parallel counting sort, read only (and lock
+** free) afterwards.
+*********************************************/
+
+class HashGrid {
+  float m_InvCellSize;
+  uint32_t m_BucketMask;
+
+  std::vector<uint32_t> m_BucketStarts;
+  std::vector<uint32_t> m_Items;
+
+  uint32_t Hash(int x, int y, int z) const {
+    return ((uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^
+            (uint32_t(z) * 83492791u)) &
+           m_BucketMask;
+  }
+
+  int Cell(float v) const { return int(std::floor(v * m_InvCellSize)); }
+
+  // Collects the distinct buckets overlapped by a sphere, at most 8 since
+  // cells are at least as large as the sphere diameter
+  int Buckets(const DirectX::SimpleMath::Vector3 &center, float radius,
+              uint32_t (&buckets)[8]) const {
+    int count = 0;
+    for (int x = Cell(center.x - radius); x <= Cell(center.x + radius); x++) {
+      for (int y = Cell(center.y - radius); y <= Cell(center.y + radius); y++) {
+        for (int z = Cell(center.z - radius); z <= Cell(center.z + radius); z++) {
+          uint32_t bucket = Hash(x, y, z);
+          bool found = false;
+          for (int i = 0; i < count; i++) {
+            found |= buckets[i] == bucket;
+          }
+          if (!found && count < 8) {
+            buckets[count++] = bucket;
+          }
+        }
+      }
+    }
+    return count;
+  }
+
+public:
+  HashGrid() : m_InvCellSize(1), m_BucketMask(0), m_BucketStarts(2, 0) {}
+
+  // getSphere(i, center, radius) describes item i, cellSize has to be at
+  // least twice the largest radius
+  template <typename GetSphere>
+  void Build(size_t count, float cellSize, GetSphere getSphere,
+             int threadCount) {
+    m_InvCellSize = 1.0f / cellSize;
+
+    uint32_t bucketCount = 1;
+    while (bucketCount < count * 2) {
+      bucketCount <<= 1;
+    }
+    m_BucketMask = bucketCount - 1;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> counters(
+        new std::atomic<uint32_t>[bucketCount]);
+    for (uint32_t i = 0; i < bucketCount; i++) {
+      counters[i].store(0, std::memory_order_relaxed);
+    }
+
+    const int n = int(count);
+
+#pragma omp parallel for num_threads(threadCount) schedule(static)
+    for (int i = 0; i < n; i++) {
+      DirectX::SimpleMath::Vector3 center;
+      float radius;
+      getSphere(i, center, radius);
+
+      uint32_t buckets[8];
+      int bucketsUsed = Buckets(center, radius, buckets);
+      for (int b = 0; b < bucketsUsed; b++) {
+        counters[buckets[b]].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    m_BucketStarts.resize(bucketCount + 1);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < bucketCount; i++) {
+      m_BucketStarts[i] = total;
+      total += counters[i].load(std::memory_order_relaxed);
+      counters[i].store(m_BucketStarts[i], std::memory_order_relaxed);
+    }
+    m_BucketStarts[bucketCount] = total;
+
+    m_Items.resize(total);
+
+#pragma omp parallel for num_threads(threadCount) schedule(static)
+    for (int i = 0; i < n; i++) {
+      DirectX::SimpleMath::Vector3 center;
+      float radius;
+      getSphere(i, center, radius);
+
+      uint32_t buckets[8];
+      int bucketsUsed = Buckets(center, radius, buckets);
+      for (int b = 0; b < bucketsUsed; b++) {
+        m_Items[counters[buckets[b]].fetch_add(1, std::memory_order_relaxed)] = i;
+      }
+    }
+  }
+
+  // Calls visit(i) for every item whose cells contain the point. Items can
+  // be further away than their radius, callers check the distance.
+  template <typename Visit>
+  void Query(const DirectX::SimpleMath::Vector3 &point, Visit visit) const {
+    uint32_t bucket = Hash(Cell(point.x), Cell(point.y), Cell(point.z));
+    for (uint32_t i = m_BucketStarts[bucket]; i < m_BucketStarts[bucket + 1]; i++) {
+      visit(m_Items[i]);
+    }
+  }
+};
@@ -0,0 +1,154 @@
+#include "IrradianceCache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define NO_ENTRY 0xFFFFFFFFu
+#define ENTRIES_PER_RECORD 8
+
+static int CellLevel(float size) { return int(std::ceil(std::log2(size))); }
+
+static int Cell(float v, float invCellSize) { return int(std::floor(v * invCellSize)); }
+
+IrradianceCache::IrradianceCache(float accuracy, uint32_t capacity)
+    : m_Accuracy(accuracy), m_Capacity(capacity),
+      m_Records(new Record[capacity]),
+      m_Entries(new Entry[size_t(capacity) * ENTRIES_PER_RECORD]),
+      m_Buckets(new std::atomic<uint32_t>[capacity * 2]) {
+  Clear();
+}
+
+void IrradianceCache::Clear() {
+  for (uint32_t i = 0; i < m_Capacity * 2; i++) {
+    m_Buckets[i].store(NO_ENTRY, std::memory_order_relaxed);
+  }
+  m_RecordCount.store(0, std::memory_order_relaxed);
+  m_EntryCount.store(0, std::memory_order_relaxed);
+  m_MinLevel.store(INT_MAX, std::memory_order_relaxed);
+  m_MaxLevel.store(INT_MIN, std::memory_order_relaxed);
+}
+
+uint32_t IrradianceCache::Size() const {
+  return std::min(m_RecordCount.load(std::memory_order_relaxed), m_Capacity);
+}
+
+uint32_t IrradianceCache::Bucket(int level, int x, int y, int z) const {
+  uint32_t h = (uint32_t(x) * 73856093u) ^ (uint32_t(y) * 19349663u) ^
+               (uint32_t(z) * 83492791u) ^ (uint32_t(level) * 2654435761u);
+  return h % (m_Capacity * 2);
+}
+
+void IrradianceCache::Insert(const Record &record) {
+  uint32_t index = m_RecordCount.fetch_add(1, std::memory_order_relaxed);
+  if (index >= m_Capacity) {
+    return;
+  }
+  m_Records[index] = record;
+
+  // The record is stored in all cells its validity sphere touches, cells
+  // are at least as large as the sphere so that's at most 8
+  float radius = m_Accuracy * record.R;
+  int level = CellLevel(2.0f * radius);
+  float invCellSize = std::ldexp(1.0f, -level);
+  const Vector3 &p = record.Position;
+
+  uint32_t buckets[8];
+  int bucketCount = 0;
+  for (int x = Cell(p.x - radius, invCellSize); x <= Cell(p.x + radius, invCellSize); x++) {
+    for (int y = Cell(p.y - radius, invCellSize); y <= Cell(p.y + radius, invCellSize); y++) {
+      for (int z = Cell(p.z - radius, invCellSize); z <= Cell(p.z + radius, invCellSize); z++) {
+        uint32_t bucket = Bucket(level, x, y, z);
+        if (bucketCount < 8 &&
+            std::find(buckets, buckets + bucketCount, bucket) == buckets + bucketCount) {
+          buckets[bucketCount++] = bucket;
+        }
+      }
+    }
+  }
+
+  for (int b = 0; b < bucketCount; b++) {
+    uint32_t entry = m_EntryCount.fetch_add(1, std::memory_order_relaxed);
+    if (entry >= m_Capacity * ENTRIES_PER_RECORD) {
+      return;
+    }
+
+    // The entry is published with the bucket head, readers see it complete
+    m_Entries[entry].Record = index;
+    uint32_t head = m_Buckets[buckets[b]].load(std::memory_order_relaxed);
+    do {
+      m_Entries[entry].Next = head;
+    } while (!m_Buckets[buckets[b]].compare_exchange_weak(
+        head, entry, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  int current = m_MinLevel.load(std::memory_order_relaxed);
+  while (level < current &&
+         !m_MinLevel.compare_exchange_weak(current, level, std::memory_order_relaxed)) {
+  }
+  current = m_MaxLevel.load(std::memory_order_relaxed);
+  while (level > current &&
+         !m_MaxLevel.compare_exchange_weak(current, level, std::memory_order_relaxed)) {
+  }
+}
+
+// Weighted average of the records after Ward, extrapolated with their
+// gradients
+bool IrradianceCache::Interpolate(Vector3 position, Vector3 normal, Color &E) const {
+  const float minWeight = 1.0f / m_Accuracy;
+
+  float weightSum = 0.0f;
+  Color sum(0, 0, 0, 0);
+
+  int minLevel = m_MinLevel.load(std::memory_order_relaxed);
+  int maxLevel = m_MaxLevel.load(std::memory_order_relaxed);
+
+  for (int level = minLevel; level <= maxLevel; level++) {
+    float invCellSize = std::ldexp(1.0f, -level);
+    uint32_t bucket = Bucket(level, Cell(position.x, invCellSize),
+                             Cell(position.y, invCellSize), Cell(position.z, invCellSize));
+
+    uint32_t entry = m_Buckets[bucket].load(std::memory_order_acquire);
+    for (; entry != NO_ENTRY; entry = m_Entries[entry].Next) {
+      const Record &record = m_Records[m_Entries[entry].Record];
+
+      Vector3 offset = position - record.Position;
+      float distance = offset.Length();
+      float normalError = std::sqrt(std::max(0.0f, 1.0f - normal.Dot(record.Normal)));
+      float weight = 1.0f / std::max(distance / record.R + normalError, 1e-6f);
+      if (weight <= minWeight) {
+        continue;
+      }
+
+      // Records in front of the point see different surroundings
+      if (offset.Dot((normal + record.Normal) * 0.5f) < -0.05f * record.R) {
+        continue;
+      }
+
+      Vector3 rotation = record.Normal.Cross(normal);
+      Color extrapolated(
+          record.E.R() + rotation.Dot(record.RotationGradient[0]) +
+              offset.Dot(record.TranslationGradient[0]),
+          record.E.G() + rotation.Dot(record.RotationGradient[1]) +
+              offset.Dot(record.TranslationGradient[1]),
+          record.E.B() + rotation.Dot(record.RotationGradient[2]) +
+              offset.Dot(record.TranslationGradient[2]),
+          0.0f);
+
+      sum += Color(std::max(0.0f, extrapolated.R()), std::max(0.0f, extrapolated.G()),
+                   std::max(0.0f, extrapolated.B()), 0.0f) *
+             weight;
+      weightSum += weight;
+    }
+  }
+
+  if (weightSum <= 0.0f) {
+    return false;
+  }
+
+  E = sum / weightSum;
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "../../SimpleMath.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/********************************************
+** IrradianceCache
+** Sparse irradiance records with rotational
+** and translational gradients (Ward and
+** Heckbert 1992). Records live in a hashed
+** grid with one level per power of two cell
+** size, inserts are lock free so preview
+** threads can fill the cache while reading.
+*********************************************/
+
+class IrradianceCache {
+public:
+  struct Record {
+    DirectX::SimpleMath::Vector3 Position;
+    DirectX::SimpleMath::Vector3 Normal;
+    DirectX::SimpleMath::Color E;
+    // Harmonic mean distance to the surroundings
+    float R;
+    // One gradient per color channel
+    DirectX::SimpleMath::Vector3 RotationGradient[3];
+    DirectX::SimpleMath::Vector3 TranslationGradient[3];
+  };
+
+private:
+  struct Entry {
+    uint32_t Record;
+    uint32_t Next;
+  };
+
+  const float m_Accuracy;
+  const uint32_t m_Capacity;
+
+  std::unique_ptr<Record[]> m_Records;
+  std::unique_ptr<Entry[]> m_Entries;
+  std::unique_ptr<std::atomic<uint32_t>[]> m_Buckets;
+  std::atomic<uint32_t> m_RecordCount;
+  std::atomic<uint32_t> m_EntryCount;
+  std::atomic<int> m_MinLevel, m_MaxLevel;
+
+  uint32_t Bucket(int level, int x, int y, int z) const;
+
+public:
+  // Records are used up to accuracy * R away
+  IrradianceCache(float accuracy = 0.3f, uint32_t capacity = 1 << 18);
+
+  // Not thread safe
+  void Clear();
+
+  uint32_t Size() const;
+
+  bool Interpolate(DirectX::SimpleMath::Vector3 position,
+                   DirectX::SimpleMath::Vector3 normal,
+                   DirectX::SimpleMath::Color &E) const;
+
+  // Thread safe, drops the record once the cache is full
+  void Insert(const Record &record);
+};
@@ -0,0 +1,281 @@
+#include "SDTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define NO_NODE 0xFFFFFFFFu
+
+// Leaves are split once they saw this many samples times sqrt(2^iteration)
+#define SPATIAL_THRESHOLD 12000.0f
+// Directional nodes holding more than this fraction of the energy are split
+#define DIRECTIONAL_THRESHOLD 0.01f
+#define DIRECTIONAL_MAX_DEPTH 20
+
+// The cylindrical mapping is area preserving, a unit of the square covers
+// 4 pi steradians
+static Vector2 DirectionToSquare(Vector3 _direction) {
+  float cosTheta = std::max(-1.0f, std::min(1.0f, _direction.z));
+  float phi = std::atan2(_direction.y, _direction.x);
+  if (phi < 0.0f) {
+    phi += XM_2PI;
+  }
+  return Vector2(std::min((cosTheta + 1.0f) * 0.5f, 0.99999994f),
+                 std::min(phi / XM_2PI, 0.99999994f));
+}
+
+static Vector3 SquareToDirection(Vector2 _p) {
+  float cosTheta = 2.0f * _p.x - 1.0f;
+  float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+  float phi = XM_2PI * _p.y;
+  return Vector3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// Child containing the point, the point is moved into the child's frame
+static int Quadrant(Vector2 &_p) {
+  int x = _p.x >= 0.5f ? 1 : 0;
+  int y = _p.y >= 0.5f ? 1 : 0;
+  _p.x = _p.x * 2.0f - x;
+  _p.y = _p.y * 2.0f - y;
+  return x + 2 * y;
+}
+
+static void AtomicAdd(std::atomic<float> &target, float value) {
+  float current = target.load(std::memory_order_relaxed);
+  while (!target.compare_exchange_weak(current, current + value,
+                                       std::memory_order_relaxed)) {
+  }
+}
+
+DTree::Node::Node() {
+  for (int i = 0; i < 4; i++) {
+    Sums[i].store(0.0f, std::memory_order_relaxed);
+    Children[i] = 0;
+  }
+}
+
+DTree::Node::Node(const Node &other) { *this = other; }
+
+DTree::Node &DTree::Node::operator=(const Node &other) {
+  for (int i = 0; i < 4; i++) {
+    Sums[i].store(other.Sums[i].load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+    Children[i] = other.Children[i];
+  }
+  return *this;
+}
+
+float DTree::Node::Total() const {
+  float total = 0.0f;
+  for (int i = 0; i < 4; i++) {
+    total += Sums[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void DTree::Record(Vector3 direction, float value) const {
+  if (!(value > 0.0f) || !std::isfinite(value)) {
+    return;
+  }
+
+  Vector2 p = DirectionToSquare(direction);
+  uint32_t index = 0;
+  for (;;) {
+    int child = Quadrant(p);
+    const Node &node = m_Nodes[index];
+    if (!node.Children[child]) {
+      AtomicAdd(node.Sums[child], value);
+      return;
+    }
+    index = node.Children[child];
+  }
+}
+
+float DTree::BuildNode(uint32_t index) {
+  for (int i = 0; i < 4; i++) {
+    uint32_t child = m_Nodes[index].Children[i];
+    if (child) {
+      m_Nodes[index].Sums[i].store(BuildNode(child), std::memory_order_relaxed);
+    }
+  }
+  return m_Nodes[index].Total();
+}
+
+void DTree::Build() { BuildNode(0); }
+
+void DTree::RefineNode(const DTree &previous, uint32_t previousIndex,
+                       uint32_t index, float energy, float total,
+                       float threshold, int depth, int maxDepth) {
+  for (int i = 0; i < 4; i++) {
+    // Nodes that were leaves before spread their energy evenly
+    float childEnergy = energy * 0.25f;
+    uint32_t previousChild = NO_NODE;
+    if (previousIndex != NO_NODE) {
+      const Node &node = previous.m_Nodes[previousIndex];
+      childEnergy = node.Sums[i].load(std::memory_order_relaxed);
+      previousChild = node.Children[i] ? node.Children[i] : NO_NODE;
+    }
+
+    if (depth >= maxDepth || childEnergy <= threshold * total) {
+      continue;
+    }
+
+    uint32_t child = uint32_t(m_Nodes.size());
+    m_Nodes.emplace_back();
+    m_Nodes[index].Children[i] = child;
+    RefineNode(previous, previousChild, child, childEnergy, total, threshold,
+               depth + 1, maxDepth);
+  }
+}
+
+DTree DTree::Refine(float threshold, int maxDepth) const {
+  DTree result;
+  float total = Total();
+  if (total > 0.0f) {
+    result.RefineNode(*this, 0, 0, total, total, threshold, 1, maxDepth);
+  }
+  return result;
+}
+
+Vector3 DTree::Sample(RandomEngine &_rnd) const {
+  std::uniform_real_distribution<float> dist(0, 1);
+
+  Vector2 origin(0, 0);
+  float size = 1.0f;
+  uint32_t index = 0;
+
+  for (;;) {
+    const Node &node = m_Nodes[index];
+
+    float sums[4];
+    for (int i = 0; i < 4; i++) {
+      sums[i] = node.Sums[i].load(std::memory_order_relaxed);
+    }
+
+    float u = dist(_rnd) * (sums[0] + sums[1] + sums[2] + sums[3]);
+    int child = 0;
+    while (child < 3 && (u >= sums[child] || sums[child] <= 0.0f)) {
+      u -= sums[child];
+      child++;
+    }
+
+    size *= 0.5f;
+    origin.x += (child & 1) * size;
+    origin.y += (child >> 1) * size;
+
+    if (!node.Children[child]) {
+      break;
+    }
+    index = node.Children[child];
+  }
+
+  float u = dist(_rnd);
+  float v = dist(_rnd);
+  return SquareToDirection(Vector2(origin.x + u * size, origin.y + v * size));
+}
+
+float DTree::Pdf(Vector3 direction) const {
+  Vector2 p = DirectionToSquare(direction);
+  float pdf = 1.0f / (4.0f * XM_PI);
+  uint32_t index = 0;
+
+  for (;;) {
+    const Node &node = m_Nodes[index];
+    float total = node.Total();
+    if (total <= 0.0f) {
+      return 0.0f;
+    }
+
+    int child = Quadrant(p);
+    pdf *= 4.0f * node.Sums[child].load(std::memory_order_relaxed) / total;
+
+    if (!node.Children[child]) {
+      return pdf;
+    }
+    index = node.Children[child];
+  }
+}
+
+static float &Component(Vector3 &_v, int _axis) {
+  return _axis == 0 ? _v.x : (_axis == 1 ? _v.y : _v.z);
+}
+
+SDTree::SDTree() { Reset(Vector3(-1, -1, -1), Vector3(1, 1, 1)); }
+
+void SDTree::Reset(Vector3 min, Vector3 max) {
+  m_Min = min;
+  m_Size = Vector3::Max(max - min, Vector3(1e-4f, 1e-4f, 1e-4f));
+  m_Nodes.assign(1, Node{0, {0, 0}, 0});
+  m_Leaves.assign(1, Leaf());
+  m_Iteration = 0;
+}
+
+const SDTree::Leaf &SDTree::Lookup(Vector3 position) const {
+  Vector3 p = (position - m_Min) / m_Size;
+  p = Vector3::Max(Vector3(0, 0, 0), Vector3::Min(p, Vector3(1, 1, 1)));
+
+  uint32_t index = 0;
+  while (m_Nodes[index].Children[0]) {
+    const Node &node = m_Nodes[index];
+    float &v = Component(p, node.Axis);
+    int child = v >= 0.5f ? 1 : 0;
+    v = v * 2.0f - child;
+    index = node.Children[child];
+  }
+  return m_Leaves[m_Nodes[index].Leaf];
+}
+
+void SDTree::Record(Vector3 position, Vector3 direction, float value) const {
+  const Leaf &leaf = Lookup(position);
+  leaf.Building.Record(direction, value);
+  leaf.Samples.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SDTree::SplitLeaf(uint32_t index) {
+  Node node = m_Nodes[index];
+  int axis = (node.Axis + 1) % 3;
+
+  uint32_t samples = m_Leaves[node.Leaf].Samples.load(std::memory_order_relaxed) / 2;
+  m_Leaves[node.Leaf].Samples.store(samples, std::memory_order_relaxed);
+  Leaf copy = m_Leaves[node.Leaf];
+  m_Leaves.push_back(copy);
+
+  uint32_t first = uint32_t(m_Nodes.size());
+  m_Nodes.push_back(Node{axis, {0, 0}, node.Leaf});
+  m_Nodes.push_back(Node{axis, {0, 0}, uint32_t(m_Leaves.size() - 1)});
+  m_Nodes[index].Children[0] = first;
+  m_Nodes[index].Children[1] = first + 1;
+}
+
+const DTree *SDTree::SamplingTree(Vector3 position) const {
+  if (!CanSample()) {
+    return nullptr;
+  }
+  const DTree &tree = Lookup(position).Sampling;
+  return tree.Total() > 0.0f ? &tree : nullptr;
+}
+
+void SDTree::Refine() {
+  uint32_t threshold =
+      uint32_t(SPATIAL_THRESHOLD * std::sqrt(std::pow(2.0f, float(m_Iteration))));
+
+  // Children are appended, so they get split again if they still hold too
+  // many samples
+  for (uint32_t i = 0; i < m_Nodes.size(); i++) {
+    if (!m_Nodes[i].Children[0] &&
+        m_Leaves[m_Nodes[i].Leaf].Samples.load(std::memory_order_relaxed) > threshold) {
+      SplitLeaf(i);
+    }
+  }
+
+  for (auto &leaf : m_Leaves) {
+    leaf.Building.Build();
+    leaf.Sampling = leaf.Building;
+    leaf.Building = leaf.Sampling.Refine(DIRECTIONAL_THRESHOLD, DIRECTIONAL_MAX_DEPTH);
+    leaf.Samples.store(0, std::memory_order_relaxed);
+  }
+
+  m_Iteration++;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include "../RandomEngine.h"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/********************************************
+** DTree
+** Directional quadtree over the cylindrical
+** mapping of the sphere (cos theta, phi).
+** Radiance is splatted into the leaves with
+** atomic adds, Build sums up the inner nodes.
+*********************************************/
+
+class DTree {
+  struct Node {
+    mutable std::atomic<float> Sums[4];
+    uint32_t Children[4]; // 0 marks a leaf
+
+    Node();
+    Node(const Node &other);
+    Node &operator=(const Node &other);
+
+    float Total() const;
+  };
+
+  std::vector<Node> m_Nodes;
+
+  float BuildNode(uint32_t index);
+  void RefineNode(const DTree &previous, uint32_t previousIndex,
+                  uint32_t index, float energy, float total, float threshold,
+                  int depth, int maxDepth);
+
+public:
+  DTree() : m_Nodes(1) {}
+
+  void Record(DirectX::SimpleMath::Vector3 direction, float value) const;
+
+  // Sums the inner nodes, has to run before sampling
+  void Build();
+
+  // New empty tree that is finer where the built tree has more energy
+  DTree Refine(float threshold, int maxDepth) const;
+
+  float Total() const { return m_Nodes[0].Total(); }
+
+  DirectX::SimpleMath::Vector3 Sample(RandomEngine &_rnd) const;
+  // Solid angle density of Sample
+  float Pdf(DirectX::SimpleMath::Vector3 direction) const;
+};
+
+/********************************************
+** SDTree
+** Spatial-directional radiance cache for path
+** guiding (Mueller et al. 2017). A binary tree
+** over space holds a DTree per leaf: one to
+** sample from and one that the current
+** iteration records into. Recording is lock
+** free, Refine runs between iterations.
+*********************************************/
+
+class SDTree {
+  struct Leaf {
+    DTree Sampling;
+    DTree Building;
+    mutable std::atomic<uint32_t> Samples;
+
+    Leaf() : Samples(0) {}
+    Leaf(const Leaf &other)
+        : Sampling(other.Sampling), Building(other.Building),
+          Samples(other.Samples.load(std::memory_order_relaxed)) {}
+    Leaf &operator=(const Leaf &other) {
+      Sampling = other.Sampling;
+      Building = other.Building;
+      Samples.store(other.Samples.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+      return *this;
+    }
+  };
+
+  struct Node {
+    int Axis;
+    uint32_t Children[2]; // 0 marks a leaf
+    uint32_t Leaf;
+  };
+
+  DirectX::SimpleMath::Vector3 m_Min, m_Size;
+  std::vector<Node> m_Nodes;
+  std::vector<Leaf> m_Leaves;
+  int m_Iteration;
+
+  const Leaf &Lookup(DirectX::SimpleMath::Vector3 position) const;
+  void SplitLeaf(uint32_t node);
+
+public:
+  SDTree();
+
+  void Reset(DirectX::SimpleMath::Vector3 min, DirectX::SimpleMath::Vector3 max);
+
+  // False until the first iteration finished
+  bool CanSample() const { return m_Iteration > 0; }
+
+  // value is the incident radiance divided by the sampling density
+  void Record(DirectX::SimpleMath::Vector3 position,
+              DirectX::SimpleMath::Vector3 direction, float value) const;
+
+  // Ends an iteration, the recorded radiance becomes the sampling
+  // distribution and the trees adapt to it
+  void Refine();
+
+  // Tree to guide with at the position, null if nothing was learned there
+  const DTree *SamplingTree(DirectX::SimpleMath::Vector3 position) const;
+};
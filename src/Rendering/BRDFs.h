@@ -2,16 +2,26 @@
 #include "../SimpleMath.h"
 #include "Scene.h"
 #include <math.h>
+#include <algorithm>
+#include <cfloat>
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
 enum class InteractionType {
   Diffuse,
+  // Non delta lobes other than Lambertian, e.g. rough microfacets
+  Glossy,
   Specular,
 	Passthrough
 };
 
+// Lobes BSDF::Evaluate and BSDF::Pdf describe, paths can be connected
+// through them
+inline bool IsConnectible(InteractionType _type) {
+  return _type == InteractionType::Diffuse || _type == InteractionType::Glossy;
+}
+
 struct BRDFSample {
   Vector3 Direction;
   float PDF;
@@ -44,7 +54,7 @@ inline Vector3 HemisphereSample(float theta, float phi, Vector3 n) {
   return direction;
 }
 
-inline Vector2 UniformSampleDisk(std::default_random_engine &_rnd) {
+inline Vector2 UniformSampleDisk(RandomEngine &_rnd) {
   std::uniform_real_distribution<float> dist =
       std::uniform_real_distribution<float>(0, 1);
 
@@ -54,7 +64,7 @@ inline Vector2 UniformSampleDisk(std::default_random_engine &_rnd) {
   return {r * cosf(theta), r * sinf(theta)};
 }
 
-inline Vector2 ConcentricSampleDisk(std::default_random_engine &_rnd) {
+inline Vector2 ConcentricSampleDisk(RandomEngine &_rnd) {
   std::uniform_real_distribution<float> dist =
       std::uniform_real_distribution<float>(-1, 1);
 
@@ -93,7 +103,7 @@ inline Vector2 ConcentricSampleDisk(std::default_random_engine &_rnd) {
 
 inline Vector3
 CosWeightedRandomHemisphereDirection2(Vector3 n,
-                                      std::default_random_engine &_rnd) {
+                                      RandomEngine &_rnd) {
   std::uniform_real_distribution<float> dist =
       std::uniform_real_distribution<float>(0, 1);
 
@@ -119,7 +129,7 @@ CosWeightedRandomHemisphereDirection2(Vector3 n,
 
 inline Vector3
 UniformHemisphereSample(Vector3 n,
-    std::default_random_engine &_rnd) {
+    RandomEngine &_rnd) {
     std::uniform_real_distribution<float> dist =
         std::uniform_real_distribution<float>(0, 1);
 
@@ -145,7 +155,7 @@ inline float sign(float val) {
 }
 
 inline BRDFSample BRDFDiffuse(Vector3 normal, Vector3 view,
-                              std::default_random_engine &_rnd) {
+                              RandomEngine &_rnd) {
   float inside = sign(view.Dot(normal));
   normal *= -inside;
   auto out = CosWeightedRandomHemisphereDirection2(normal, _rnd);
@@ -162,7 +172,7 @@ inline float FresnelSchlick(Vector3 H, Vector3 norm, float n1) {
 }
 
 inline BRDFSample BRDFPhong(Vector3 normal, Vector3 view, float kd, float ks, float kt,
-                            float roughness, std::default_random_engine &_rnd) {
+                            float roughness, RandomEngine &_rnd) {
   std::uniform_real_distribution<float> dist =
       std::uniform_real_distribution<float>(0, 1);
 
@@ -224,4 +234,98 @@ inline BRDFSample BRDFPhong(Vector3 normal, Vector3 view, float kd, float ks, fl
 	else pdf = pow(dot, 1.0f / roughness);
 
   return { w1, pdf * fac, InteractionType::Specular};
-}
\ No newline at end of file
+}
+// sin and cos of 2 pi u from polynomials on octants, no library calls.
+// Absolute error below 1e-6.
+inline void SinCos2Pi(float u, float &s, float &c) {
+  static const float h = 0.70710678f;
+  static const float centerCos[4] = {h, -h, -h, h};
+  static const float centerSin[4] = {h, h, -h, -h};
+
+  float t = (u - floorf(u)) * 4.0f;
+  int q = std::min(int(t), 3);
+  float a = (t - q - 0.5f) * (XM_PI * 0.5f);
+  float a2 = a * a;
+
+  float sa = a * (1.0f - a2 / 6.0f * (1.0f - a2 / 20.0f * (1.0f - a2 / 42.0f)));
+  float ca = 1.0f - a2 / 2.0f * (1.0f - a2 / 12.0f * (1.0f - a2 / 30.0f * (1.0f - a2 / 56.0f)));
+
+  c = centerCos[q] * ca - centerSin[q] * sa;
+  s = centerSin[q] * ca + centerCos[q] * sa;
+}
+
+// Orthonormal basis around n (Duff et al. 2017)
+inline void BuildFrame(Vector3 n, Vector3 &t, Vector3 &b) {
+  float s = sign(n.z);
+  float a = -1.0f / (s + n.z);
+  float c = n.x * n.y * a;
+  t = Vector3(1.0f + s * n.x * n.x * a, s * c, -s * n.x);
+  b = Vector3(c, s + n.y * n.y * a, -n.y);
+}
+
+// GGX normal distribution, wm in the local frame
+inline float GGXDistribution(Vector3 wm, float alpha) {
+  float a2 = alpha * alpha;
+  float t = wm.z * wm.z * (a2 - 1.0f) + 1.0f;
+  return a2 / (XM_PI * t * t);
+}
+
+// Smith Lambda of GGX, G1 = 1 / (1 + Lambda)
+inline float GGXLambda(Vector3 w, float alpha) {
+  float z2 = w.z * w.z;
+  if (z2 <= 0.0f) {
+    return FLT_MAX;
+  }
+  float tan2 = (w.x * w.x + w.y * w.y) / z2;
+  return 0.5f * (std::sqrt(1.0f + alpha * alpha * tan2) - 1.0f);
+}
+
+// Visible normal of GGX seen from wo (Heitz 2018), wo.z > 0
+inline Vector3 SampleGGXVNDF(Vector3 wo, float alpha, float u1, float u2) {
+  Vector3 vh(alpha * wo.x, alpha * wo.y, wo.z);
+  vh.Normalize();
+
+  float lengthSquared = vh.x * vh.x + vh.y * vh.y;
+  Vector3 t1 = lengthSquared > 0.0f
+                   ? Vector3(-vh.y, vh.x, 0.0f) / std::sqrt(lengthSquared)
+                   : Vector3(1.0f, 0.0f, 0.0f);
+  Vector3 t2 = vh.Cross(t1);
+
+  float s, c;
+  SinCos2Pi(u2, s, c);
+  float r = std::sqrt(u1);
+  float p1 = r * c;
+  float p2 = r * s;
+  float blend = 0.5f * (1.0f + vh.z);
+  p2 = (1.0f - blend) * std::sqrt(std::max(0.0f, 1.0f - p1 * p1)) + blend * p2;
+
+  Vector3 nh = t1 * p1 + t2 * p2 + vh * std::sqrt(std::max(0.0f, 1.0f - p1 * p1 - p2 * p2));
+  Vector3 wm(alpha * nh.x, alpha * nh.y, std::max(1e-6f, nh.z));
+  wm.Normalize();
+  return wm;
+}
+
+// Unpolarized Fresnel reflectance, eta is the transmitted over the incident
+// index of refraction
+inline float FresnelDielectric(float cosThetaI, float eta) {
+  cosThetaI = std::max(-1.0f, std::min(1.0f, cosThetaI));
+  if (cosThetaI < 0.0f) {
+    eta = 1.0f / eta;
+    cosThetaI = -cosThetaI;
+  }
+
+  float sin2ThetaT = (1.0f - cosThetaI * cosThetaI) / (eta * eta);
+  if (sin2ThetaT >= 1.0f) {
+    return 1.0f;
+  }
+  float cosThetaT = std::sqrt(1.0f - sin2ThetaT);
+
+  float parallel = (eta * cosThetaI - cosThetaT) / (eta * cosThetaI + cosThetaT);
+  float perpendicular = (cosThetaI - eta * cosThetaT) / (cosThetaI + eta * cosThetaT);
+  return 0.5f * (parallel * parallel + perpendicular * perpendicular);
+}
+
+inline Color FresnelSchlick(Color f0, float cosTheta) {
+  float m = pow5(std::max(0.0f, 1.0f - cosTheta));
+  return f0 + (Color(1, 1, 1) - f0) * m;
+}
@@ -40,4 +40,32 @@ void Camera::SetViewMatrix(DirectX::SimpleMath::Matrix matrix) {
       Matrix::CreateTranslation(m_Position));
 }
 
+static thread_local float s_RayTime = 0.5f;
+
+static thread_local Ray s_LastRay;
+
+static thread_local float s_PixelSpread = 0.0f;
+
+float Camera::GetRayTime() { return s_RayTime; }
+
+void Camera::SetRayTime(float _time) { s_RayTime = _time; }
+
+const Ray &Camera::GetLastRay() { return s_LastRay; }
+
+float Camera::GetPixelSpread() { return s_PixelSpread; }
+
+Ray Camera::SetLastRay(const Ray &_ray, float _spread) {
+  s_LastRay = _ray;
+  s_PixelSpread = _spread;
+  return _ray;
+}
+
+void Camera::SampleTime(RandomEngine &_rnd) const {
+  // Without motion blur the time doesn't matter, leave the random stream alone
+  if (m_Shutter > 0) {
+    std::uniform_real_distribution<float> dist(0, 1);
+    s_RayTime = dist(_rnd);
+  }
+}
+
 Camera::~Camera(void) {}
@@ -1,6 +1,7 @@
 #pragma once
 #include "../../SimpleMath.h"
 #include <random>
+#include "../RandomEngine.h"
 
 /********************************************
 ** Camera
@@ -16,8 +17,19 @@ private:
 
   DirectX::SimpleMath::Matrix m_ViewMatrix;
 
+  // Open shutter in frames, centered on the rendered frame
+  float m_Shutter;
+
+protected:
+  // Picks the shutter time of the path started by GetRay
+  void SampleTime(RandomEngine &_rnd) const;
+  // Remembers the result of GetRay for GetLastRay, _spread is the angle
+  // between the rays of neighbouring pixels
+  static DirectX::SimpleMath::Ray SetLastRay(const DirectX::SimpleMath::Ray &_ray,
+                                             float _spread);
+
 public:
-  Camera() : m_Position(), m_Rotation(){};
+  Camera() : m_Position(), m_Rotation(), m_Shutter(0){};
   void SetPosition(DirectX::SimpleMath::Vector3 _pos);
   void SetRotation(DirectX::SimpleMath::Vector3 _rot);
   void LookAt(DirectX::SimpleMath::Vector3 _eye,
@@ -26,9 +38,39 @@ public:
   DirectX::SimpleMath::Matrix GetViewMatrix(void) const;
   void SetViewMatrix(DirectX::SimpleMath::Matrix matrix);
 
+  void SetShutter(float _shutter) { m_Shutter = _shutter; }
+  float GetShutter() const { return m_Shutter; }
+
+  // Time of the last camera ray of the calling thread in [0, 1] over the
+  // shutter, all rays of its path are traced at that time
+  static float GetRayTime();
+  // Restores the time of an earlier camera ray, for integrators that go on
+  // with its path after tracing others
+  static void SetRayTime(float _time);
+  // Last camera ray of the calling thread
+  static const DirectX::SimpleMath::Ray &GetLastRay();
+  // Pixel spread angle of the last camera ray of the calling thread, the
+  // footprint of a hit grows with it and the traced distance
+  static float GetPixelSpread();
+
   virtual DirectX::SimpleMath::Ray GetRay(float _x, float _y, int _w, int _h,
-                                          std::default_random_engine &_rnd,
+                                          RandomEngine &_rnd,
                                           float &weight) const = 0;
 
+  // Maps a world position onto the film (light tracing). pdfW is the solid
+  // angle density of GetRay for that direction within its pixel. Cameras
+  // that can't be reached by a connection return false.
+  virtual bool Project(DirectX::SimpleMath::Vector3 _pos, int _w, int _h,
+                       float &x, float &y, float &pdfW) const {
+    return false;
+  }
+
+  // Solid angle density of GetRay producing _dir within its pixel, 0 if the
+  // camera can't be connected to
+  virtual float DirectionPdf(DirectX::SimpleMath::Vector3 _dir, int _w,
+                             int _h) const {
+    return 0;
+  }
+
   ~Camera(void);
 };
@@ -5,8 +5,10 @@ using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
 Ray PhysicallyBasedCamera::GetRay(float _x, float _y, int _w, int _h,
-                                  std::default_random_engine &_rnd,
+                                  RandomEngine &_rnd,
                                   float &weight) const {
+  SampleTime(_rnd);
+
   float x = _x;
   float y = _y;
   float fovx = m_FOV;          // Horizontal FOV
@@ -44,5 +46,5 @@ Ray PhysicallyBasedCamera::GetRay(float _x, float _y, int _w, int _h,
   result.direction = Vector3::TransformNormal(result.direction, viewMatrix);
 	result.direction.Normalize();
 
-  return result;
+  return SetLastRay(result, 2.0f * tanf(fovy / 2) / _h);
 }
@@ -11,6 +11,16 @@ public:
       : m_FocalDistance(_focalDistance), m_LensRadius(_lensRadius),
         PinholeCamera(_fov){};
   virtual DirectX::SimpleMath::Ray GetRay(float _x, float _y, int _w, int _h,
-                                          std::default_random_engine &_rnd,
+                                          RandomEngine &_rnd,
                                           float &weight) const override;
+
+  // The thin lens can't be hit by light paths
+  virtual bool Project(DirectX::SimpleMath::Vector3 _pos, int _w, int _h,
+                       float &x, float &y, float &pdfW) const override {
+    return false;
+  }
+  virtual float DirectionPdf(DirectX::SimpleMath::Vector3 _dir, int _w,
+                             int _h) const override {
+    return 0;
+  }
 };
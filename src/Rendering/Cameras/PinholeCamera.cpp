@@ -5,8 +5,10 @@ using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
 Ray PinholeCamera::GetRay(float _x, float _y, int _w, int _h,
-                          std::default_random_engine &_rnd,
+                          RandomEngine &_rnd,
                           float &weight) const {
+  SampleTime(_rnd);
+
   float x = _x;
   float y = _y;
   float fovx = m_FOV;          // Horizontal FOV
@@ -25,5 +27,52 @@ Ray PinholeCamera::GetRay(float _x, float _y, int _w, int _h,
   dir.Normalize();
 
   weight = 1;
-  return Ray(pos, dir);
+  return SetLastRay(Ray(pos, dir), 2.0f * tanf(fovy / 2.0f) / _h);
+}
+
+bool PinholeCamera::Project(Vector3 _pos, int _w, int _h, float &x, float &y,
+                            float &pdfW) const {
+  Matrix viewMatrix = GetViewMatrix();
+  Vector3 dir = _pos - viewMatrix.Translation();
+
+  float z = dir.Dot(viewMatrix.Forward());
+  if (z <= 0) {
+    return false;
+  }
+
+  float fovx = m_FOV;
+  float fovy = fovx * _h / _w;
+
+  float halfWidth = _w / 2.0f;
+  float halfHeight = _h / 2.0f;
+
+  float alpha = dir.Dot(viewMatrix.Right()) / z;
+  float beta = dir.Dot(viewMatrix.Up()) / z;
+
+  x = alpha / tanf(fovx / 2.0f) * halfWidth + halfWidth;
+  y = halfHeight - beta / tanf(fovy / 2.0f) * halfHeight;
+
+  // Pixel centers sit on integer coordinates like the samples of the renderer
+  if (x < -0.5f || y < -0.5f || x >= _w - 0.5f || y >= _h - 0.5f) {
+    return false;
+  }
+
+  dir.Normalize();
+  pdfW = DirectionPdf(dir, _w, _h);
+  return true;
+}
+
+float PinholeCamera::DirectionPdf(Vector3 _dir, int _w, int _h) const {
+  Matrix viewMatrix = GetViewMatrix();
+  float cosTheta = _dir.Dot(viewMatrix.Forward());
+  if (cosTheta <= 0) {
+    return 0;
+  }
+
+  float fovx = m_FOV;
+  float fovy = fovx * _h / _w;
+
+  // Area of one pixel on the image plane at distance 1
+  float pixelArea = 4.0f * tanf(fovx / 2.0f) * tanf(fovy / 2.0f) / (_w * _h);
+  return 1.0f / (pixelArea * cosTheta * cosTheta * cosTheta);
 }
@@ -8,6 +8,11 @@ protected:
 public:
   PinholeCamera(float _fov) : m_FOV(_fov){};
   virtual DirectX::SimpleMath::Ray GetRay(float _x, float _y, int _w, int _h,
-                                          std::default_random_engine &_rnd,
+                                          RandomEngine &_rnd,
                                           float &weight) const override;
+
+  virtual bool Project(DirectX::SimpleMath::Vector3 _pos, int _w, int _h,
+                       float &x, float &y, float &pdfW) const override;
+  virtual float DirectionPdf(DirectX::SimpleMath::Vector3 _dir, int _w,
+                             int _h) const override;
 };
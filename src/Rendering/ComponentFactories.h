@@ -3,14 +3,33 @@
 #include "Integrators/BidirectionalPathTracer.h"
 #include "Integrators/GradientDomainPathTracer.h"
 #include "Integrators/DebugView.h"
+#include "Integrators/VertexConnectionMerging.h"
+#include "Integrators/StochasticProgressivePhotonMapper.h"
+#include "Integrators/MetropolisLightTransport.h"
+#include "Integrators/IrradianceCachePreview.h"
+#include "Integrators/ReservoirResampling.h"
 
 inline Integrator *IntegratorFactory(std::string _integrator, Scene *_scene, Camera* _camera, int w, int h) {
   if (_integrator == "PT") {
     return reinterpret_cast<Integrator *>(new PathTracer(_scene, _camera, w, h));
+  } else if (_integrator == "PPG") {
+    return reinterpret_cast<Integrator *>(new PathTracer(_scene, _camera, w, h, true));
   } else if (_integrator == "BDPT") {
     return reinterpret_cast<Integrator *>(new BidirectionalPathTracer(_scene, _camera, w, h));
   } else if (_integrator == "GDPT") {
     return reinterpret_cast<Integrator *>(new GradientDomainPathTracer(_scene, _camera, w, h));
+  } else if (_integrator == "VCM") {
+    return reinterpret_cast<Integrator *>(new VertexConnectionMerging(_scene, _camera, w, h));
+  } else if (_integrator == "SPPM") {
+    return reinterpret_cast<Integrator *>(new StochasticProgressivePhotonMapper(_scene, _camera, w, h));
+  } else if (_integrator == "MLT") {
+    return reinterpret_cast<Integrator *>(new MetropolisLightTransport(_scene, _camera, w, h));
+  } else if (_integrator == "MLT-resume") {
+    return reinterpret_cast<Integrator *>(new MetropolisLightTransport(_scene, _camera, w, h, true));
+  } else if (_integrator == "IC") {
+    return reinterpret_cast<Integrator *>(new IrradianceCachePreview(_scene, _camera, w, h));
+  } else if (_integrator == "RESTIR") {
+    return reinterpret_cast<Integrator *>(new ReservoirResampling(_scene, _camera, w, h));
   } else if (_integrator == "DV") {
 	return reinterpret_cast<Integrator *>(new DebugView(_scene, _camera, w, h));
 }
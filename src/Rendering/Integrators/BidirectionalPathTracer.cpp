@@ -8,194 +8,393 @@
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
-#define RUSSIAN_ROULETTE 0.9f
+// BSDF::Evaluate and BSDF::Pdf are scaled by pi, the MIS weights
+// below work with the actual BSDF and solid angle densities
+#define INV_PI (1.0f / XM_PI)
 
+static bool IsConnectible(const BSDF &_bsdf) {
+  return IsConnectible(_bsdf.Type);
+}
+
+static bool IsBlack(const Color &_color) {
+  return _color.R() <= 0.0f && _color.G() <= 0.0f && _color.B() <= 0.0f;
+}
+
+BidirectionalPathTracer::VertexArena &BidirectionalPathTracer::GetArena() {
+  static thread_local VertexArena arena;
+  return arena;
+}
+
+bool BidirectionalPathTracer::SampleScattering(const Intersection &_intersect,
+                                               const BSDF &_bsdf,
+                                               SubPathState &_state,
+                                               RandomEngine &_rnd) const {
+  Vector3 in = _state.Ray.direction;
+
+  auto sample = _bsdf.Sample(_rnd);
+  if (sample.PDF <= 0.0f) {
+    return false;
+  }
+
+  float cosOut = std::abs(sample.Direction.Dot(_intersect.normal));
+
+  if (!IsConnectible(sample.Type) || !IsConnectible(_bsdf)) {
+    // Treated like a delta lobe, no connections through this vertex
+    _state.Throughput *= _bsdf.Throughput(sample);
+    _state.dVCM = 0.0f;
+    _state.dVC *= cosOut;
+    _state.dVM *= cosOut;
+  } else {
+    float pdfDir = _bsdf.Pdf(in, sample.Direction) * INV_PI;
+    float pdfRev = _bsdf.Pdf(-sample.Direction, -in) * INV_PI;
+    if (pdfDir <= 0.0f) {
+      return false;
+    }
+
+    _state.Throughput *= _bsdf.Evaluate(in, sample.Direction) *
+                         INV_PI * cosOut / pdfDir;
+    _state.dVC = cosOut / pdfDir *
+                 (_state.dVC * pdfRev + _state.dVCM + m_MisVmWeightFactor);
+    _state.dVM = cosOut / pdfDir *
+                 (_state.dVM * pdfRev + _state.dVCM * m_MisVcWeightFactor + 1.0f);
+    _state.dVCM = 1.0f / pdfDir;
+  }
 
-BidirectionalPathTracer::Path
-BidirectionalPathTracer::MakePath(const DirectX::SimpleMath::Ray &_startRay,
-                                  int _depth,
-                                  std::default_random_engine &_rnd) const {
-  Path path;
-  path.reserve(_depth+1);
-  Ray ray = _startRay;
+  _state.Ray = Ray(_intersect.position + sample.Direction * 0.001f,
+                   sample.Direction);
+  _state.PathLength++;
 
+  return !IsBlack(_state.Throughput);
+}
+
+void BidirectionalPathTracer::TraceLightPath(int _depth, std::vector<PathVertex> &_vertices,
+                                             RandomEngine &_rnd) const {
   std::uniform_real_distribution<float> dist(0, 1);
 
-  float throughput = 1.0f;
+  RenderObject *light;
+  float pickProbability;
+  Ray lightStart = m_Scene->SampleLight(_rnd, &light, pickProbability);
+
+  // Emitters are two sided, pick a side and sample the cosine lobe
+  Vector3 lightNormal = lightStart.direction;
+  lightNormal.Normalize();
+  if (dist(_rnd) < 0.5f) {
+    lightNormal = -lightNormal;
+  }
+
+  Vector3 direction = CosWeightedRandomHemisphereDirection2(lightNormal, _rnd);
+  float cosLight = std::abs(direction.Dot(lightNormal));
+  if (cosLight <= 0.0f) {
+    return;
+  }
+
+  float directPdfA = m_Scene->LightPdfA();
+  float emissionPdfW = directPdfA * cosLight * INV_PI * 0.5f;
+
+  Intersection lightPoint = {lightStart.position, lightNormal, Vector2(0, 0),
+                             light->GetMaterial(), light};
+  Color Le = light->GetMaterial()->Evaluate(lightPoint).Emission;
+
+  SubPathState state;
+  state.Ray = Ray(lightStart.position + direction * 0.001f, direction);
+  state.Throughput = Le * cosLight / emissionPdfW;
+  state.PathLength = 1;
+  state.dVCM = directPdfA / emissionPdfW;
+  state.dVC = cosLight / emissionPdfW;
+  state.dVM = state.dVC * m_MisVcWeightFactor;
 
-  for (int i = 0; i < _depth; ++i) {
-    Intersection minIntersect;
-    if (!m_Scene->Trace(ray, minIntersect)) {
+  for (;;) {
+    Intersection hit;
+    if (!m_Scene->Trace(state.Ray, hit)) {
       break;
     }
 
-    PathVertex v;
-    v.Intersect = minIntersect;
-    v.Normal = minIntersect.normal;
-    v.Pos = minIntersect.position;
-    v.Material = minIntersect.material;
-    v.In = ray.direction;
+    float distSquared = (hit.position - state.Ray.position).LengthSquared();
+    float cosIn = std::abs(state.Ray.direction.Dot(hit.normal));
+    if (cosIn <= 0.0f) {
+      break;
+    }
 
-    v.RelativeWeight = 1;
+    state.dVCM *= distSquared / cosIn;
+    state.dVC /= cosIn;
+    state.dVM /= cosIn;
 
-    /*if (i > 2) {
-      if (dist(_rnd) > RUSSIAN_ROULETTE) {
-        break;
-      } else {
-        v.RelativeWeight = 1.0f / RUSSIAN_ROULETTE;
-      }
-    }*/
+    // Emitters don't reflect
+    if (hit.material->IsLight()) {
+      break;
+    }
 
-    auto sample =
-        minIntersect.material->Sample(minIntersect, ray.direction, _rnd);
-    v.Out = sample.Direction;
-    v.BrdfWeight = sample.PDF;
+    BSDF bsdf = hit.material->Evaluate(hit, state.Ray.direction);
 
-    path.push_back(v);
-    
-		if (minIntersect.material->IsLight()) {
-			break;
-		}
+    if (IsConnectible(bsdf)) {
+      _vertices.push_back({hit, bsdf});
+      PathVertex &vertex = _vertices.back();
+      vertex.In = state.Ray.direction;
+      vertex.Throughput = state.Throughput;
+      vertex.PathLength = state.PathLength;
+      vertex.dVCM = state.dVCM;
+      vertex.dVC = state.dVC;
+      vertex.dVM = state.dVM;
 
-		ray = {minIntersect.position + sample.Direction * 0.001f, sample.Direction};
-  }
+      ConnectToCamera(state, hit, bsdf);
+    }
 
-  return path;
-}
+    if (state.PathLength + 2 > _depth) {
+      break;
+    }
 
-float BidirectionalPathTracer::G(const PathVertex &v0,
-                                 const PathVertex &v1) const {
-  Vector3 w = (v1.Pos - v0.Pos);
-  w.Normalize();
-  return std::abs(v0.Normal.Dot(w)) * std::abs(v1.Normal.Dot(-w)) /
-         Vector3::DistanceSquared(v0.Pos, v1.Pos);
+    if (!SampleScattering(hit, bsdf, state, _rnd)) {
+      break;
+    }
+  }
 }
 
-Color BidirectionalPathTracer::EvalPath(const Path &eye, int nEye,
-                                        const Path &light, int nLight) const {
+void BidirectionalPathTracer::ConnectToCamera(const SubPathState &_state,
+                                              const Intersection &_intersect,
+                                              const BSDF &_bsdf) const {
+  float x, y, cameraPdfW;
+  if (!m_Camera->Project(_intersect.position, m_Width, m_Height, x, y, cameraPdfW)) {
+    return;
+  }
+
+  Vector3 cameraPos = m_Camera->GetViewMatrix().Translation();
+  Vector3 toCamera = cameraPos - _intersect.position;
+  float distSquared = toCamera.LengthSquared();
+  toCamera.Normalize();
 
-  if (nEye == 0 || nLight == 0) return{ 0, 0, 0 };
-  Color L(1, 1, 1, 1);
+  Color f = _bsdf.Evaluate(_state.Ray.direction, toCamera);
+  if (IsBlack(f)) {
+    return;
+  }
+
+  float pdfRev = _bsdf.Pdf(-toCamera, -_state.Ray.direction) * INV_PI;
+  float cosToCamera = std::abs(toCamera.Dot(_intersect.normal));
+
+  // Density of the camera generating this vertex
+  float cameraPdfA = cameraPdfW * cosToCamera / distSquared;
 
-  const static auto evalV = [](const PathVertex &v) {
-    return v.Material->F(v.In, v.Out, v.Normal) * v.Material->GetColor(v.Intersect, v.Type) *
-           std::abs(v.Out.Dot(v.Normal)) / (v.BrdfWeight * v.RelativeWeight);
-  };
+  float wLight = cameraPdfA / LightSubPathCount() *
+                 (m_MisVmWeightFactor + _state.dVCM + _state.dVC * pdfRev);
+  float misWeight = 1.0f / (wLight + 1.0f);
 
-  for (int i = 0; i < nEye - 1; ++i) {
-    L *= evalV(eye[i]);
+  Color contribution = _state.Throughput * f * (misWeight * INV_PI * cameraPdfA / LightSubPathCount());
+  if (IsBlack(contribution)) {
+    return;
   }
 
-  Vector3 w = light[nLight - 1].Pos - eye[nEye - 1].Pos;
-  w.Normalize();
-  Vector3 ww = -w;
+  if (m_Scene->Occluded(_intersect.position, cameraPos)) {
+    return;
+  }
+
+  Splat(x, y, contribution);
+}
+
+Color BidirectionalPathTracer::ConnectToLight(const SubPathState &_state,
+                                              const Intersection &_intersect,
+                                              const BSDF &_bsdf,
+                                              RandomEngine &_rnd) const {
+  RenderObject *light;
+  float pickProbability;
+  Ray lightSample = m_Scene->SampleLight(_rnd, &light, pickProbability);
+
+  Vector3 lightNormal = lightSample.direction;
+  lightNormal.Normalize();
+
+  Vector3 toLight = lightSample.position - _intersect.position;
+  float distSquared = toLight.LengthSquared();
+  toLight.Normalize();
 
-  L *= eye[nEye - 1].Material->F(eye[nEye - 1].In, w, eye[nEye-1].Normal) *
-       eye[nEye - 1].Material->GetColor(eye[nEye - 1].Intersect, eye[nEye - 1].Type) *
-       //G(eye[nEye - 1], light[nLight - 1]) *
-       light[nLight - 1].Material->F(ww, light[nLight - 1].In, light[nLight - 1].Normal) /
-       (eye[nEye - 1].RelativeWeight * light[nLight - 1].RelativeWeight);
-	
+  float cosAtLight = std::abs(toLight.Dot(lightNormal));
+  if (cosAtLight <= FLT_EPSILON) {
+    return Color(0, 0, 0, 0);
+  }
 
-  for (int i = nLight - 2; i >= 0; --i) {
-    L *= evalV(light[i]);
+  Vector3 in = _state.Ray.direction;
+  Color f = _bsdf.Evaluate(in, toLight);
+  if (IsBlack(f)) {
+    return Color(0, 0, 0, 0);
   }
 
-  if (L.R() == 0.0f && L.G() == 0.0f && L.B() == 0.0f) {
-    return L;
+  float pdfA = m_Scene->LightPdfA();
+  float directPdfW = pdfA * distSquared / cosAtLight;
+  float emissionPdfW = pdfA * cosAtLight * INV_PI * 0.5f;
+  float cosToLight = std::abs(toLight.Dot(_intersect.normal));
+
+  float bsdfDirPdfW = _bsdf.Pdf(in, toLight) * INV_PI;
+  float bsdfRevPdfW = _bsdf.Pdf(-toLight, -in) * INV_PI;
+
+  float wLight = bsdfDirPdfW / directPdfW;
+  float wCamera = emissionPdfW * cosToLight / (directPdfW * cosAtLight) *
+                  (m_MisVmWeightFactor + _state.dVCM + _state.dVC * bsdfRevPdfW);
+  float misWeight = 1.0f / (wLight + 1.0f + wCamera);
+
+  Intersection lightPoint = {lightSample.position, lightNormal, Vector2(0, 0),
+                             light->GetMaterial(), light};
+  Color Le = light->GetMaterial()->Evaluate(lightPoint).Emission;
+
+  Color contribution = Le * f * (misWeight * INV_PI * cosToLight / directPdfW);
+  if (IsBlack(contribution)) {
+    return Color(0, 0, 0, 0);
   }
 
-  if (!m_Scene->Test(eye[nEye - 1].Pos, light[nLight - 1].Pos)) {
-    return Color(0.0f, 0.0f, 0.0f);
+  if (m_Scene->Occluded(_intersect.position, lightSample.position)) {
+    return Color(0, 0, 0, 0);
   }
 
-  return L;
+  return contribution;
 }
 
-Color BidirectionalPathTracer::EvalPath(const Path &eye, int nEye) const {
+Color BidirectionalPathTracer::ConnectVertices(const SubPathState &_state,
+                                               const Intersection &_intersect,
+                                               const BSDF &_bsdf,
+                                               const PathVertex &_lightVertex) const {
+  const Intersection &lightHit = _lightVertex.Intersect;
 
-	if (nEye == 0) return{ 0, 0, 0 };
-	Color L(1, 1, 1, 1);
+  Vector3 direction = lightHit.position - _intersect.position;
+  float distSquared = direction.LengthSquared();
+  direction.Normalize();
 
-	const static auto evalV = [](const PathVertex &v) {
-		return v.Material->F(v.In, v.Out, v.Normal) * v.Material->GetColor(v.Intersect, v.Type) *
-			std::abs(v.Out.Dot(v.Normal)) / (v.BrdfWeight * v.RelativeWeight);
-	};
+  Vector3 in = _state.Ray.direction;
+  Color cameraF = _bsdf.Evaluate(in, direction);
+  if (IsBlack(cameraF)) {
+    return Color(0, 0, 0, 0);
+  }
 
-	for (int i = 0; i < nEye-1; ++i) {
-		L *= evalV(eye[i]);
-	}
+  Color lightF = _lightVertex.Bsdf.Evaluate(_lightVertex.In, -direction);
+  if (IsBlack(lightF)) {
+    return Color(0, 0, 0, 0);
+  }
 
-	return L;
-}
+  float cameraDirPdfW = _bsdf.Pdf(in, direction) * INV_PI;
+  float cameraRevPdfW = _bsdf.Pdf(-direction, -in) * INV_PI;
+  float lightDirPdfW = _lightVertex.Bsdf.Pdf(_lightVertex.In, -direction) * INV_PI;
+  float lightRevPdfW = _lightVertex.Bsdf.Pdf(direction, -_lightVertex.In) * INV_PI;
 
-Color BidirectionalPathTracer::IlluminatePoint(
-    Vector3 pos, Vector3 normal, std::default_random_engine &_rnd) const {
-  RenderObject *sampledLight;
-  float Le;
-  Ray lightStart = m_Scene->SampleLight(_rnd, &sampledLight, Le);
-  lightStart.direction =
-      CosWeightedRandomHemisphereDirection2(lightStart.direction, _rnd);
+  float cosCamera = std::abs(direction.Dot(_intersect.normal));
+  float cosLight = std::abs(direction.Dot(lightHit.normal));
 
-  Color L = sampledLight->GetMaterial()->GetColor(Intersection(), InteractionType::Diffuse);
-  L *= G(PathVertex{pos, normal},
-         PathVertex{lightStart.position, lightStart.direction}) *
-       Le * XM_PI;
+  float geometryTerm = cosLight * cosCamera / distSquared;
 
-  if (L.R() == 0.0f && L.G() == 0.0f && L.B() == 0.0f) {
-    return L;
+  float cameraDirPdfA = cameraDirPdfW * cosLight / distSquared;
+  float lightDirPdfA = lightDirPdfW * cosCamera / distSquared;
+
+  float wLight = cameraDirPdfA * (m_MisVmWeightFactor + _lightVertex.dVCM +
+                                  _lightVertex.dVC * lightRevPdfW);
+  float wCamera = lightDirPdfA * (m_MisVmWeightFactor + _state.dVCM +
+                                  _state.dVC * cameraRevPdfW);
+  float misWeight = 1.0f / (wLight + 1.0f + wCamera);
+
+  Color contribution = cameraF * lightF * (misWeight * geometryTerm * INV_PI * INV_PI);
+  if (IsBlack(contribution)) {
+    return Color(0, 0, 0, 0);
   }
 
-  if (!m_Scene->Test(pos, lightStart.position)) {
-    return Color(0.0f, 0.0f, 0.0f);
+  if (m_Scene->Occluded(_intersect.position, lightHit.position)) {
+    return Color(0, 0, 0, 0);
   }
-  return L;
+
+  return contribution;
 }
 
-Color BidirectionalPathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary, std::default_random_engine &_rnd) const {
-  if (_depth == 0) {
-    return Color(0, 0, 0);
+Color BidirectionalPathTracer::EmittedRadiance(const SubPathState &_state,
+                                               const Intersection &_intersect,
+                                               const BSDF &_bsdf) const {
+  Color Le = _bsdf.Emission;
+
+  // Directly visible emitters can only be found by the eye path
+  if (_state.PathLength == 1) {
+    return Le;
   }
 
-  RenderObject *sampledLight;
-  float Le;
-  Ray lightStart = m_Scene->SampleLight(_rnd, &sampledLight, Le);
-  lightStart.direction =
-      CosWeightedRandomHemisphereDirection2(lightStart.direction, _rnd);
+  float directPdfA = m_Scene->LightPdfA();
+  float cosOut = std::abs(_state.Ray.direction.Dot(_intersect.normal));
+  float emissionPdfW = directPdfA * cosOut * INV_PI * 0.5f;
+
+  float wCamera = directPdfA * _state.dVCM + emissionPdfW * _state.dVC;
+  return Le * (1.0f / (1.0f + wCamera));
+}
+
+Color BidirectionalPathTracer::TraceEyePath(const Ray &_ray, int _depth,
+                                            const PathVertex *_lightVertices,
+                                            size_t _lightVertexCount,
+                                            RandomEngine &_rnd) const {
+  SubPathState state;
+  state.Ray = _ray;
+  state.Throughput = Color(1, 1, 1, 0);
+  state.PathLength = 1;
 
-  // Generate eye and light sub-paths
-  auto lightPath = MakePath(lightStart, _depth, _rnd);
-  auto eyePath = MakePath(_ray, _depth, _rnd);
+  float cameraPdfW = m_Camera->DirectionPdf(_ray.direction, m_Width, m_Height);
+  state.dVCM = cameraPdfW > 0.0f ? LightSubPathCount() / cameraPdfW : 0.0f;
+  state.dVC = 0.0f;
+  state.dVM = 0.0f;
 
   Color L(0, 0, 0, 0);
-  size_t i, j;
-
-	auto& lastEye = eyePath[eyePath.size() - 1];
-
-	/*if (lastEye.Material->IsLight()) {
-		L = EvalPath(eyePath, eyePath.size()) * lastEye.Material->GetColor(lastEye.Intersect);
-	} else */{
-		//L = EvalPath(eyePath, eyePath.size(), lightPath, lightPath.size()) * Color(3,3,3);
-
-	}
-
-#if 1
-  // Connect bidirectional path prefixes and evaluate throughput
-  Color directWt(1.0f, 1.0f, 1.0f);
-  for (i = 1; i <= eyePath.size(); ++i) {
-    /*// Handle direct lighting for bidirectional integrator
-    directWt *= 1.0f/eyePath[i - 1].RelativeWeight;
-    Color col = eyePath[i - 1].Material->GetColor(eyePath[i - 1].Intersect);
-    L += directWt * col * IlluminatePoint(eyePath[i - 1].Pos, eyePath[i -
-    1].Normal, _rnd) / i;
-    directWt *= col * std::abs(eyePath[i - 1].Out.Dot(eyePath[i - 1].Normal)) /
-    eyePath[i - 1].BrdfWeight;*/
-
-    for (j = 1; j <= lightPath.size(); ++j) {
-      L += EvalPath(eyePath, i, lightPath, j) * 3 / (float)(i + j);
+
+  for (;;) {
+    Intersection hit;
+    if (!m_Scene->Trace(state.Ray, hit)) {
+      break;
+    }
+
+    float distSquared = (hit.position - state.Ray.position).LengthSquared();
+    float cosIn = std::abs(state.Ray.direction.Dot(hit.normal));
+    if (cosIn <= 0.0f) {
+      break;
+    }
+
+    state.dVCM *= distSquared / cosIn;
+    state.dVC /= cosIn;
+    state.dVM /= cosIn;
+
+    BSDF bsdf = hit.material->Evaluate(hit, state.Ray.direction);
+
+    if (bsdf.IsLight()) {
+      L += state.Throughput * EmittedRadiance(state, hit, bsdf);
+      break;
+    }
+
+    if (state.PathLength >= _depth) {
+      break;
+    }
+
+    if (IsConnectible(bsdf)) {
+      L += state.Throughput * ConnectToLight(state, hit, bsdf, _rnd);
+
+      // Light vertices are stored in order of increasing path length
+      for (size_t i = 0; i < _lightVertexCount; i++) {
+        const auto &lightVertex = _lightVertices[i];
+        if (lightVertex.PathLength + 1 + state.PathLength > _depth) {
+          break;
+        }
+
+        L += state.Throughput * lightVertex.Throughput *
+             ConnectVertices(state, hit, bsdf, lightVertex);
+      }
+
+      if (m_MisVmWeightFactor > 0.0f) {
+        L += state.Throughput * Merge(state, hit, bsdf, _depth);
+      }
+    }
+
+    if (!SampleScattering(hit, bsdf, state, _rnd)) {
+      break;
     }
   }
-#endif
 
+  STAT_PATH_LENGTH(state.PathLength);
+
+  L.A(0);
   return L;
-}
\ No newline at end of file
+}
+
+Color BidirectionalPathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary, RandomEngine &_rnd) const {
+  if (_depth == 0) {
+    return Color(0, 0, 0);
+  }
+
+  VertexArena &arena = GetArena();
+  arena.Reset();
+  TraceLightPath(_depth, arena.Vertices, _rnd);
+
+  return TraceEyePath(_ray, _depth, arena.Vertices.data(), arena.Vertices.size(), _rnd);
+}
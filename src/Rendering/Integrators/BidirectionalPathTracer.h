@@ -2,44 +2,108 @@
 #include "Integrator.h"
 #include "../../Geometry/Intersection.h"
 #include "../BRDFs.h"
+#include "../Materials/BSDF.h"
+
+#include <vector>
 
 struct Material;
 class BaseObject;
 
+/********************************************
+** BidirectionalPathTracer
+** Connects every eye path vertex with every
+** light path vertex, samples the lights and
+** splats light path vertices onto the film.
+** Strategies are combined with the balance
+** heuristic using the recursive MIS weights of
+** Georgiev's "Implementing Vertex Connection
+** and Merging" so each weight costs O(1).
+*********************************************/
+
 class BidirectionalPathTracer : public Integrator {
-private:
+protected:
+  // State of a sub path while it is extended
+  struct SubPathState {
+    DirectX::SimpleMath::Ray Ray;
+    DirectX::SimpleMath::Color Throughput;
+    int PathLength;
+    // Partial MIS weights of the strategies that aren't taken
+    float dVCM, dVC, dVM;
+  };
+
   struct PathVertex {
-    DirectX::SimpleMath::Vector3 Pos;
-    DirectX::SimpleMath::Vector3 Normal;
+    Intersection Intersect;
+    // Closure for the direction the path arrived from
+    BSDF Bsdf;
+    // Direction the path arrived from, pointing towards the surface
     DirectX::SimpleMath::Vector3 In;
-    DirectX::SimpleMath::Vector3 Out;
+    DirectX::SimpleMath::Color Throughput;
+    int PathLength;
+    float dVCM, dVC, dVM;
+  };
 
-		InteractionType Type;
-    Intersection Intersect;
-    Material *Material;
-    BaseObject *Prim;
-    float BrdfWeight;
-    float RelativeWeight;
+  // Vertex merging terms of the MIS weights, all zero unless a subclass
+  // merges eye vertices with light vertices
+  float m_MisVmWeightFactor;
+  float m_MisVcWeightFactor;
+  float m_VmNormalization;
+
+  // Light path vertices of the current sample, per thread and reset for
+  // every sample so the storage is reused
+  struct VertexArena {
+    std::vector<PathVertex> Vertices;
+
+    void Reset() { Vertices.clear(); }
   };
 
-  typedef std::vector<PathVertex> Path;
+  static VertexArena &GetArena();
 
-  Path MakePath(const DirectX::SimpleMath::Ray &_startRay, int _depth,
-                std::default_random_engine &_rnd) const;
-  float G(const PathVertex &v0, const PathVertex &v1) const;
-  DirectX::SimpleMath::Color EvalPath(const Path &eye, int nEye,
-                                      const Path &light, int nLight) const;
+  // Appends the connectible vertices of one light path and splats them
+  // onto the film
+  void TraceLightPath(int _depth, std::vector<PathVertex> &_vertices,
+                      RandomEngine &_rnd) const;
 
-	DirectX::SimpleMath::Color EvalPath(const Path & eye, int nEye) const;
+  DirectX::SimpleMath::Color
+  TraceEyePath(const DirectX::SimpleMath::Ray &_ray, int _depth,
+               const PathVertex *_lightVertices, size_t _lightVertexCount,
+               RandomEngine &_rnd) const;
+
+  // Density estimation at an eye vertex, used by vertex merging
+  virtual DirectX::SimpleMath::Color Merge(const SubPathState &_state,
+                                           const Intersection &_intersect,
+                                           const BSDF &_bsdf, int _depth) const {
+    return DirectX::SimpleMath::Color(0, 0, 0, 0);
+  }
+
+  bool SampleScattering(const Intersection &_intersect, const BSDF &_bsdf,
+                        SubPathState &_state, RandomEngine &_rnd) const;
+
+  void ConnectToCamera(const SubPathState &_state, const Intersection &_intersect,
+                       const BSDF &_bsdf) const;
 
   DirectX::SimpleMath::Color
-  IlluminatePoint(DirectX::SimpleMath::Vector3 pos,
-                  DirectX::SimpleMath::Vector3 normal,
-                  std::default_random_engine &_rnd) const;
+  ConnectToLight(const SubPathState &_state, const Intersection &_intersect,
+                 const BSDF &_bsdf, RandomEngine &_rnd) const;
+
+  DirectX::SimpleMath::Color ConnectVertices(const SubPathState &_state,
+                                             const Intersection &_intersect,
+                                             const BSDF &_bsdf,
+                                             const PathVertex &_lightVertex) const;
+
+  DirectX::SimpleMath::Color EmittedRadiance(const SubPathState &_state,
+                                             const Intersection &_intersect,
+                                             const BSDF &_bsdf) const;
+
+  float LightSubPathCount() const { return float(m_Width * m_Height); }
 
 public:
-  BidirectionalPathTracer(Scene *scene, Camera* camera, int w, int h) : Integrator(scene, camera, w, h) {}
+  BidirectionalPathTracer(Scene *scene, Camera* camera, int w, int h)
+      : Integrator(scene, camera, w, h), m_MisVmWeightFactor(0),
+        m_MisVcWeightFactor(0), m_VmNormalization(0) {
+    EnableSplatting();
+  }
+
   virtual DirectX::SimpleMath::Color
   Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
-            std::default_random_engine &_rnd) const override;
+            RandomEngine &_rnd) const override;
 };
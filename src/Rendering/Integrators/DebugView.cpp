@@ -13,7 +13,7 @@ using namespace DirectX::SimpleMath;
 
 // Intersect a ray with the scene (currently no optimization)
 Color DebugView::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
-                            std::default_random_engine &_rnd) const {
+                            RandomEngine &_rnd) const {
   if (_depth == 0) {
     return Color(0, 0, 0);
   }
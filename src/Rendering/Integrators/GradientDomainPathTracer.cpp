@@ -2,155 +2,176 @@
 
 
 #include "../Scene.h"
+#include "../PostProcessing/PoissonSolver.h"
 
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
-Color GradientDomainPathTracer::Sample(float x, float y, int w, int h, std::default_random_engine& _rnd) const {
-  Color result = { 0, 0, 0, 0 };
-
-  {
-    float camWeight, weightOffset;
-    Ray ray = m_Camera->GetRay(x, y, w, h, _rnd, camWeight);
-
-    std::array<Ray, 4> offsetRays = {
-      m_Camera->GetRay(x + 1, y, w, h, _rnd, weightOffset),
-      m_Camera->GetRay(x, y + 1, w, h, _rnd, weightOffset),
-      m_Camera->GetRay(x - 1, y, w, h, _rnd, weightOffset),
-      m_Camera->GetRay(x, y - 1, w, h, _rnd, weightOffset),
-    };
-
-    int baseLength;
-    auto basePath = TracePath(ray, 8, _rnd, baseLength);
-    auto basePathValue = EvaluatePath(basePath, baseLength);
-
-    for (int i = 0; i < 4; i++) {
-      Path offsetPath;
-      float weight, jacobian;
-      int shiftLength;
-
-      auto shiftResult = OffsetPath(basePath, offsetRays[i], baseLength, offsetPath, shiftLength, weight, jacobian);
-      Color accum = { 0,0,0 };
-      switch (shiftResult) {
-        case ShiftResult::NotInvertible:
-        {
-          offsetPath = TracePath(offsetRays[i], 8, _rnd, shiftLength);
-          accum = basePathValue - EvaluatePath(offsetPath, shiftLength);
-          break;
-        }
-        case ShiftResult::Invertible:
-        {
-          float w_ij = 0.5f; //TODO: MIS
-          accum = w_ij * (basePathValue - EvaluatePath(offsetPath, shiftLength) * jacobian);
-          break;
-        }
-        case ShiftResult::NotSymmetric:
-        {
-          float w_ij = 1.0;
-          accum = w_ij * (basePathValue - EvaluatePath(offsetPath, shiftLength) * jacobian);
-        }
-      }
-
-	  float fwdFactor = (i > 1 ? -1 : 1);
-      int gradientOffsetX = ( (i == 2 && int(x) != 0) ? -1 : 0);
-      int gradientOffsetY = ( (i == 3 && int(y) != 0) ? -1 : 0);
-      ds[i % 2].get()[m_Width * (int(y) + gradientOffsetY) + int(x) + gradientOffsetX] +=  -accum * fwdFactor;
-      result = accum * fwdFactor;
+Color GradientDomainPathTracer::Sample(float x, float y, int w, int h, RandomEngine& _rnd) const {
+  // Offset rays reuse the random numbers of the base ray so lens and pixel
+  // samples are shifted, not resampled
+  auto cameraRnd = _rnd;
+
+  float camWeight;
+  Ray ray = m_Camera->GetRay(x, y, w, h, _rnd, camWeight);
+  STAT_INC(CameraRays);
+
+  int baseLength;
+  auto basePath = TracePath(ray, 8, _rnd, baseLength);
+  auto basePathValue = EvaluatePath(basePath, baseLength);
+
+  const int px = int(x), py = int(y);
+  const int offsetX[4] = { 1, 0, -1, 0 };
+  const int offsetY[4] = { 0, 1, 0, -1 };
+
+  Color primal = { 0, 0, 0, 0 };
+
+  for (int i = 0; i < 4; i++) {
+    int nx = px + offsetX[i], ny = py + offsetY[i];
+
+    // No neighbour to share the path with, the base path gets full weight
+    if (nx < 0 || ny < 0 || nx >= m_Width || ny >= m_Height) {
+      primal += basePathValue * 0.25f;
+      continue;
     }
-    base.get()[m_Width * int(y) + int(x)] += basePathValue;
-    result = Color{ 0.5, 0.5, 0.5 } + Color{ result.x, result.y, result.z }*0.5f;
-  }
-  return result;
-}
 
-void GradientDomainPathTracer::Finalize(int totalSamples) const {
-  Integrator::Finalize(totalSamples);
-}
+    auto offsetRnd = cameraRnd;
+    float weightOffset;
+    Ray offsetRay = m_Camera->GetRay(x + offsetX[i], y + offsetY[i], w, h, offsetRnd, weightOffset);
+    STAT_INC(CameraRays);
 
+    Color offsetValue = { 0, 0, 0, 0 };
+    float pdfRatio = 0;
+    float w_ij = 1.0f;
 
-GradientDomainPathTracer::ShiftResult GradientDomainPathTracer::OffsetPath(const Path& base, const Ray &startRay, int length, Path& offset, int& shiftLength, float& weight, float& jacobian) const {
-  weight = 1;
-  jacobian = 1;
-  shiftLength = 1;
+    // Balance heuristic between sampling the base path directly and
+    // reaching it by shifting a path of the neighbour
+    if (OffsetPath(basePath, baseLength, offsetRay, offsetValue, pdfRatio) == ShiftResult::Invertible) {
+      w_ij = 1.0f / (1.0f + pdfRatio);
+    }
 
-  Ray currentRay = startRay;
-  offset[0] = { { currentRay.position, currentRay.direction, { 0,0 }, nullptr, nullptr }, { currentRay.direction, 1, InteractionType::Diffuse }, PathVertex::Camera };
+    Color weighted = offsetValue * w_ij;
+    weighted.w = 0;
 
-  auto result = ShiftResult::Invertible;
+    // Both pixels of the pair get their MIS weighted share of the primal
+    primal += basePathValue * (0.25f * w_ij);
+    Accumulate(Primal, m_Width * ny + nx, weighted * 0.25f);
 
-  int i = 1;
-  for (; i < length; i++) {
+    // Gradients are stored as forward differences, the pixel pair (p, p + 1)
+    // is written at p from either side
+    Color accum = weighted - basePathValue * w_ij;
+    float fwdFactor = (i > 1 ? -1.0f : 1.0f);
+    int gradientIndex = i > 1 ? m_Width * ny + nx : m_Width * py + px;
+    Accumulate(i % 2 ? GradientY : GradientX, gradientIndex, accum * fwdFactor);
+  }
 
-    Intersection minIntersect;
-    bool intersectFound = m_Scene->Trace(currentRay, minIntersect);
+  Accumulate(Primal, m_Width * py + px, primal);
 
-    if (!intersectFound) {
-      return ShiftResult::NotInvertible;
+  return basePathValue;
+}
+
+void GradientDomainPathTracer::Accumulate(Buffer buffer, int pixel, const Color &value) const {
+  AtomicAdd(m_Buffers[buffer][pixel * 3 + 0], value.R());
+  AtomicAdd(m_Buffers[buffer][pixel * 3 + 1], value.G());
+  AtomicAdd(m_Buffers[buffer][pixel * 3 + 2], value.B());
+}
+
+void GradientDomainPathTracer::BeginFrame() {
+  for (auto &buffer : m_Buffers) {
+    for (int i = 0; i < m_Width * m_Height * 3; i++) {
+      buffer[i].store(0.0f, std::memory_order_relaxed);
     }
+  }
+}
 
-    if (minIntersect.material->IsLight()) {
-      offset[i] = { minIntersect,{ { 0, 0, 0 }, 1 },  PathVertex::Light };
-      i++;
-			return ShiftResult::NotInvertible;
+void GradientDomainPathTracer::Finalize(int totalSamples) const {
+  Color *outputs[BufferCount] = {base.get(), ds[0].get(), ds[1].get()};
+  for (int b = 0; b < BufferCount; b++) {
+    const std::atomic<float> *buffer = m_Buffers[b].get();
+    for (int i = 0; i < m_Width * m_Height; i++) {
+      outputs[b][i] = Color(buffer[i * 3 + 0].load(std::memory_order_relaxed),
+                            buffer[i * 3 + 1].load(std::memory_order_relaxed),
+                            buffer[i * 3 + 2].load(std::memory_order_relaxed), 0.0f);
     }
+  }
 
+  Integrator::Finalize(totalSamples);
 
-    BRDFSample sample;
-    auto halfVec = (-base[i - 1].sample.Direction + base[i].sample.Direction);
-    halfVec.Normalize();
-    sample.Direction = Vector3::Reflect(-offset[i - 1].sample.Direction, halfVec);
-    sample.PDF = minIntersect.material->F(offset[i - 1].sample.Direction, sample.Direction, minIntersect.normal);
-    sample.Type = minIntersect.material->type;
+  PoissonSolver solver(m_Width, m_Height);
+  solver.Solve(base.get(), ds[0].get(), ds[1].get(), reconstructed.get());
+}
 
-		if (base[i].type == PathVertex::Specular) return ShiftResult::NotInvertible;
 
-    offset[i] = { minIntersect, sample, sample.Type == InteractionType::Diffuse ? PathVertex::Diffuse : PathVertex::Specular };
+GradientDomainPathTracer::ShiftResult GradientDomainPathTracer::OffsetPath(const Path& base, int length, const Ray &startRay, Color& offsetValue, float& pdfRatio) const {
+  offsetValue = { 0, 0, 0, 0 };
+  pdfRatio = 0;
 
-    if (offset[i].type != base[i].type) result = ShiftResult::NotSymmetric;
+  // The camera ray escaped, nothing to shift
+  if (length < 2) {
+    return ShiftResult::NotInvertible;
+  }
+
+  Intersection y1;
+  if (!m_Scene->Trace(startRay, y1)) {
+    return ShiftResult::NotInvertible;
+  }
+
+  BSDF y1Bsdf = y1.material->Evaluate(y1, startRay.direction);
+
+  // Directly visible emitters shift onto each other with the same pdf
+  if (base[1].type == PathVertex::Light || y1Bsdf.IsLight()) {
+    if (base[1].type != PathVertex::Light || !y1Bsdf.IsLight()) {
+      return ShiftResult::NotInvertible;
+    }
 
-    bool thisIsDiffuse = base[i].type == PathVertex::Diffuse && offset[i].type == PathVertex::Diffuse;
-    bool nextIsDiffuse = base[i + 1].type == PathVertex::Diffuse || base[i + 1].type == PathVertex::Light;
+    offsetValue = y1Bsdf.Emission;
+    pdfRatio = 1;
+    return ShiftResult::Invertible;
+  }
 
-    bool canConnect = thisIsDiffuse && nextIsDiffuse;
+  // Reconnect the diffuse primary hit to the second base vertex and reuse
+  // the rest of the base path
+  if (length < 3 || base[1].type != PathVertex::Diffuse || y1Bsdf.Type != InteractionType::Diffuse) {
+    return ShiftResult::NotInvertible;
+  }
 
-    if (canConnect) {
-      currentRay.direction = (base[i + 1].intersect.position - offset[i].intersect.position);
-      currentRay.direction.Normalize();
+  const auto& x1 = base[1];
+  const auto& x2 = base[2];
+  if (x2.type != PathVertex::Diffuse && x2.type != PathVertex::Light) {
+    return ShiftResult::NotInvertible;
+  }
 
-      offset[i].sample.Direction = currentRay.direction;
-			offset[i].sample.PDF = minIntersect.material->F(offset[i - 1].sample.Direction, offset[i].sample.Direction, offset[i].intersect.normal);
-      
-      float squaredDistX = (base[i + 1].intersect.position - base[i].intersect.position).LengthSquared();
-      float squaredDistY = (base[i + 1].intersect.position - offset[i].intersect.position).LengthSquared();
-      
-      float cosX = abs(base[i].sample.Direction.Dot(base[i].intersect.normal));
-      float cosY = abs(offset[i].sample.Direction.Dot(offset[i].intersect.normal));
+  Vector3 dirY = x2.intersect.position - y1.position;
+  float squaredDistY = dirY.LengthSquared();
+  dirY.Normalize();
 
-      jacobian *= (cosX * squaredDistX) / (0.000001f + cosY * squaredDistY);
+  float squaredDistX = (x2.intersect.position - x1.intersect.position).LengthSquared();
 
-      // Connection failed
-      if (!m_Scene->Test(offset[i].intersect.position, base[i + 1].intersect.position)) {
-        shiftLength = i;
-        return ShiftResult::NotInvertible;
-      }
-      // Connection succeeded, copy the rest of the vertices
+  float cosX2 = std::abs(x1.sample.Direction.Dot(x2.intersect.normal));
+  float cosY2 = std::abs(dirY.Dot(x2.intersect.normal));
+  float cosY1 = std::abs(dirY.Dot(y1.normal));
 
-      i++;
-      break;
-    } else {
-      // TODO: Jacobian
-      currentRay = Ray(minIntersect.position + sample.Direction * 0.001f, sample.Direction);
-    }
+  if (cosX2 < FLT_EPSILON || squaredDistY < FLT_EPSILON || x1.sample.PDF < FLT_EPSILON) {
+    return ShiftResult::NotInvertible;
   }
 
-  for (; i < length; i++) {
-    offset[i] = base[i];
+  if (!m_Scene->Test(y1.position, x2.intersect.position)) {
+    return ShiftResult::NotInvertible;
   }
-  shiftLength = length;
-  return result;
+
+  // Area measure Jacobian of moving the first vertex
+  float jacobian = (cosY2 * squaredDistX) / (cosX2 * squaredDistY);
+
+  // Diffuse materials sample proportional to the cosine
+  pdfRatio = cosY1 / x1.sample.PDF * jacobian;
+
+  Color throughput = y1Bsdf.F(dirY) * y1Bsdf.GetColor(InteractionType::Diffuse) * cosY1 / x1.sample.PDF;
+
+  offsetValue = throughput * EvaluatePath(base, length, 2) * jacobian;
+  return ShiftResult::Invertible;
 }
 
-GradientDomainPathTracer::Path GradientDomainPathTracer::TracePath(const Ray &_ray, int _depth, std::default_random_engine &_rnd, int& length) const {
+GradientDomainPathTracer::Path GradientDomainPathTracer::TracePath(const Ray &_ray, int _depth, RandomEngine &_rnd, int& length) const {
   Path path;
 
   Ray currentRay = _ray;
@@ -167,27 +188,29 @@ GradientDomainPathTracer::Path GradientDomainPathTracer::TracePath(const Ray &_r
       break;
     }
 
-    if (minIntersect.material->IsLight()) {
-      path[i] = { minIntersect,{ { 0, 0, 0 }, 1 },  PathVertex::Light };
+    BSDF bsdf = minIntersect.material->Evaluate(minIntersect, currentRay.direction);
+
+    if (bsdf.IsLight()) {
+      path[i] = { minIntersect,{ { 0, 0, 0 }, 1 },  PathVertex::Light, bsdf };
       filledSamples++;
       break;
     }
 
-    auto sample =
-      minIntersect.material->Sample(minIntersect, currentRay.direction, _rnd);
+    auto sample = bsdf.Sample(_rnd);
 
     currentRay = Ray(minIntersect.position + sample.Direction * 0.001f,
       sample.Direction);
 
-    path[i] = { minIntersect, sample, sample.Type == InteractionType::Diffuse ? PathVertex::Diffuse : PathVertex::Specular };
+    path[i] = { minIntersect, sample, sample.Type == InteractionType::Diffuse ? PathVertex::Diffuse : PathVertex::Specular, bsdf };
     filledSamples++;
   }
 
   length = filledSamples;
+  STAT_PATH_LENGTH(length - 1);
   return path;
 }
 
-Color GradientDomainPathTracer::EvaluatePath(const Path& path, int length) const {
+Color GradientDomainPathTracer::EvaluatePath(const Path& path, int length, int start) const {
 
   if (path[length - 1].type != PathVertex::Light) return{ 0, 0, 0, 1 };
 
@@ -195,16 +218,15 @@ Color GradientDomainPathTracer::EvaluatePath(const Path& path, int length) const
   weight.A(0);
   Color L = Color(0, 0, 0, 1);
 
-  for (int i = 1; i < length; i++) {
+  for (int i = start; i < length; i++) {
     auto& pathVertex = path[i];
 
     if (pathVertex.type == PathVertex::Light) {
-      L = pathVertex.intersect.material->GetColor(pathVertex.intersect, pathVertex.sample.Type);
+      L = pathVertex.bsdf.Emission;
       break;
     }
 
-    weight *= pathVertex.intersect.material->F(path[i-1].sample.Direction, path[i].sample.Direction, path[i].intersect.normal) 
-			* pathVertex.intersect.material->GetColor(pathVertex.intersect, pathVertex.sample.Type) * std::abs(path[i].sample.Direction.Dot(path[i].intersect.normal)) / pathVertex.sample.PDF;
+    weight *= pathVertex.bsdf.Throughput(pathVertex.sample);
   }
 
   return L * weight;
@@ -212,7 +234,7 @@ Color GradientDomainPathTracer::EvaluatePath(const Path& path, int length) const
 
 // Intersect a ray with the scene (currently no optimization)
 Color GradientDomainPathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
-  std::default_random_engine &_rnd) const {
+  RandomEngine &_rnd) const {
   if (_depth == 0) {
     return Color(0, 0, 0);
   }
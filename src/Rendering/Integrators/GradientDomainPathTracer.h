@@ -15,25 +15,39 @@ public:
     ds[1] = AddOutput("dy", OutputFormat::PFM, w, h);
 
     base = AddOutput("primal", OutputFormat::PFM, w, h);
+    reconstructed = AddOutput("reconstructed", OutputFormat::HDR, w, h);
 
+    for (auto &buffer : m_Buffers) {
+      buffer.reset(new std::atomic<float>[w * h * 3]);
+    }
+    BeginFrame();
   }
   virtual DirectX::SimpleMath::Color
     Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
-      std::default_random_engine &_rnd) const override;
+      RandomEngine &_rnd) const override;
 
-  virtual DirectX::SimpleMath::Color Sample(float x, float y, int w, int h, std::default_random_engine& _rnd) const override;
+  virtual DirectX::SimpleMath::Color Sample(float x, float y, int w, int h, RandomEngine& _rnd) const override;
+  virtual void BeginFrame() override;
   virtual void Finalize(int totalSamples) const override;
 
 private:
 
   std::shared_ptr<Color> base;
   std::shared_ptr<Color> ds[2];
+  std::shared_ptr<Color> reconstructed;
+
+  // Samples also write the primal and gradients of their neighbours, which
+  // belong to other tiles. Accumulated atomically (RGB) and copied to the
+  // outputs by Finalize.
+  enum Buffer { Primal, GradientX, GradientY, BufferCount };
+  std::unique_ptr<std::atomic<float>[]> m_Buffers[BufferCount];
+
+  void Accumulate(Buffer buffer, int pixel, const DirectX::SimpleMath::Color &value) const;
 
 
   enum class ShiftResult {
     Invertible,
-    NotInvertible,
-    NotSymmetric
+    NotInvertible
   };
 
   struct PathVertex {
@@ -47,11 +61,17 @@ private:
     Intersection intersect;
     BRDFSample sample;
     Type type;
+    BSDF bsdf;
   };
 
   typedef std::array<PathVertex, 15> Path;
 
-  Path TracePath(const DirectX::SimpleMath::Ray & _ray, int _depth, std::default_random_engine & _rnd, int& length) const;
-  GradientDomainPathTracer::ShiftResult GradientDomainPathTracer::OffsetPath(const Path& base, const Ray &startRay, int length, Path& offset, int& shiftLength, float& weight, float& jacobian) const;
-  DirectX::SimpleMath::Color EvaluatePath(const Path & path, int length) const;
+  Path TracePath(const DirectX::SimpleMath::Ray & _ray, int _depth, RandomEngine & _rnd, int& length) const;
+  // Shifts the base path to start with startRay. On success returns the
+  // offset contribution (already divided by the base pdf) and the ratio of
+  // the offset to the base path pdf including the Jacobian.
+  ShiftResult OffsetPath(const Path& base, int length, const DirectX::SimpleMath::Ray &startRay, DirectX::SimpleMath::Color& offsetValue, float& pdfRatio) const;
+
+  // Contribution of the path from vertex start onwards
+  DirectX::SimpleMath::Color EvaluatePath(const Path & path, int length, int start = 1) const;
 };
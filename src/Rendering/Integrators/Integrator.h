@@ -1,9 +1,13 @@
 #pragma once
 #include "../../SimpleMath.h"
 #include <random>
+#include "../RandomEngine.h"
 #include <memory>
 #include <exception>
+#include <atomic>
+#include <algorithm>
 #include "../Cameras/Camera.h"
+#include "../Statistics.h"
 
 class Scene;
 
@@ -40,15 +44,48 @@ protected:
     return img.Data;
   }
 
+  // Contributions of light paths that can land on any pixel (RGB)
+  std::unique_ptr<std::atomic<float>[]> m_Splats;
+
+  void EnableSplatting() {
+    m_Splats.reset(new std::atomic<float>[m_Width * m_Height * 3]);
+    ClearSplats();
+  }
+
+  void ClearSplats() {
+    for (int i = 0; i < m_Width * m_Height * 3; i++) {
+      m_Splats[i].store(0.0f, std::memory_order_relaxed);
+    }
+  }
+
+  static void AtomicAdd(std::atomic<float> &target, float value) {
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value,
+                                         std::memory_order_relaxed)) {
+    }
+  }
+
+  // Splatted values are divided by the samples per pixel on resolve
+  void Splat(float x, float y, const DirectX::SimpleMath::Color &color) const {
+    int px = std::max(0, std::min(int(x + 0.5f), m_Width - 1));
+    int py = std::max(0, std::min(int(y + 0.5f), m_Height - 1));
+    int index = (px + py * m_Width) * 3;
+    AtomicAdd(m_Splats[index + 0], color.R());
+    AtomicAdd(m_Splats[index + 1], color.G());
+    AtomicAdd(m_Splats[index + 2], color.B());
+  }
+
 public:
   Integrator(Scene *scene, Camera *camera, int w, int h) : m_Scene(scene), m_Camera(camera), m_Width(w), m_Height(h) {}
+  virtual ~Integrator() {}
   virtual DirectX::SimpleMath::Color
   Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
-            std::default_random_engine &_rnd) const = 0;
+            RandomEngine &_rnd) const = 0;
 
-  virtual DirectX::SimpleMath::Color Sample(float x, float y, int w, int h, std::default_random_engine& _rnd) const {
+  virtual DirectX::SimpleMath::Color Sample(float x, float y, int w, int h, RandomEngine& _rnd) const {
       float weight;
       DirectX::SimpleMath::Ray  ray = m_Camera->GetRay(x, y, w, h, _rnd, weight);
+      STAT_INC(CameraRays);
 
       if (weight > FLT_EPSILON) {
           return Intersect(ray, 8, false, _rnd);
@@ -56,6 +93,14 @@ public:
       return{ 0,0,0 };
   }
 
+  // Called by Render once the scene was moved to the frame
+  virtual void BeginFrame() {}
+
+  // Progressive integrators render one sample per pixel and pass, BeginPass
+  // runs before each pass once the previous one has finished
+  virtual bool IsProgressive() const { return false; }
+  virtual void BeginPass(int pass, int threadCount) {}
+
   virtual void Finalize(int totalSamples) const {
     float factor = 1.0 / totalSamples;
     for (auto& output : m_Outputs) {
@@ -65,10 +110,29 @@ public:
     }
   }
 
+  // Adds the contributions that don't go through Sample (e.g. splatted
+  // light paths) to the final image
+  virtual void ResolveSplats(DirectX::SimpleMath::Color *image, int totalSamples) const {
+    if (!m_Splats) {
+      return;
+    }
+
+    float factor = 1.0f / totalSamples;
+    for (int i = 0; i < m_Width * m_Height; i++) {
+      image[i].x += m_Splats[i * 3 + 0].load(std::memory_order_relaxed) * factor;
+      image[i].y += m_Splats[i * 3 + 1].load(std::memory_order_relaxed) * factor;
+      image[i].z += m_Splats[i * 3 + 2].load(std::memory_order_relaxed) * factor;
+    }
+  }
+
   void Reset() {
     for (auto& output : m_Outputs) {
       std::fill(output.Data.get(), output.Data.get() + m_Width * m_Height, DirectX::SimpleMath::Color(0, 0, 0, 0));
     }
+
+    if (m_Splats) {
+      ClearSplats();
+    }
   }
 
   std::vector<OutputImage> getOutputs() { return m_Outputs; }
@@ -0,0 +1,239 @@
+#include "IrradianceCachePreview.h"
+#include "../Scene.h"
+#include "../BRDFs.h"
+#include "../Materials/Material.h"
+#include "../../Objects/RenderObject.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+// Hemisphere strata per record (theta x phi)
+#define RECORD_THETA 8
+#define RECORD_PHI 24
+// Record radii in pixel footprints at the time they were created
+#define MIN_RADIUS_PIXELS 2.0f
+#define MAX_RADIUS_PIXELS 64.0f
+
+static float Luminance(const Color &_color) {
+  return 0.2126f * _color.R() + 0.7152f * _color.G() + 0.0722f * _color.B();
+}
+
+IrradianceCachePreview::IrradianceCachePreview(Scene *scene, Camera *camera,
+                                               int w, int h)
+    : Integrator(scene, camera, w, h), m_GeometryVersion(scene->GetGeometryVersion()) {}
+
+void IrradianceCachePreview::BeginFrame() {
+  if (m_Scene->GetGeometryVersion() != m_GeometryVersion) {
+    m_Cache.Clear();
+    m_GeometryVersion = m_Scene->GetGeometryVersion();
+  }
+}
+
+// Single light sample of the irradiance divided by pi
+Color IrradianceCachePreview::SampleDirectLight(const Intersection &_intersect,
+                                                Vector3 _normal,
+                                                RandomEngine &_rnd) const {
+  RenderObject *light;
+  float pickProbability;
+  Ray lightSample = m_Scene->SampleLight(_rnd, &light, pickProbability);
+
+  Vector3 lightNormal = lightSample.direction;
+  lightNormal.Normalize();
+
+  Vector3 toLight = lightSample.position - _intersect.position;
+  float distSquared = toLight.LengthSquared();
+  toLight.Normalize();
+
+  float cosAtLight = std::abs(toLight.Dot(lightNormal));
+  float cosAtPoint = toLight.Dot(_normal);
+  if (cosAtLight <= FLT_EPSILON || cosAtPoint <= 0.0f) {
+    return Color(0, 0, 0, 0);
+  }
+
+  if (m_Scene->Occluded(_intersect.position, lightSample.position)) {
+    return Color(0, 0, 0, 0);
+  }
+
+  Intersection lightPoint = {lightSample.position, lightNormal, Vector2(0, 0),
+                             light->GetMaterial(), light};
+  Color Le = light->GetMaterial()->Evaluate(lightPoint).Emission;
+
+  return Le * (cosAtPoint * cosAtLight / (XM_PI * distSquared * m_Scene->LightPdfA()));
+}
+
+Color IrradianceCachePreview::ComputeIrradiance(const Intersection &_intersect,
+                                                Vector3 _normal, float _footprint,
+                                                RandomEngine &_rnd) const {
+  const int M = RECORD_THETA, N = RECORD_PHI;
+  std::uniform_real_distribution<float> dist(0, 1);
+
+  Vector3 xDir = std::abs(_normal.x) < std::abs(_normal.y) ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+  Vector3 yDir = _normal.Cross(xDir);
+  yDir.Normalize();
+  xDir = yDir.Cross(_normal);
+
+  // Incoming radiance and hit distance per stratum, L[j * N + k]
+  Color L[M * N];
+  float r[M * N];
+  float inverseDistanceSum = 0.0f;
+
+  for (int j = 0; j < M; j++) {
+    for (int k = 0; k < N; k++) {
+      float sinTheta = std::sqrt((j + dist(_rnd)) / M);
+      float cosTheta = std::sqrt(std::max(0.0f, 1.0f - sinTheta * sinTheta));
+      float phi = XM_2PI * (k + dist(_rnd)) / N;
+      Vector3 direction = (xDir * std::cos(phi) + yDir * std::sin(phi)) * sinTheta +
+                          _normal * cosTheta;
+
+      Color &radiance = L[j * N + k] = Color(0, 0, 0, 0);
+      r[j * N + k] = FLT_MAX;
+
+      Intersection hit;
+      if (!m_Scene->Trace(Ray(_intersect.position + direction * 0.001f, direction), hit)) {
+        continue;
+      }
+
+      float distance = (hit.position - _intersect.position).Length();
+      r[j * N + k] = distance;
+      inverseDistanceSum += 1.0f / std::max(distance, 1e-4f);
+
+      // Emitters are handled by the direct light of the cached point
+      if (hit.material->IsLight() || !IsConnectible(hit.material->type)) {
+        continue;
+      }
+
+      Vector3 hitNormal = hit.normal.Dot(direction) < 0.0f ? hit.normal : -hit.normal;
+      radiance = hit.material->Evaluate(hit, direction).Diffuse *
+                 SampleDirectLight(hit, hitNormal, _rnd);
+    }
+  }
+
+  IrradianceCache::Record record;
+  record.Position = _intersect.position;
+  record.Normal = _normal;
+
+  Color E(0, 0, 0, 0);
+  for (int i = 0; i < M * N; i++) {
+    E += L[i];
+  }
+  record.E = E * (XM_PI / (M * N));
+
+  // Gradients after Ward and Heckbert for cosine weighted strata
+  for (int c = 0; c < 3; c++) {
+    record.RotationGradient[c] = Vector3(0, 0, 0);
+    record.TranslationGradient[c] = Vector3(0, 0, 0);
+  }
+
+  auto channel = [](const Color &color, int c) {
+    return c == 0 ? color.R() : (c == 1 ? color.G() : color.B());
+  };
+
+  for (int k = 0; k < N; k++) {
+    float phi = XM_2PI * (k + 0.5f) / N;
+    float phiMin = XM_2PI * k / N;
+    Vector3 v = xDir * -std::sin(phi) + yDir * std::cos(phi);
+    Vector3 uMin = xDir * std::cos(phiMin) + yDir * std::sin(phiMin);
+    Vector3 vMin = xDir * -std::sin(phiMin) + yDir * std::cos(phiMin);
+    int kPrev = (k + N - 1) % N;
+
+    for (int c = 0; c < 3; c++) {
+      float rotation = 0.0f;
+      float radial = 0.0f;
+      float tangential = 0.0f;
+
+      for (int j = 0; j < M; j++) {
+        float sinThetaCenter = std::sqrt((j + 0.5f) / M);
+        float tanTheta = sinThetaCenter / std::sqrt(std::max(1e-6f, 1.0f - sinThetaCenter * sinThetaCenter));
+        rotation -= tanTheta * channel(L[j * N + k], c);
+
+        float sinThetaMin = std::sqrt(float(j) / M);
+        float cosThetaMin = std::sqrt(1.0f - float(j) / M);
+        float cosThetaMax = std::sqrt(std::max(0.0f, 1.0f - float(j + 1) / M));
+
+        if (j > 0) {
+          float rMin = std::min(r[j * N + k], r[(j - 1) * N + k]);
+          radial += sinThetaMin * cosThetaMin * cosThetaMin / rMin *
+                    (channel(L[j * N + k], c) - channel(L[(j - 1) * N + k], c));
+        }
+
+        float rMin = std::min(r[j * N + k], r[j * N + kPrev]);
+        tangential += (cosThetaMin - cosThetaMax) / (sinThetaCenter * rMin) *
+                      (channel(L[j * N + k], c) - channel(L[j * N + kPrev], c));
+      }
+
+      record.RotationGradient[c] += v * (rotation * XM_PI / (M * N));
+      record.TranslationGradient[c] += uMin * (radial * XM_2PI / N) + vMin * tangential;
+    }
+  }
+
+  // Harmonic mean distance, clamped to the pixel footprint and shrunk where
+  // the gradient says irradiance changes quickly
+  float R = inverseDistanceSum > 0.0f ? M * N / inverseDistanceSum : FLT_MAX;
+  R = std::max(MIN_RADIUS_PIXELS * _footprint, std::min(R, MAX_RADIUS_PIXELS * _footprint));
+
+  Vector3 luminanceGradient = record.TranslationGradient[0] * 0.2126f +
+                              record.TranslationGradient[1] * 0.7152f +
+                              record.TranslationGradient[2] * 0.0722f;
+  float gradientLength = luminanceGradient.Length();
+  if (gradientLength > 0.0f) {
+    R = std::max(MIN_RADIUS_PIXELS * _footprint,
+                 std::min(R, Luminance(record.E) / gradientLength));
+  }
+  record.R = R;
+
+  m_Cache.Insert(record);
+  return record.E;
+}
+
+Color IrradianceCachePreview::Intersect(const Ray &_ray, int _depth,
+                                        bool _isSecondary,
+                                        RandomEngine &_rnd) const {
+  Ray ray = _ray;
+  Color weight(1, 1, 1, 0);
+
+  // Size of a pixel per unit distance from the camera
+  float cameraPdfW = m_Camera->DirectionPdf(_ray.direction, m_Width, m_Height);
+  float pixelAngle = cameraPdfW > 0.0f ? std::sqrt(1.0f / cameraPdfW) : 1.0f / m_Width;
+  float distance = 0.0f;
+
+  for (int depth = 0; depth < _depth; depth++) {
+    Intersection hit;
+    if (!m_Scene->Trace(ray, hit)) {
+      break;
+    }
+    distance += (hit.position - ray.position).Length();
+
+    BSDF bsdf = hit.material->Evaluate(hit, ray.direction);
+
+    if (bsdf.IsLight()) {
+      return weight * bsdf.Emission;
+    }
+
+    // Specular surfaces are followed, diffuse and glossy ones end the path
+    if (IsConnectible(bsdf.Type)) {
+      Vector3 normal = hit.normal.Dot(ray.direction) < 0.0f ? hit.normal : -hit.normal;
+
+      Color E;
+      if (!m_Cache.Interpolate(hit.position, normal, E)) {
+        E = ComputeIrradiance(hit, normal, distance * pixelAngle, _rnd);
+      }
+      E += SampleDirectLight(hit, normal, _rnd) * XM_PI;
+
+      return weight * bsdf.Evaluate(ray.direction, normal) * E *
+             (1.0f / XM_PI);
+    }
+
+    auto sample = bsdf.Sample(_rnd);
+    if (sample.PDF <= 0.0f) {
+      break;
+    }
+
+    weight *= bsdf.Throughput(sample);
+    ray = Ray(hit.position + sample.Direction * 0.001f, sample.Direction);
+  }
+
+  return Color(0, 0, 0, 0);
+}
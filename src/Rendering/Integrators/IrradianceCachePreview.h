@@ -0,0 +1,39 @@
+#pragma once
+#include "Integrator.h"
+#include "../../Geometry/Intersection.h"
+#include "../Accelerators/IrradianceCache.h"
+
+/********************************************
+** IrradianceCachePreview
+** Fast preview integrator: direct light plus
+** one bounce of indirect light interpolated
+** from an irradiance cache. Records are
+** created lazily where interpolation fails
+** and kept across frames until geometry moves.
+*********************************************/
+
+class IrradianceCachePreview : Integrator {
+  mutable IrradianceCache m_Cache;
+  uint64_t m_GeometryVersion;
+
+  DirectX::SimpleMath::Color
+  SampleDirectLight(const Intersection &_intersect,
+                    DirectX::SimpleMath::Vector3 _normal,
+                    RandomEngine &_rnd) const;
+
+  // Samples the hemisphere above the point and stores the record
+  DirectX::SimpleMath::Color
+  ComputeIrradiance(const Intersection &_intersect,
+                    DirectX::SimpleMath::Vector3 _normal, float _footprint,
+                    RandomEngine &_rnd) const;
+
+public:
+  IrradianceCachePreview(Scene *scene, Camera *camera, int w, int h);
+
+  virtual DirectX::SimpleMath::Color
+  Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
+            RandomEngine &_rnd) const override;
+
+  // Drops the cache if the scene geometry changed
+  virtual void BeginFrame() override;
+};
@@ -0,0 +1,280 @@
+#include "MetropolisLightTransport.h"
+#include "PathTracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define CHECKPOINT_FILE "mlt_chains.txt"
+#define CHECKPOINT_VERSION 1
+#define LARGE_STEP_PROBABILITY 0.3f
+#define MUTATION_SIGMA 0.01f
+
+static float Luminance(const Color &_color) {
+  return 0.2126f * _color.R() + 0.7152f * _color.G() + 0.0722f * _color.B();
+}
+
+// Chains and bootstrap samples get fixed seeds so renders are repeatable
+static uint32_t Seed(uint32_t index, uint32_t stream) {
+  uint32_t h = index * 0x9E3779B9u ^ (stream + 0x7F4A7C15u);
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  return h ? h : 1u;
+}
+
+void MetropolisLightTransport::MLTSampler::EnsureReady(size_t index) {
+  std::uniform_real_distribution<float> dist(0, 1);
+
+  if (index >= m_X.size()) {
+    m_X.resize(index + 1);
+  }
+  PrimarySample &x = m_X[index];
+
+  // A large step happened since the last use
+  if (x.LastModification < m_LastLargeStep) {
+    x.Value = dist(m_Rnd);
+    x.LastModification = m_LastLargeStep;
+  }
+
+  x.Backup = x.Value;
+  x.BackupModification = x.LastModification;
+
+  if (m_LargeStep) {
+    x.Value = dist(m_Rnd);
+  } else {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    float skipped = float(m_Iteration - x.LastModification);
+    x.Value += normal(m_Rnd) * MUTATION_SIGMA * std::sqrt(skipped);
+    x.Value -= std::floor(x.Value);
+  }
+  x.LastModification = m_Iteration;
+}
+
+float MetropolisLightTransport::MLTSampler::Next() {
+  EnsureReady(m_Index);
+  return m_X[m_Index++].Value;
+}
+
+void MetropolisLightTransport::MLTSampler::StartIteration() {
+  std::uniform_real_distribution<float> dist(0, 1);
+  m_Iteration++;
+  m_LargeStep = dist(m_Rnd) < LARGE_STEP_PROBABILITY;
+  m_Index = 0;
+}
+
+void MetropolisLightTransport::MLTSampler::Accept() {
+  if (m_LargeStep) {
+    m_LastLargeStep = m_Iteration;
+  }
+}
+
+void MetropolisLightTransport::MLTSampler::Reject() {
+  for (auto &x : m_X) {
+    if (x.LastModification == m_Iteration) {
+      x.Value = x.Backup;
+      x.LastModification = x.BackupModification;
+    }
+  }
+  m_Iteration--;
+}
+
+void MetropolisLightTransport::MLTSampler::Write(std::ostream &out) const {
+  out << m_Rnd << "\n"
+      << m_Iteration << " " << m_LastLargeStep << " " << m_X.size() << "\n";
+  for (const auto &x : m_X) {
+    out << x.Value << " " << x.LastModification << "\n";
+  }
+}
+
+bool MetropolisLightTransport::MLTSampler::Read(std::istream &in) {
+  size_t count;
+  if (!(in >> m_Rnd >> m_Iteration >> m_LastLargeStep >> count)) {
+    return false;
+  }
+
+  m_X.resize(count);
+  for (auto &x : m_X) {
+    if (!(in >> x.Value >> x.LastModification)) {
+      return false;
+    }
+    x.Backup = x.Value;
+    x.BackupModification = x.LastModification;
+  }
+  m_LargeStep = false;
+  m_Index = 0;
+  return true;
+}
+
+MetropolisLightTransport::MetropolisLightTransport(Scene *scene, Camera *camera,
+                                                   int w, int h, bool resume)
+    : Integrator(scene, camera, w, h),
+      m_PathTracer(reinterpret_cast<Integrator *>(new PathTracer(scene, camera, w, h))),
+      m_Brightness(0.0f), m_Resume(resume) {
+  EnableSplatting();
+}
+
+Color MetropolisLightTransport::Intersect(const Ray &_ray, int _depth,
+                                          bool _isSecondary,
+                                          RandomEngine &_rnd) const {
+  return m_PathTracer->Intersect(_ray, _depth, _isSecondary, _rnd);
+}
+
+// The first two primary samples pick the pixel, the path tracer consumes
+// the rest
+Color MetropolisLightTransport::EvaluateSample(MLTSampler &_sampler, float &_x,
+                                               float &_y) const {
+  RandomEngine rnd;
+  rnd.SetSource(&_sampler);
+
+  _x = _sampler.Next() * m_Width - 0.5f;
+  _y = _sampler.Next() * m_Height - 0.5f;
+
+  Color L = m_PathTracer->Sample(_x, _y, m_Width, m_Height, rnd);
+  bool valid = std::isfinite(L.R()) && std::isfinite(L.G()) && std::isfinite(L.B());
+  return valid ? L : Color(0, 0, 0, 0);
+}
+
+void MetropolisLightTransport::Bootstrap(int threadCount) {
+  std::vector<float> weights(m_BootstrapSamples);
+
+#pragma omp parallel for num_threads(threadCount) schedule(dynamic, 64)
+  for (int i = 0; i < m_BootstrapSamples; i++) {
+    MLTSampler sampler(Seed(uint32_t(i), 0));
+    float x, y;
+    weights[i] = Luminance(EvaluateSample(sampler, x, y));
+  }
+
+  double sum = 0.0;
+  for (float weight : weights) {
+    sum += weight;
+  }
+  m_Brightness = float(sum / m_BootstrapSamples);
+
+  m_Chains.clear();
+  if (m_Brightness <= 0.0f) {
+    return;
+  }
+
+  // Chains start from bootstrap paths picked proportional to their
+  // contribution, replaying the bootstrap seed recreates the path
+  std::discrete_distribution<int> pick(weights.begin(), weights.end());
+  m_Chains.resize(threadCount);
+  for (int c = 0; c < threadCount; c++) {
+    Chain &chain = m_Chains[c];
+    chain.Rnd.seed(Seed(uint32_t(c), 1));
+
+    int start = pick(chain.Rnd);
+    chain.Sampler = MLTSampler(Seed(uint32_t(start), 0));
+    chain.L = EvaluateSample(chain.Sampler, chain.X, chain.Y);
+  }
+}
+
+bool MetropolisLightTransport::SaveChains(const std::string &path) const {
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+
+  out.precision(9);
+  out << CHECKPOINT_VERSION << " " << m_Width << " " << m_Height << " "
+      << m_Brightness << " " << m_Chains.size() << "\n";
+  for (const auto &chain : m_Chains) {
+    out << chain.Rnd << "\n"
+        << chain.L.R() << " " << chain.L.G() << " " << chain.L.B() << " "
+        << chain.X << " " << chain.Y << "\n";
+    chain.Sampler.Write(out);
+  }
+  return bool(out);
+}
+
+bool MetropolisLightTransport::LoadChains(const std::string &path) {
+  std::ifstream in(path);
+  int version, w, h;
+  size_t count;
+  float brightness;
+  if (!(in >> version >> w >> h >> brightness >> count) ||
+      version != CHECKPOINT_VERSION || w != m_Width || h != m_Height) {
+    return false;
+  }
+
+  std::vector<Chain> chains(count);
+  for (auto &chain : chains) {
+    float r, g, b;
+    if (!(in >> chain.Rnd >> r >> g >> b >> chain.X >> chain.Y) ||
+        !chain.Sampler.Read(in)) {
+      return false;
+    }
+    chain.L = Color(r, g, b, 0);
+  }
+
+  m_Brightness = brightness;
+  m_Chains = std::move(chains);
+  return true;
+}
+
+void MetropolisLightTransport::BeginPass(int pass, int threadCount) {
+  threadCount = std::max(threadCount, 1);
+
+  if (pass == 0) {
+    if (!m_Resume || !LoadChains(CHECKPOINT_FILE)) {
+      if (m_Resume) {
+        std::cout << "No usable MLT checkpoint, bootstrapping" << std::endl;
+      }
+      Bootstrap(threadCount);
+    }
+  }
+
+  if (m_Chains.empty()) {
+    return;
+  }
+
+  // Every pass mutates as often as there are pixels, which keeps the
+  // splat normalization at one sample per pixel and pass
+  const int chainCount = int(m_Chains.size());
+  const int64_t mutations = (int64_t(m_Width) * m_Height + chainCount - 1) / chainCount;
+  const float scale = m_Brightness * float(m_Width) * float(m_Height) /
+                      float(mutations * chainCount);
+
+#pragma omp parallel for num_threads(threadCount) schedule(static, 1)
+  for (int c = 0; c < chainCount; c++) {
+    Chain &chain = m_Chains[c];
+    std::uniform_real_distribution<float> dist(0, 1);
+
+    for (int64_t i = 0; i < mutations; i++) {
+      chain.Sampler.StartIteration();
+
+      float x, y;
+      Color L = EvaluateSample(chain.Sampler, x, y);
+
+      float current = Luminance(chain.L);
+      float proposed = Luminance(L);
+      float accept = current > 0.0f ? std::min(1.0f, proposed / current) : 1.0f;
+
+      // Both states are splatted with their expected weights
+      if (proposed > 0.0f) {
+        Splat(x, y, L * (accept * scale / proposed));
+      }
+      if (current > 0.0f) {
+        Splat(chain.X, chain.Y, chain.L * ((1.0f - accept) * scale / current));
+      }
+
+      if (dist(chain.Rnd) < accept) {
+        chain.L = L;
+        chain.X = x;
+        chain.Y = y;
+        chain.Sampler.Accept();
+      } else {
+        chain.Sampler.Reject();
+      }
+    }
+  }
+
+  if (!SaveChains(CHECKPOINT_FILE)) {
+    std::cout << "Could not write " << CHECKPOINT_FILE << std::endl;
+  }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "Integrator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/********************************************
+** MetropolisLightTransport
+** Primary sample space MLT (Kelemen et al.
+** 2002) over the path tracer. A bootstrap
+** phase estimates the image brightness, then
+** one Markov chain per worker mutates the
+** random numbers the path tracer consumes and
+** splats every state into the film.
+*********************************************/
+
+class MetropolisLightTransport : Integrator {
+  struct PrimarySample {
+    float Value = 0.0f;
+    float Backup = 0.0f;
+    int64_t LastModification = 0;
+    int64_t BackupModification = 0;
+  };
+
+  // Kelemen style mutations, values are created lazily and small steps
+  // that were skipped are applied at once
+  class MLTSampler : public PrimarySampleSource {
+    std::default_random_engine m_Rnd;
+    std::vector<PrimarySample> m_X;
+    int64_t m_Iteration = 0;
+    int64_t m_LastLargeStep = 0;
+    bool m_LargeStep = true;
+    size_t m_Index = 0;
+
+    void EnsureReady(size_t index);
+
+  public:
+    MLTSampler(uint32_t seed = 0) : m_Rnd(seed) {}
+
+    virtual float Next() override;
+
+    void StartIteration();
+    void Accept();
+    void Reject();
+
+    void Write(std::ostream &out) const;
+    bool Read(std::istream &in);
+  };
+
+  struct Chain {
+    MLTSampler Sampler;
+    std::default_random_engine Rnd;
+    DirectX::SimpleMath::Color L;
+    float X, Y;
+  };
+
+  const int m_BootstrapSamples = 100000;
+
+  std::unique_ptr<Integrator> m_PathTracer;
+  std::vector<Chain> m_Chains;
+
+  // Average luminance of the image
+  float m_Brightness;
+  bool m_Resume;
+
+  DirectX::SimpleMath::Color EvaluateSample(MLTSampler &_sampler, float &_x,
+                                            float &_y) const;
+  void Bootstrap(int threadCount);
+
+  bool SaveChains(const std::string &path) const;
+  bool LoadChains(const std::string &path);
+
+public:
+  // Chains are checkpointed after every pass, resuming continues them
+  // instead of running the bootstrap again
+  MetropolisLightTransport(Scene *scene, Camera *camera, int w, int h,
+                           bool resume = false);
+
+  virtual DirectX::SimpleMath::Color
+  Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
+            RandomEngine &_rnd) const override;
+
+  // All contributions are splatted
+  virtual DirectX::SimpleMath::Color
+  Sample(float x, float y, int w, int h, RandomEngine &_rnd) const override {
+    return DirectX::SimpleMath::Color(0, 0, 0, 0);
+  }
+
+  virtual bool IsProgressive() const override { return true; }
+  virtual void BeginPass(int pass, int threadCount) override;
+};
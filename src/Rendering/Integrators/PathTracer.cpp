@@ -11,9 +11,97 @@ using namespace DirectX::SimpleMath;
 
 #define RUSSIAN_ROULETTE 1.0f
 
+// Probability of sampling the BSDF rather than the guiding distribution
+#define BSDF_SAMPLING_FRACTION 0.5f
+#define MAX_GUIDE_VERTICES 16
+
+// Diffuse vertex of a guided path, Radiance collects the light arriving
+// from Direction
+struct GuideVertex {
+  Vector3 Position;
+  Vector3 Direction;
+  Color Throughput;
+  Color Radiance;
+  float Pdf;
+};
+
+static float Luminance(const Color &_color) {
+  return 0.2126f * _color.R() + 0.7152f * _color.G() + 0.0722f * _color.B();
+}
+
+void PathTracer::EstimateBounds(Vector3 &_min, Vector3 &_max) const {
+  const int probes = 32;
+  RandomEngine rnd(1);
+
+  _min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+  _max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+  for (int py = 0; py < probes; py++) {
+    for (int px = 0; px < probes; px++) {
+      float weight;
+      Ray ray = m_Camera->GetRay((px + 0.5f) * m_Width / probes - 0.5f,
+                                 (py + 0.5f) * m_Height / probes - 0.5f,
+                                 m_Width, m_Height, rnd, weight);
+      if (weight <= FLT_EPSILON) {
+        continue;
+      }
+
+      for (int bounce = 0; bounce < 4; bounce++) {
+        Intersection hit;
+        if (!m_Scene->Trace(ray, hit)) {
+          break;
+        }
+        _min = Vector3::Min(_min, hit.position);
+        _max = Vector3::Max(_max, hit.position);
+
+        if (hit.material->IsLight()) {
+          break;
+        }
+        auto sample = hit.material->Evaluate(hit, ray.direction).Sample(rnd);
+        if (sample.PDF <= 0.0f) {
+          break;
+        }
+        ray = Ray(hit.position + sample.Direction * 0.001f, sample.Direction);
+      }
+    }
+  }
+
+  if (_min.x > _max.x) {
+    _min = Vector3(-1, -1, -1);
+    _max = Vector3(1, 1, 1);
+  }
+
+  // Points outside are clamped to the border leaves
+  Vector3 margin = (_max - _min) * 0.01f + Vector3(0.001f, 0.001f, 0.001f);
+  _min -= margin;
+  _max += margin;
+}
+
+void PathTracer::BeginPass(int pass, int threadCount) {
+  if (!m_Guiding) {
+    return;
+  }
+
+  if (pass == 0) {
+    Vector3 min, max;
+    EstimateBounds(min, max);
+    m_Guide.Reset(min, max);
+    m_IterationLength = 1;
+    m_IterationEnd = 1;
+    return;
+  }
+
+  // Iteration k spans 2^k passes, the next one samples what it learned
+  if (pass == m_IterationEnd) {
+    m_Guide.Refine();
+    m_IterationLength *= 2;
+    m_IterationEnd += m_IterationLength;
+  }
+}
+
 // Intersect a ray with the scene (currently no optimization)
 Color PathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
-                            std::default_random_engine &_rnd) const {
+                            RandomEngine &_rnd) const {
   if (_depth == 0) {
     return Color(0, 0, 0);
   }
@@ -25,7 +113,11 @@ Color PathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
   Ray currentRay = _ray;
   std::uniform_real_distribution<float> dist(0, 1);
 
-  for (int i = 0; i < _depth; i++) {
+  GuideVertex guideVertices[MAX_GUIDE_VERTICES];
+  int guideVertexCount = 0;
+
+  int i = 0;
+  for (; i < _depth; i++) {
     Intersection minIntersect;
     bool intersectFound = m_Scene->Trace(currentRay, minIntersect);
 
@@ -33,8 +125,19 @@ Color PathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
       break;
     }
 
-    if (minIntersect.material->IsLight()) {
-        L += minIntersect.material->GetColor(minIntersect, InteractionType::Diffuse) * weight;
+    BSDF bsdf = minIntersect.material->Evaluate(minIntersect, currentRay.direction);
+
+    if (bsdf.IsLight()) {
+        Color Le = bsdf.Emission * weight;
+        L += Le;
+
+        for (int v = 0; v < guideVertexCount; v++) {
+          const Color &throughput = guideVertices[v].Throughput;
+          guideVertices[v].Radiance +=
+              Color(throughput.R() > 0.0f ? Le.R() / throughput.R() : 0.0f,
+                    throughput.G() > 0.0f ? Le.G() / throughput.G() : 0.0f,
+                    throughput.B() > 0.0f ? Le.B() / throughput.B() : 0.0f, 0.0f);
+        }
         break;
     }
 
@@ -42,27 +145,80 @@ Color PathTracer::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
 
     if (i > 4) {
       if (dist(_rnd) > RUSSIAN_ROULETTE) {
+        STAT_INC(RussianRouletteTerminations);
         break;
       } else {
         rr_weight = 1.0f / RUSSIAN_ROULETTE;
       }
     }
 
-    auto sample =
-        minIntersect.material->Sample(minIntersect, currentRay.direction, _rnd);
+    Vector3 in = currentRay.direction;
+    Vector3 out;
+
+    if (m_Guiding && IsConnectible(bsdf.Type)) {
+      // One sample MIS between the BSDF and the learned distribution
+      const DTree *guide = m_Guide.SamplingTree(minIntersect.position);
+      float bsdfFraction = guide ? BSDF_SAMPLING_FRACTION : 1.0f;
+      bool guided = true;
+
+      if (guide && dist(_rnd) >= bsdfFraction) {
+        out = guide->Sample(_rnd);
+      } else {
+        auto sample = bsdf.Sample(_rnd);
+        if (sample.PDF <= 0.0f) {
+          break;
+        }
+        out = sample.Direction;
+
+        // Lobes the guide doesn't cover, e.g. passing through
+        if (!IsConnectible(sample.Type)) {
+          weight *= bsdf.Throughput(sample) / bsdfFraction * rr_weight;
+          guided = false;
+        }
+      }
+
+      if (guided) {
+        float pdf = bsdfFraction * bsdf.Pdf(in, out) / XM_PI +
+                    (1.0f - bsdfFraction) * (guide ? guide->Pdf(out) : 0.0f);
+        if (pdf <= 0.0f) {
+          break;
+        }
+
+        weight *= bsdf.Evaluate(in, out) *
+                  std::abs(out.Dot(minIntersect.normal)) / (XM_PI * pdf) *
+                  rr_weight;
+
+        if (guideVertexCount < MAX_GUIDE_VERTICES) {
+          guideVertices[guideVertexCount++] = {minIntersect.position, out, weight,
+                                               Color(0, 0, 0, 0), pdf};
+        }
+      }
+    } else {
+      auto sample = bsdf.Sample(_rnd);
 
 		if (sample.PDF < 0.01) break;
 
-		weight *= minIntersect.material->F(currentRay.direction, sample.Direction, minIntersect.normal) * minIntersect.material->GetColor(minIntersect, sample.Type) * std::abs(sample.Direction.Dot(minIntersect.normal)) / sample.PDF * rr_weight;
+		weight *= bsdf.Throughput(sample) * rr_weight;
+
+      out = sample.Direction;
+    }
 
-    currentRay = Ray(minIntersect.position + sample.Direction * 0.001f,
-                     sample.Direction);
+    currentRay = Ray(minIntersect.position + out * 0.001f, out);
 
     if (weight.ToVector3().LengthSquared() < 0.001) {
         break;
     }
   }
 
+  STAT_PATH_LENGTH(i);
+
+  // Training data for the next guiding iteration
+  for (int v = 0; v < guideVertexCount; v++) {
+    const GuideVertex &vertex = guideVertices[v];
+    m_Guide.Record(vertex.Position, vertex.Direction,
+                   Luminance(vertex.Radiance) / vertex.Pdf);
+  }
+
 	auto vec = L.ToVector3();
 	//vec.Clamp({ 0, 0, 0 }, { 100,100,100 });
 
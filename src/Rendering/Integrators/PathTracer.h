@@ -1,10 +1,34 @@
 #pragma once
 #include "Integrator.h"
+#include "../Accelerators/SDTree.h"
+
+/********************************************
+** PathTracer
+** Unidirectional path tracer. With guiding
+** enabled it learns an SD-tree over
+** progressive passes and samples diffuse
+** vertices from a mix of it and the BSDF.
+*********************************************/
 
 class PathTracer : Integrator {
+  bool m_Guiding;
+  SDTree m_Guide;
+
+  // Training iterations double in length, the current one ends at m_IterationEnd
+  int m_IterationLength;
+  int m_IterationEnd;
+
+  void EstimateBounds(DirectX::SimpleMath::Vector3 &_min,
+                      DirectX::SimpleMath::Vector3 &_max) const;
+
 public:
-  PathTracer(Scene *scene, Camera* camera, int w, int h) : Integrator(scene, camera, w, h) {}
+  PathTracer(Scene *scene, Camera *camera, int w, int h, bool guiding = false)
+      : Integrator(scene, camera, w, h), m_Guiding(guiding),
+        m_IterationLength(1), m_IterationEnd(1) {}
   virtual DirectX::SimpleMath::Color
   Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
-            std::default_random_engine &_rnd) const override;
+            RandomEngine &_rnd) const override;
+
+  virtual bool IsProgressive() const override { return m_Guiding; }
+  virtual void BeginPass(int pass, int threadCount) override;
 };
@@ -0,0 +1,303 @@
+#include "ReservoirResampling.h"
+#include "../Scene.h"
+#include "../BRDFs.h"
+#include "../Materials/Material.h"
+#include "../../Objects/RenderObject.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define MAX_DEPTH 8
+// Light candidates per pixel and pass
+#define CANDIDATES 32
+#define SPATIAL_NEIGHBOURS 5
+#define SPATIAL_RADIUS 30.0f
+// Reused reservoirs can't outweigh this many times the fresh candidates
+#define TEMPORAL_HISTORY 20
+
+static float Luminance(const Color &_color) {
+  return 0.2126f * _color.R() + 0.7152f * _color.G() + 0.0722f * _color.B();
+}
+
+bool ReservoirResampling::Reservoir::Update(const LightSample &sample, float weight,
+                                            float u) {
+  WeightSum += weight;
+  M += 1.0f;
+  if (weight > 0.0f && u * WeightSum < weight) {
+    Sample = sample;
+    return true;
+  }
+  return false;
+}
+
+ReservoirResampling::ReservoirResampling(Scene *scene, Camera *camera, int w, int h)
+    : Integrator(scene, camera, w, h), m_Surfaces(w * h), m_PreviousSurfaces(w * h),
+      m_Reservoirs(w * h), m_PreviousReservoirs(w * h), m_SpatialReservoirs(w * h),
+      m_Emitted(w * h), m_Result(w * h), m_GeometryVersion(0) {
+  for (int i = 0; i < w * h; i++) {
+    m_Surfaces[i].Valid = m_PreviousSurfaces[i].Valid = false;
+    m_Reservoirs[i].Clear();
+    m_PreviousReservoirs[i].Clear();
+    m_SpatialReservoirs[i].Clear();
+  }
+}
+
+Color ReservoirResampling::Contribution(const Surface &_surface,
+                                        const LightSample &_sample) const {
+  Vector3 toLight = _sample.Position - _surface.Hit.position;
+  float distSquared = toLight.LengthSquared();
+  if (distSquared <= 0.0f) {
+    return Color(0, 0, 0, 0);
+  }
+  toLight /= std::sqrt(distSquared);
+
+  float cosAtLight = std::abs(toLight.Dot(_sample.Normal));
+  float cosAtSurface = std::abs(toLight.Dot(_surface.Normal));
+
+  // Evaluate is scaled by pi
+  Color f = _surface.Bsdf.Evaluate(_surface.In, toLight);
+  return _surface.Beta * f * _sample.Le *
+         (cosAtSurface * cosAtLight / (XM_PI * distSquared));
+}
+
+float ReservoirResampling::TargetPdf(const Surface &_surface,
+                                     const LightSample &_sample) const {
+  return std::max(0.0f, Luminance(Contribution(_surface, _sample)));
+}
+
+// Reuse across pixels only between surfaces that see about the same lights
+bool ReservoirResampling::IsSimilar(const Surface &_a, const Surface &_b) const {
+  return _a.Valid && _b.Valid && _a.Normal.Dot(_b.Normal) > 0.9f &&
+         std::abs(_a.Depth - _b.Depth) < 0.1f * std::max(_a.Depth, _b.Depth) &&
+         _a.Hit.material == _b.Hit.material;
+}
+
+Color ReservoirResampling::TraceSurface(const Ray &_ray, Surface &_surface,
+                                        RandomEngine &_rnd) const {
+  Ray ray = _ray;
+  Color beta(1, 1, 1, 0);
+  float depth = 0.0f;
+  _surface.Valid = false;
+
+  for (int i = 0; i < MAX_DEPTH; i++) {
+    Intersection hit;
+    if (!m_Scene->Trace(ray, hit)) {
+      break;
+    }
+    depth += (hit.position - ray.position).Length();
+
+    BSDF bsdf = hit.material->Evaluate(hit, ray.direction);
+
+    if (bsdf.IsLight()) {
+      return beta * bsdf.Emission;
+    }
+
+    if (IsConnectible(bsdf.Type)) {
+      _surface.Hit = hit;
+      _surface.Bsdf = bsdf;
+      _surface.In = ray.direction;
+      _surface.Normal = hit.normal.Dot(ray.direction) < 0.0f ? hit.normal : -hit.normal;
+      _surface.Beta = beta;
+      _surface.Depth = depth;
+      _surface.Valid = true;
+      break;
+    }
+
+    auto sample = bsdf.Sample(_rnd);
+    if (sample.PDF <= 0.0f) {
+      break;
+    }
+
+    beta *= bsdf.Throughput(sample);
+    ray = Ray(hit.position + sample.Direction * 0.001f, sample.Direction);
+  }
+
+  return Color(0, 0, 0, 0);
+}
+
+// Resampled importance sampling of the light candidates, visibility is
+// only tested for the sample Shade ends up with
+void ReservoirResampling::SampleCandidates(const Surface &_surface, Reservoir &_reservoir,
+                                           RandomEngine &_rnd) const {
+  std::uniform_real_distribution<float> dist(0, 1);
+  const float sourcePdf = m_Scene->LightPdfA();
+
+  _reservoir.Clear();
+  for (int i = 0; i < CANDIDATES; i++) {
+    RenderObject *light;
+    float pickProbability;
+    Ray lightSample = m_Scene->SampleLight(_rnd, &light, pickProbability);
+
+    LightSample candidate;
+    candidate.Position = lightSample.position;
+    candidate.Normal = lightSample.direction;
+    candidate.Normal.Normalize();
+
+    Intersection lightPoint = {candidate.Position, candidate.Normal, Vector2(0, 0),
+                               light->GetMaterial(), light};
+    candidate.Le = light->GetMaterial()->Evaluate(lightPoint).Emission;
+
+    _reservoir.Update(candidate, TargetPdf(_surface, candidate) / sourcePdf, dist(_rnd));
+  }
+
+  FinalizeReservoir(_reservoir, _surface);
+}
+
+void ReservoirResampling::Combine(Reservoir &_target, const Surface &_surface,
+                                  const Reservoir &_source, RandomEngine &_rnd) const {
+  if (_source.M <= 0.0f) {
+    return;
+  }
+
+  std::uniform_real_distribution<float> dist(0, 1);
+  float weight = TargetPdf(_surface, _source.Sample) * _source.W * _source.M;
+
+  // Update counts a single sample, the source stands for M of them
+  _target.Update(_source.Sample, weight, dist(_rnd));
+  _target.M += _source.M - 1.0f;
+}
+
+void ReservoirResampling::FinalizeReservoir(Reservoir &_reservoir,
+                                            const Surface &_surface) const {
+  float target = _reservoir.M > 0.0f ? TargetPdf(_surface, _reservoir.Sample) : 0.0f;
+  _reservoir.W = target > 0.0f ? _reservoir.WeightSum / (_reservoir.M * target) : 0.0f;
+}
+
+Color ReservoirResampling::Shade(const Surface &_surface, const Reservoir &_reservoir) const {
+  if (_reservoir.W <= 0.0f) {
+    return Color(0, 0, 0, 0);
+  }
+  if (m_Scene->Occluded(_surface.Hit.position, _reservoir.Sample.Position)) {
+    return Color(0, 0, 0, 0);
+  }
+  return Contribution(_surface, _reservoir.Sample) * _reservoir.W;
+}
+
+Color ReservoirResampling::Intersect(const Ray &_ray, int _depth, bool _isSecondary,
+                                     RandomEngine &_rnd) const {
+  Surface surface;
+  Color L = TraceSurface(_ray, surface, _rnd);
+  if (!surface.Valid) {
+    return L;
+  }
+
+  Reservoir reservoir;
+  SampleCandidates(surface, reservoir, _rnd);
+  return L + Shade(surface, reservoir);
+}
+
+void ReservoirResampling::BeginFrame() {
+  // Light samples of the history are positions on emitters that may have
+  // moved, reusing them would leave ghost lighting
+  if (m_Scene->GetGeometryVersion() != m_GeometryVersion) {
+    m_GeometryVersion = m_Scene->GetGeometryVersion();
+    for (int i = 0; i < m_Width * m_Height; i++) {
+      m_Surfaces[i].Valid = m_PreviousSurfaces[i].Valid = false;
+      m_PreviousReservoirs[i].Clear();
+    }
+  }
+}
+
+void ReservoirResampling::BeginPass(int pass, int threadCount) {
+  threadCount = std::max(threadCount, 1);
+  const int pixelCount = m_Width * m_Height;
+
+  std::swap(m_Surfaces, m_PreviousSurfaces);
+
+#pragma omp parallel num_threads(threadCount)
+  {
+    std::random_device d;
+    RandomEngine rnd(d());
+    std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+
+    // Fresh candidates, then the reservoir of the previous pass (or frame)
+    // if it belongs to the same surface
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < pixelCount; i++) {
+      Surface &surface = m_Surfaces[i];
+      Reservoir &reservoir = m_Reservoirs[i];
+
+      float weight;
+      Ray ray = m_Camera->GetRay(float(i % m_Width) + jitter(rnd),
+                                 float(i / m_Width) + jitter(rnd), m_Width,
+                                 m_Height, rnd, weight);
+      STAT_INC(CameraRays);
+
+      surface.Time = Camera::GetRayTime();
+      surface.Valid = false;
+      m_Emitted[i] = weight > FLT_EPSILON ? TraceSurface(ray, surface, rnd)
+                                          : Color(0, 0, 0, 0);
+      if (!surface.Valid) {
+        reservoir.Clear();
+        continue;
+      }
+
+      SampleCandidates(surface, reservoir, rnd);
+
+      if (IsSimilar(surface, m_PreviousSurfaces[i])) {
+        Reservoir previous = m_PreviousReservoirs[i];
+        previous.M = std::min(previous.M, float(TEMPORAL_HISTORY * CANDIDATES));
+
+        Reservoir combined;
+        combined.Clear();
+        Combine(combined, surface, reservoir, rnd);
+        Combine(combined, surface, previous, rnd);
+        FinalizeReservoir(combined, surface);
+        reservoir = combined;
+      }
+    }
+
+    // Neighbours are read from the temporal result, written to a copy
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < pixelCount; i++) {
+      const Surface &surface = m_Surfaces[i];
+      Reservoir &spatial = m_SpatialReservoirs[i];
+      if (!surface.Valid) {
+        spatial.Clear();
+        continue;
+      }
+
+      spatial.Clear();
+      Combine(spatial, surface, m_Reservoirs[i], rnd);
+
+      std::uniform_real_distribution<float> dist(0, 1);
+      for (int n = 0; n < SPATIAL_NEIGHBOURS; n++) {
+        float radius = SPATIAL_RADIUS * std::sqrt(dist(rnd));
+        float angle = XM_2PI * dist(rnd);
+        int x = i % m_Width + int(std::round(radius * std::cos(angle)));
+        int y = i / m_Width + int(std::round(radius * std::sin(angle)));
+        if (x < 0 || y < 0 || x >= m_Width || y >= m_Height) {
+          continue;
+        }
+
+        int neighbour = x + y * m_Width;
+        if (neighbour != i && IsSimilar(surface, m_Surfaces[neighbour])) {
+          Combine(spatial, surface, m_Reservoirs[neighbour], rnd);
+        }
+      }
+      FinalizeReservoir(spatial, surface);
+    }
+
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < pixelCount; i++) {
+      m_Result[i] = m_Emitted[i];
+      if (m_Surfaces[i].Valid) {
+        Camera::SetRayTime(m_Surfaces[i].Time);
+        m_Result[i] += Shade(m_Surfaces[i], m_SpatialReservoirs[i]);
+      }
+    }
+  }
+
+  // The spatially reused reservoirs feed the next pass and frame
+  std::swap(m_SpatialReservoirs, m_PreviousReservoirs);
+}
+
+Color ReservoirResampling::Sample(float x, float y, int w, int h,
+                                  RandomEngine &_rnd) const {
+  int px = std::max(0, std::min(int(x + 0.5f), m_Width - 1));
+  int py = std::max(0, std::min(int(y + 0.5f), m_Height - 1));
+  return m_Result[px + py * m_Width];
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "Integrator.h"
+#include "../../Geometry/Intersection.h"
+#include "../Materials/BSDF.h"
+
+#include <vector>
+
+/********************************************
+** ReservoirResampling
+** ReSTIR direct lighting (Bitterli et al.
+** 2020). Every pass resamples light candidates
+** per pixel, reuses the reservoirs of the
+** previous pass or frame at the same surface
+** and of neighbouring pixels, and traces a
+** single shadow ray for the chosen sample.
+** History is dropped when geometry moves.
+*********************************************/
+
+class ReservoirResampling : Integrator {
+  struct LightSample {
+    DirectX::SimpleMath::Vector3 Position;
+    DirectX::SimpleMath::Vector3 Normal;
+    DirectX::SimpleMath::Color Le;
+  };
+
+  struct Reservoir {
+    LightSample Sample;
+    float WeightSum;
+    float M;
+    // Unbiased contribution weight of Sample
+    float W;
+
+    void Clear() { WeightSum = M = W = 0.0f; }
+    bool Update(const LightSample &sample, float weight, float u);
+  };
+
+  // First diffuse vertex of the camera path
+  struct Surface {
+    Intersection Hit;
+    // Closure for In, evaluated for every candidate
+    BSDF Bsdf;
+    DirectX::SimpleMath::Vector3 In;
+    DirectX::SimpleMath::Vector3 Normal;
+    DirectX::SimpleMath::Color Beta;
+    float Depth;
+    // Shutter time of the camera ray, Shade runs after other pixels traced
+    float Time;
+    bool Valid;
+  };
+
+  std::vector<Surface> m_Surfaces;
+  std::vector<Surface> m_PreviousSurfaces;
+  std::vector<Reservoir> m_Reservoirs;
+  std::vector<Reservoir> m_PreviousReservoirs;
+  std::vector<Reservoir> m_SpatialReservoirs;
+
+  // Light hit directly or through specular surfaces
+  std::vector<DirectX::SimpleMath::Color> m_Emitted;
+  std::vector<DirectX::SimpleMath::Color> m_Result;
+
+  // Scene::GetGeometryVersion the history was built with
+  uint64_t m_GeometryVersion;
+
+  // Unshadowed contribution of the sample, the resampling target
+  float TargetPdf(const Surface &_surface, const LightSample &_sample) const;
+  DirectX::SimpleMath::Color Contribution(const Surface &_surface,
+                                          const LightSample &_sample) const;
+  bool IsSimilar(const Surface &_a, const Surface &_b) const;
+
+  // Follows specular bounces, returns the light found on the way
+  DirectX::SimpleMath::Color TraceSurface(const DirectX::SimpleMath::Ray &_ray,
+                                          Surface &_surface,
+                                          RandomEngine &_rnd) const;
+  void SampleCandidates(const Surface &_surface, Reservoir &_reservoir,
+                        RandomEngine &_rnd) const;
+  void Combine(Reservoir &_target, const Surface &_surface,
+               const Reservoir &_source, RandomEngine &_rnd) const;
+  void FinalizeReservoir(Reservoir &_reservoir, const Surface &_surface) const;
+  DirectX::SimpleMath::Color Shade(const Surface &_surface,
+                                   const Reservoir &_reservoir) const;
+
+public:
+  ReservoirResampling(Scene *scene, Camera *camera, int w, int h);
+
+  virtual DirectX::SimpleMath::Color
+  Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
+            RandomEngine &_rnd) const override;
+
+  virtual DirectX::SimpleMath::Color
+  Sample(float x, float y, int w, int h, RandomEngine &_rnd) const override;
+
+  virtual void BeginFrame() override;
+  virtual bool IsProgressive() const override { return true; }
+  virtual void BeginPass(int pass, int threadCount) override;
+};
@@ -0,0 +1,359 @@
+#include "StochasticProgressivePhotonMapper.h"
+#include "../Scene.h"
+#include "../BRDFs.h"
+#include "../Materials/Material.h"
+#include "../../Objects/RenderObject.h"
+
+#include <algorithm>
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define MAX_DEPTH 8
+
+// BSDF::Evaluate and BSDF::Pdf are scaled by pi
+#define INV_PI (1.0f / XM_PI)
+
+static bool IsConnectible(const BSDF &_bsdf) {
+  return IsConnectible(_bsdf.Type);
+}
+
+static float Luminance(const Color &_color) {
+  return 0.2126f * _color.R() + 0.7152f * _color.G() + 0.0722f * _color.B();
+}
+
+StochasticProgressivePhotonMapper::StochasticProgressivePhotonMapper(Scene *scene,
+                                                                     Camera *camera,
+                                                                     int w, int h)
+    : Integrator(scene, camera, w, h), m_Pixels(new PixelState[w * h]) {
+  for (int i = 0; i < w * h; i++) {
+    PixelState &pixel = m_Pixels[i];
+    pixel.Point.Valid = false;
+    pixel.Direct = pixel.Tau = Color(0, 0, 0, 0);
+    pixel.Radius = 0.0f;
+    pixel.N = 0.0f;
+    for (auto &phi : pixel.Phi) {
+      phi.store(0.0f, std::memory_order_relaxed);
+    }
+    pixel.M.store(0, std::memory_order_relaxed);
+  }
+}
+
+Color StochasticProgressivePhotonMapper::SampleDirectLight(const Intersection &_intersect,
+                                                           const BSDF &_bsdf,
+                                                           RandomEngine &_rnd) const {
+  RenderObject *light;
+  float pickProbability;
+  Ray lightSample = m_Scene->SampleLight(_rnd, &light, pickProbability);
+
+  Vector3 lightNormal = lightSample.direction;
+  lightNormal.Normalize();
+
+  Vector3 toLight = lightSample.position - _intersect.position;
+  float distSquared = toLight.LengthSquared();
+  toLight.Normalize();
+
+  float cosAtLight = std::abs(toLight.Dot(lightNormal));
+  if (cosAtLight <= FLT_EPSILON) {
+    return Color(0, 0, 0, 0);
+  }
+
+  Color f = _bsdf.Evaluate(_bsdf.View, toLight);
+  if (Luminance(f) <= 0.0f) {
+    return Color(0, 0, 0, 0);
+  }
+
+  if (m_Scene->Occluded(_intersect.position, lightSample.position)) {
+    return Color(0, 0, 0, 0);
+  }
+
+  Intersection lightPoint = {lightSample.position, lightNormal, Vector2(0, 0),
+                             light->GetMaterial(), light};
+  Color Le = light->GetMaterial()->Evaluate(lightPoint).Emission;
+
+  float cosToLight = std::abs(toLight.Dot(_intersect.normal));
+  return Le * f *
+         (INV_PI * cosToLight * cosAtLight / (distSquared * m_Scene->LightPdfA()));
+}
+
+// Follows the eye path through specular vertices up to the first diffuse
+// one, which becomes the visible point. Returns the emitted and direct
+// light found on the way.
+Color StochasticProgressivePhotonMapper::Intersect(const Ray &_ray, int _depth,
+                                                   bool _isSecondary,
+                                                   RandomEngine &_rnd) const {
+  VisiblePoint point;
+  return TraceVisiblePoint(_ray, _depth, point, _rnd);
+}
+
+Color StochasticProgressivePhotonMapper::TraceVisiblePoint(const Ray &_ray, int _depth,
+                                                           VisiblePoint &_point,
+                                                           RandomEngine &_rnd) const {
+  Ray ray = _ray;
+  Color beta(1, 1, 1, 0);
+  Color L(0, 0, 0, 0);
+  _point.Valid = false;
+
+  for (int depth = 0; depth < _depth; depth++) {
+    Intersection hit;
+    if (!m_Scene->Trace(ray, hit)) {
+      break;
+    }
+
+    BSDF bsdf = hit.material->Evaluate(hit, ray.direction);
+
+    if (bsdf.IsLight()) {
+      L += beta * bsdf.Emission;
+      break;
+    }
+
+    if (IsConnectible(bsdf)) {
+      L += beta * SampleDirectLight(hit, bsdf, _rnd);
+
+      _point.Hit = hit;
+      _point.Bsdf = bsdf;
+      _point.In = ray.direction;
+      _point.Beta = beta;
+      _point.Valid = true;
+      break;
+    }
+
+    auto sample = bsdf.Sample(_rnd);
+    if (sample.PDF <= 0.0f) {
+      break;
+    }
+
+    beta *= bsdf.Throughput(sample);
+    if (Luminance(beta) <= 0.0f) {
+      break;
+    }
+
+    ray = Ray(hit.position + sample.Direction * 0.001f, sample.Direction);
+  }
+
+  return L;
+}
+
+void StochasticProgressivePhotonMapper::TraceVisiblePoints(int threadCount) {
+  const int pixelCount = m_Width * m_Height;
+
+#pragma omp parallel num_threads(threadCount)
+  {
+    std::random_device d;
+    RandomEngine rnd(d());
+    std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < pixelCount; i++) {
+      PixelState &pixel = m_Pixels[i];
+      pixel.Direct = Color(0, 0, 0, 0);
+      pixel.Point.Valid = false;
+
+      float weight;
+      Ray ray = m_Camera->GetRay(float(i % m_Width) + jitter(rnd),
+                                 float(i / m_Width) + jitter(rnd), m_Width,
+                                 m_Height, rnd, weight);
+      STAT_INC(CameraRays);
+      if (weight <= FLT_EPSILON) {
+        continue;
+      }
+
+      pixel.Direct = TraceVisiblePoint(ray, MAX_DEPTH, pixel.Point, rnd);
+    }
+  }
+
+  m_VisiblePixels.clear();
+  for (int i = 0; i < pixelCount; i++) {
+    if (m_Pixels[i].Point.Valid) {
+      m_VisiblePixels.push_back(uint32_t(i));
+    }
+  }
+}
+
+void StochasticProgressivePhotonMapper::TracePhotons(int threadCount) {
+  const int photonCount = PhotonCount();
+  const float lightPdfA = m_Scene->LightPdfA();
+
+#pragma omp parallel num_threads(threadCount)
+  {
+    std::random_device d;
+    RandomEngine rnd(d());
+    std::uniform_real_distribution<float> dist(0, 1);
+
+#pragma omp for schedule(dynamic, 256)
+    for (int i = 0; i < photonCount; i++) {
+      RenderObject *light;
+      float pickProbability;
+      Ray lightStart = m_Scene->SampleLight(rnd, &light, pickProbability);
+
+      // Emitters are two sided, pick a side and sample the cosine lobe
+      Vector3 lightNormal = lightStart.direction;
+      lightNormal.Normalize();
+      if (dist(rnd) < 0.5f) {
+        lightNormal = -lightNormal;
+      }
+
+      Vector3 direction = CosWeightedRandomHemisphereDirection2(lightNormal, rnd);
+      float cosLight = std::abs(direction.Dot(lightNormal));
+      if (cosLight <= 0.0f) {
+        continue;
+      }
+
+      Intersection lightPoint = {lightStart.position, lightNormal, Vector2(0, 0),
+                                 light->GetMaterial(), light};
+      float emissionPdfW = lightPdfA * cosLight * INV_PI * 0.5f;
+      Color beta = light->GetMaterial()->Evaluate(lightPoint).Emission *
+                   cosLight / emissionPdfW;
+
+      Ray ray(lightStart.position + direction * 0.001f, direction);
+
+      for (int depth = 0; depth < MAX_DEPTH; depth++) {
+        Intersection hit;
+        if (!m_Scene->Trace(ray, hit) || hit.material->IsLight()) {
+          break;
+        }
+
+        BSDF bsdf = hit.material->Evaluate(hit, ray.direction);
+
+        // Direct light is sampled at the visible points
+        if (depth > 0 && IsConnectible(bsdf)) {
+          m_Grid.Query(hit.position, [&](uint32_t index) {
+            PixelState &pixel = m_Pixels[m_VisiblePixels[index]];
+            const VisiblePoint &point = pixel.Point;
+            if ((point.Hit.position - hit.position).LengthSquared() >
+                pixel.Radius * pixel.Radius) {
+              return;
+            }
+
+            // The photon arrives from -direction
+            Color phi = beta * point.Bsdf.Evaluate(point.In, -ray.direction) * INV_PI;
+            AtomicAdd(pixel.Phi[0], phi.R());
+            AtomicAdd(pixel.Phi[1], phi.G());
+            AtomicAdd(pixel.Phi[2], phi.B());
+            pixel.M.fetch_add(1, std::memory_order_relaxed);
+          });
+        }
+
+        auto sample = bsdf.Sample(rnd);
+        if (sample.PDF <= 0.0f) {
+          break;
+        }
+
+        Color newBeta;
+        if (IsConnectible(sample.Type) && IsConnectible(bsdf)) {
+          float pdf = bsdf.Pdf(ray.direction, sample.Direction);
+          if (pdf <= 0.0f) {
+            break;
+          }
+          float cosOut = std::abs(sample.Direction.Dot(hit.normal));
+          newBeta = beta * bsdf.Evaluate(ray.direction, sample.Direction) * cosOut / pdf;
+        } else {
+          newBeta = beta * bsdf.Throughput(sample);
+        }
+
+        if (Luminance(newBeta) <= 0.0f) {
+          break;
+        }
+
+        // Russian roulette on the throughput change keeps photon power constant
+        float q = std::max(0.0f, 1.0f - Luminance(newBeta) / Luminance(beta));
+        if (dist(rnd) < q) {
+          STAT_INC(RussianRouletteTerminations);
+          break;
+        }
+        beta = newBeta / (1.0f - q);
+
+        ray = Ray(hit.position + sample.Direction * 0.001f, sample.Direction);
+      }
+    }
+  }
+}
+
+void StochasticProgressivePhotonMapper::UpdatePixels(int threadCount) {
+  const int pixelCount = m_Width * m_Height;
+
+#pragma omp parallel for num_threads(threadCount) schedule(static)
+  for (int i = 0; i < pixelCount; i++) {
+    PixelState &pixel = m_Pixels[i];
+
+    int M = pixel.M.exchange(0, std::memory_order_relaxed);
+    Color phi(pixel.Phi[0].exchange(0.0f, std::memory_order_relaxed),
+              pixel.Phi[1].exchange(0.0f, std::memory_order_relaxed),
+              pixel.Phi[2].exchange(0.0f, std::memory_order_relaxed), 0.0f);
+
+    if (M > 0) {
+      float N = pixel.N + m_Gamma * M;
+      float radius = pixel.Radius * std::sqrt(N / (pixel.N + M));
+      pixel.Tau = (pixel.Tau + pixel.Point.Beta * phi) *
+                  (radius * radius / (pixel.Radius * pixel.Radius));
+      pixel.N = N;
+      pixel.Radius = radius;
+    }
+  }
+}
+
+void StochasticProgressivePhotonMapper::BeginPass(int pass, int threadCount) {
+  threadCount = std::max(threadCount, 1);
+
+  TraceVisiblePoints(threadCount);
+
+  // The initial radius follows the extent of the first visible points
+  if (pass == 0) {
+    Vector3 minPos(FLT_MAX, FLT_MAX, FLT_MAX), maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t i : m_VisiblePixels) {
+      minPos = Vector3::Min(minPos, m_Pixels[i].Point.Hit.position);
+      maxPos = Vector3::Max(maxPos, m_Pixels[i].Point.Hit.position);
+    }
+
+    float radius = m_VisiblePixels.empty() ? 0.0f : 0.01f * (maxPos - minPos).Length();
+    for (int i = 0; i < m_Width * m_Height; i++) {
+      m_Pixels[i].Radius = radius;
+      m_Pixels[i].N = 0.0f;
+      m_Pixels[i].Tau = Color(0, 0, 0, 0);
+    }
+  }
+
+  float maxRadius = 0.0f;
+  for (uint32_t i : m_VisiblePixels) {
+    maxRadius = std::max(maxRadius, m_Pixels[i].Radius);
+  }
+  if (maxRadius <= 0.0f) {
+    return;
+  }
+
+  m_Grid.Build(m_VisiblePixels.size(), 2.0f * maxRadius,
+               [this](size_t i, Vector3 &center, float &radius) {
+                 const PixelState &pixel = m_Pixels[m_VisiblePixels[i]];
+                 center = pixel.Point.Hit.position;
+                 radius = pixel.Radius;
+               },
+               threadCount);
+
+  TracePhotons(threadCount);
+  UpdatePixels(threadCount);
+}
+
+// Direct light is estimated anew every pass
+Color StochasticProgressivePhotonMapper::Sample(float x, float y, int w, int h,
+                                                RandomEngine &_rnd) const {
+  int px = std::max(0, std::min(int(x + 0.5f), m_Width - 1));
+  int py = std::max(0, std::min(int(y + 0.5f), m_Height - 1));
+  return m_Pixels[px + py * m_Width].Direct;
+}
+
+void StochasticProgressivePhotonMapper::ResolveSplats(Color *image, int totalSamples) const {
+  // Every pass emitted PhotonCount photons
+  float photons = float(totalSamples) * float(PhotonCount());
+
+  for (int i = 0; i < m_Width * m_Height; i++) {
+    const PixelState &pixel = m_Pixels[i];
+    if (pixel.Radius <= 0.0f) {
+      continue;
+    }
+
+    float factor = 1.0f / (photons * XM_PI * pixel.Radius * pixel.Radius);
+    image[i].x += pixel.Tau.R() * factor;
+    image[i].y += pixel.Tau.G() * factor;
+    image[i].z += pixel.Tau.B() * factor;
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "Integrator.h"
+#include "../../Geometry/Intersection.h"
+#include "../Accelerators/HashGrid.h"
+#include "../Materials/BSDF.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/********************************************
+** StochasticProgressivePhotonMapper
+** SPPM (Hachisuka and Jensen 2009). Every pass
+** traces a camera path per pixel up to the
+** first diffuse vertex, hashes those visible
+** points and splats photons onto them. Pixel
+** radii shrink as photons are gathered.
+*********************************************/
+
+class StochasticProgressivePhotonMapper : Integrator {
+  // First diffuse vertex of an eye path
+  struct VisiblePoint {
+    Intersection Hit;
+    // Closure for In, shared by all photons landing here
+    BSDF Bsdf;
+    DirectX::SimpleMath::Vector3 In;
+    DirectX::SimpleMath::Color Beta;
+    bool Valid;
+  };
+
+  struct PixelState {
+    VisiblePoint Point;
+
+    // Direct light of the current pass, returned by Sample
+    DirectX::SimpleMath::Color Direct;
+
+    float Radius;
+    float N;
+    DirectX::SimpleMath::Color Tau;
+
+    // Photons gathered during the current pass
+    std::atomic<float> Phi[3];
+    std::atomic<int> M;
+  };
+
+  // Fraction of new photons kept each pass
+  const float m_Gamma = 2.0f / 3.0f;
+
+  std::unique_ptr<PixelState[]> m_Pixels;
+  std::vector<uint32_t> m_VisiblePixels;
+  HashGrid m_Grid;
+
+  void TraceVisiblePoints(int threadCount);
+  void TracePhotons(int threadCount);
+  void UpdatePixels(int threadCount);
+
+  DirectX::SimpleMath::Color
+  TraceVisiblePoint(const DirectX::SimpleMath::Ray &_ray, int _depth,
+                    VisiblePoint &_point,
+                    RandomEngine &_rnd) const;
+
+  DirectX::SimpleMath::Color
+  SampleDirectLight(const Intersection &_intersect, const BSDF &_bsdf,
+                    RandomEngine &_rnd) const;
+
+  int PhotonCount() const { return m_Width * m_Height; }
+
+public:
+  StochasticProgressivePhotonMapper(Scene *scene, Camera *camera, int w, int h);
+
+  virtual DirectX::SimpleMath::Color
+  Intersect(const DirectX::SimpleMath::Ray &_ray, int _depth, bool _isSecondary,
+            RandomEngine &_rnd) const override;
+
+  virtual DirectX::SimpleMath::Color
+  Sample(float x, float y, int w, int h,
+         RandomEngine &_rnd) const override;
+
+  virtual bool IsProgressive() const override { return true; }
+  virtual void BeginPass(int pass, int threadCount) override;
+
+  // Adds the photon density estimate to the image
+  virtual void ResolveSplats(DirectX::SimpleMath::Color *image,
+                             int totalSamples) const override;
+};
@@ -0,0 +1,163 @@
+#include "VertexConnectionMerging.h"
+#include "../Scene.h"
+#include "../Materials/Material.h"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace DirectX;
+using namespace DirectX::SimpleMath;
+
+#define MAX_DEPTH 8
+
+void VertexConnectionMerging::TraceLightPaths(int threadCount) {
+  const int pathCount = m_Width * m_Height;
+
+  // Each thread gets a contiguous range of paths (static schedule), so the
+  // per thread buffers concatenated in thread order are sorted by path
+  std::vector<std::vector<PathVertex>> threadVertices(threadCount);
+  std::vector<uint32_t> localEnds(pathCount);
+  std::vector<int> pathThread(pathCount);
+
+#pragma omp parallel num_threads(threadCount)
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    std::random_device d;
+    RandomEngine rnd(d());
+    auto &vertices = threadVertices[thread];
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < pathCount; i++) {
+      TraceLightPath(MAX_DEPTH, vertices, rnd);
+      localEnds[i] = uint32_t(vertices.size());
+      pathThread[i] = thread;
+    }
+  }
+
+  std::vector<uint32_t> threadOffsets(threadCount + 1, 0);
+  for (int t = 0; t < threadCount; t++) {
+    threadOffsets[t + 1] = threadOffsets[t] + uint32_t(threadVertices[t].size());
+  }
+
+  m_LightVertices.resize(threadOffsets[threadCount]);
+  for (int t = 0; t < threadCount; t++) {
+    std::copy(threadVertices[t].begin(), threadVertices[t].end(),
+              m_LightVertices.begin() + threadOffsets[t]);
+  }
+
+  m_PathStarts.resize(pathCount + 1);
+  m_PathStarts[0] = 0;
+  for (int i = 0; i < pathCount; i++) {
+    m_PathStarts[i + 1] = threadOffsets[pathThread[i]] + localEnds[i];
+  }
+}
+
+void VertexConnectionMerging::BeginPass(int pass, int threadCount) {
+  threadCount = std::max(threadCount, 1);
+
+  // The merging weights of the light paths depend on the radius of this pass
+  if (pass > 0) {
+    m_Radius = m_BaseRadius * std::pow(float(pass + 1), 0.5f * (m_Alpha - 1.0f));
+  }
+
+  float etaVCM = XM_PI * m_Radius * m_Radius * LightSubPathCount();
+  m_MisVmWeightFactor = pass > 0 ? etaVCM : 0.0f;
+  m_MisVcWeightFactor = pass > 0 ? 1.0f / etaVCM : 0.0f;
+  m_VmNormalization = pass > 0 ? 1.0f / etaVCM : 0.0f;
+
+  TraceLightPaths(threadCount);
+
+  // The first pass only connects and sizes the radius after the extent of
+  // the light vertices
+  if (pass == 0) {
+    Vector3 minPos(FLT_MAX, FLT_MAX, FLT_MAX), maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const auto &vertex : m_LightVertices) {
+      minPos = Vector3::Min(minPos, vertex.Intersect.position);
+      maxPos = Vector3::Max(maxPos, vertex.Intersect.position);
+    }
+
+    m_BaseRadius = m_LightVertices.empty() ? 0.0f : 0.003f * (maxPos - minPos).Length();
+    m_Radius = m_BaseRadius;
+    return;
+  }
+
+  if (m_Radius <= 0.0f) {
+    m_MisVmWeightFactor = m_MisVcWeightFactor = m_VmNormalization = 0.0f;
+    return;
+  }
+
+  m_Grid.Build(m_LightVertices.size(), 2.0f * m_Radius,
+               [this](size_t i, Vector3 &center, float &radius) {
+                 center = m_LightVertices[i].Intersect.position;
+                 radius = m_Radius;
+               },
+               threadCount);
+}
+
+Color VertexConnectionMerging::Merge(const SubPathState &_state,
+                                     const Intersection &_intersect,
+                                     const BSDF &_bsdf, int _depth) const {
+  const float radiusSquared = m_Radius * m_Radius;
+  Vector3 in = _state.Ray.direction;
+
+  Color contribution(0, 0, 0, 0);
+
+  m_Grid.Query(_intersect.position, [&](uint32_t index) {
+    const PathVertex &lightVertex = m_LightVertices[index];
+
+    if ((lightVertex.Intersect.position - _intersect.position).LengthSquared() > radiusSquared) {
+      return;
+    }
+    if (lightVertex.PathLength + _state.PathLength > _depth) {
+      return;
+    }
+
+    // The photon arrives from -In
+    Color f = _bsdf.Evaluate(in, -lightVertex.In);
+    if (f.R() <= 0.0f && f.G() <= 0.0f && f.B() <= 0.0f) {
+      return;
+    }
+
+    float cameraDirPdfW = _bsdf.Pdf(in, -lightVertex.In) / XM_PI;
+    float cameraRevPdfW = _bsdf.Pdf(lightVertex.In, -in) / XM_PI;
+
+    float wLight = lightVertex.dVCM * m_MisVcWeightFactor + lightVertex.dVM * cameraDirPdfW;
+    float wCamera = _state.dVCM * m_MisVcWeightFactor + _state.dVM * cameraRevPdfW;
+    float misWeight = 1.0f / (wLight + 1.0f + wCamera);
+
+    contribution += f * lightVertex.Throughput * (misWeight / XM_PI);
+  });
+
+  return contribution * m_VmNormalization;
+}
+
+Color VertexConnectionMerging::Sample(float x, float y, int w, int h,
+                                      RandomEngine &_rnd) const {
+  float weight;
+  Ray ray = m_Camera->GetRay(x, y, w, h, _rnd, weight);
+  STAT_INC(CameraRays);
+
+  if (weight <= FLT_EPSILON) {
+    return Color(0, 0, 0, 0);
+  }
+
+  // Eye paths connect to the light path traced for their pixel
+  int px = std::max(0, std::min(int(x + 0.5f), m_Width - 1));
+  int py = std::max(0, std::min(int(y + 0.5f), m_Height - 1));
+  size_t path = size_t(px + py * m_Width);
+
+  const PathVertex *lightVertices = nullptr;
+  size_t lightVertexCount = 0;
+  if (path + 1 < m_PathStarts.size()) {
+    lightVertices = m_LightVertices.data() + m_PathStarts[path];
+    lightVertexCount = m_PathStarts[path + 1] - m_PathStarts[path];
+  }
+
+  return TraceEyePath(ray, MAX_DEPTH, lightVertices, lightVertexCount, _rnd);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "BidirectionalPathTracer.h"
+#include "../Accelerators/HashGrid.h"
+
+#include <vector>
+
+/********************************************
+** VertexConnectionMerging
+** BDPT combined with photon mapping style
+** vertex merging (Georgiev et al. 2012). Each
+** pass traces one light path per pixel, stores
+** the vertices in a hash grid and merges eye
+** vertices with them using a radius that
+** shrinks from pass to pass.
+*********************************************/
+
+class VertexConnectionMerging : public BidirectionalPathTracer {
+  // Radius reduction exponent of progressive photon mapping
+  const float m_Alpha = 0.75f;
+
+  float m_BaseRadius;
+  float m_Radius;
+
+  std::vector<PathVertex> m_LightVertices;
+  // Light path i owns m_LightVertices[m_PathStarts[i], m_PathStarts[i + 1])
+  std::vector<uint32_t> m_PathStarts;
+
+  HashGrid m_Grid;
+
+  void TraceLightPaths(int threadCount);
+
+  virtual DirectX::SimpleMath::Color Merge(const SubPathState &_state,
+                                           const Intersection &_intersect,
+                                           const BSDF &_bsdf,
+                                           int _depth) const override;
+
+public:
+  VertexConnectionMerging(Scene *scene, Camera *camera, int w, int h)
+      : BidirectionalPathTracer(scene, camera, w, h), m_BaseRadius(0),
+        m_Radius(0) {}
+
+  virtual bool IsProgressive() const override { return true; }
+  virtual void BeginPass(int pass, int threadCount) override;
+
+  virtual DirectX::SimpleMath::Color
+  Sample(float x, float y, int w, int h,
+         RandomEngine &_rnd) const override;
+};
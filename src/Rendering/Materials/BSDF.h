@@ -0,0 +1,418 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include "../BRDFs.h"
+#include "../Statistics.h"
+#include "MaterialTables.h"
+#include <cstring>
+
+// Type tag of a material, selects the shading code of a BSDF. Transparent
+// materials hand their closure to the child and never appear on a BSDF.
+enum class MaterialKind : unsigned char {
+  Diffuse,
+  Specular,
+  Emission,
+  Transparent,
+  // GGX microfacet models
+  Conductor,
+  Dielectric,
+  Plastic
+};
+
+// Smallest GGX roughness, smooth surfaces are sharp GGX lobes
+#define MIN_ALPHA 1e-3f
+// Roughness from which microfacet lobes are Glossy, smoother ones are
+// treated like Specular
+#define GLOSSY_ALPHA 0.1f
+
+/********************************************
+** BSDF
+** Shading closure of one hit, produced by
+** Material::Evaluate. Texture values and the
+** lobes for the incoming direction are looked
+** up once and reused by sampling, evaluation
+** and pdf queries. Dispatch is on Kind.
+*********************************************/
+
+struct BSDF {
+  MaterialKind Kind;
+  InteractionType Type;
+
+  DirectX::SimpleMath::Vector3 Normal;
+  // Incoming ray direction the closure was built for, towards the surface
+  DirectX::SimpleMath::Vector3 View;
+  // sign(View . Normal), -1 when the front side was hit
+  float Inside;
+
+  DirectX::SimpleMath::Color Diffuse;
+  DirectX::SimpleMath::Color Specular;
+  DirectX::SimpleMath::Color Emission;
+
+  // Transparency, Passthrough is the probability of passing through
+  DirectX::SimpleMath::Color Opacity;
+  float Passthrough;
+
+  // Normalized lobe probabilities and the Phong exponent of Specular, the
+  // mirror and refraction directions of View, the mirror direction under
+  // total internal reflection
+  struct PhongLobes {
+    float Kd, Ks, Kt;
+    float Roughness;
+    DirectX::SimpleMath::Vector3 Reflected;
+    DirectX::SimpleMath::Vector3 Refracted;
+  };
+
+  // Shading frame with Shading facing -View, GGX roughness, index of
+  // refraction of the far side relative to the View side and the conductor
+  // reflectance at normal incidence, or its complex index of refraction when
+  // ComplexIOR is set. Compensation is the energy compensation over pi from
+  // MaterialTables, the multiple scattering color of conductors and the base
+  // normalization of plastic.
+  struct MicrofacetLobes {
+    DirectX::SimpleMath::Vector3 Tangent, Bitangent, Shading;
+    float Alpha;
+    float Eta;
+    union {
+      DirectX::SimpleMath::Color F0;
+      DirectX::SimpleMath::Color ConductorEta;
+    };
+    DirectX::SimpleMath::Color ConductorK;
+    bool ComplexIOR;
+    DirectX::SimpleMath::Color Compensation;
+  };
+
+  // Only the lobes of Kind are stored, set by PrepareLobes or
+  // PrepareMicrofacet
+  union {
+    PhongLobes Phong;
+    MicrofacetLobes Microfacet;
+  };
+
+  BSDF() : BSDF(DirectX::SimpleMath::Vector3(0, 0, 0), DirectX::SimpleMath::Vector3(0, 0, 0)) {}
+
+  BSDF(DirectX::SimpleMath::Vector3 _normal, DirectX::SimpleMath::Vector3 _view)
+      : Kind(MaterialKind::Diffuse), Type(InteractionType::Diffuse),
+        Normal(_normal), View(_view), Inside(sign(_view.Dot(_normal))),
+        Passthrough(0.0f) {}
+
+  // The lobes are plain floats but SimpleMath types aren't trivially
+  // copyable, which the union needs
+  BSDF(const BSDF &_other) { std::memcpy((void *)this, &_other, sizeof(BSDF)); }
+
+  BSDF &operator=(const BSDF &_other) {
+    std::memcpy((void *)this, &_other, sizeof(BSDF));
+    return *this;
+  }
+
+  bool IsLight() const { return Kind == MaterialKind::Emission; }
+
+  bool IsMicrofacet() const { return Kind >= MaterialKind::Conductor; }
+
+  void PrepareMicrofacet(float _alpha, float _eta) {
+    Microfacet.Alpha = std::max(_alpha, MIN_ALPHA);
+    Microfacet.Eta = _eta;
+    Microfacet.Shading = -Inside * Normal;
+    BuildFrame(Microfacet.Shading, Microfacet.Tangent, Microfacet.Bitangent);
+  }
+
+  DirectX::SimpleMath::Vector3 ToLocal(DirectX::SimpleMath::Vector3 _v) const {
+    return DirectX::SimpleMath::Vector3(_v.Dot(Microfacet.Tangent), _v.Dot(Microfacet.Bitangent),
+                                        _v.Dot(Microfacet.Shading));
+  }
+
+  DirectX::SimpleMath::Vector3 FromLocal(DirectX::SimpleMath::Vector3 _v) const {
+    return Microfacet.Tangent * _v.x + Microfacet.Bitangent * _v.y + Microfacet.Shading * _v.z;
+  }
+
+  // Probability of sampling the coating of plastic, from its albedo
+  float PlasticSpecularProbability(float _coating) const {
+    float diffuse = (1.0f - _coating) *
+                    (0.2126f * Diffuse.R() + 0.7152f * Diffuse.G() + 0.0722f * Diffuse.B());
+    return std::max(0.1f, std::min(0.9f, _coating / (_coating + diffuse + 1e-6f)));
+  }
+
+  // Unscaled BSDF and solid angle density of the microfacet models. _in
+  // points towards the surface, _out away from it.
+  DirectX::SimpleMath::Color EvaluateMicrofacet(DirectX::SimpleMath::Vector3 _in,
+                                                DirectX::SimpleMath::Vector3 _out,
+                                                float &_pdf) const {
+    const DirectX::SimpleMath::Color black(0.0f, 0.0f, 0.0f);
+    _pdf = 0.0f;
+
+    DirectX::SimpleMath::Vector3 wo = ToLocal(-_in);
+    DirectX::SimpleMath::Vector3 wi = ToLocal(_out);
+    float alpha = Microfacet.Alpha;
+    float eta = Microfacet.Eta;
+    if (wo.z < 0.0f) {
+      wo.z = -wo.z;
+      wi.z = -wi.z;
+      eta = 1.0f / eta;
+    }
+    if (wo.z <= 0.0f || wi.z == 0.0f) {
+      return black;
+    }
+
+    bool reflect = wi.z > 0.0f;
+    if (!reflect && Kind != MaterialKind::Dielectric) {
+      return black;
+    }
+
+    DirectX::SimpleMath::Vector3 wm = reflect ? wo + wi : wo + wi * eta;
+    if (wm.LengthSquared() <= 0.0f) {
+      return black;
+    }
+    wm.Normalize();
+    if (wm.z < 0.0f) {
+      wm = -wm;
+    }
+
+    // Back facing microfacets
+    float dotO = wo.Dot(wm);
+    float dotI = wi.Dot(wm);
+    if (dotO <= 0.0f || (reflect ? dotI <= 0.0f : dotI >= 0.0f)) {
+      return black;
+    }
+
+    float D = GGXDistribution(wm, alpha);
+    float lambdaO = GGXLambda(wo, alpha);
+    float G2 = 1.0f / (1.0f + lambdaO + GGXLambda(wi, alpha));
+    // Density of the visible normal wm
+    float visiblePdf = D * dotO / ((1.0f + lambdaO) * wo.z);
+
+    switch (Kind) {
+    case MaterialKind::Conductor: {
+      const MaterialTables &tables = MaterialTables::Get();
+      _pdf = visiblePdf / (4.0f * dotO);
+      DirectX::SimpleMath::Color fresnel =
+          Microfacet.ComplexIOR
+              ? tables.ConductorFresnel(dotO, Microfacet.ConductorEta, Microfacet.ConductorK)
+              : FresnelSchlick(Microfacet.F0, dotO);
+      // Energy lost by single scattering returns as a diffuse like lobe (Kulla-Conty)
+      float lost = (1.0f - tables.Albedo(wo.z, alpha)) * (1.0f - tables.Albedo(wi.z, alpha));
+      return Specular *
+             (fresnel * (D * G2 / (4.0f * wo.z * wi.z)) + Microfacet.Compensation * lost);
+    }
+    case MaterialKind::Plastic: {
+      // The base receives what the rough coating doesn't reflect
+      const MaterialTables &tables = MaterialTables::Get();
+      float coatingO = tables.CoatingAlbedo(wo.z, alpha, eta);
+      float coatingI = tables.CoatingAlbedo(wi.z, alpha, eta);
+      float specular = PlasticSpecularProbability(coatingO);
+      _pdf = specular * visiblePdf / (4.0f * dotO) + (1.0f - specular) * wi.z / XM_PI;
+      return Specular * (FresnelDielectric(dotO, eta) * D * G2 / (4.0f * wo.z * wi.z)) +
+             Diffuse * Microfacet.Compensation * ((1.0f - coatingO) * (1.0f - coatingI));
+    }
+    default: {
+      float fresnel = FresnelDielectric(dotO, eta);
+      if (reflect) {
+        _pdf = fresnel * visiblePdf / (4.0f * dotO);
+        return Specular * (fresnel * D * G2 / (4.0f * wo.z * wi.z));
+      }
+
+      // Generalized half vector of refraction, radiance is scaled by 1/eta^2
+      float denominator = dotI + dotO / eta;
+      denominator *= denominator;
+      _pdf = (1.0f - fresnel) * visiblePdf * std::abs(dotI) / denominator;
+      return Specular * ((1.0f - fresnel) * D * G2 * std::abs(dotI * dotO) /
+                         (wo.z * std::abs(wi.z) * denominator * eta * eta));
+    }
+    }
+  }
+
+  BRDFSample SampleMicrofacet(RandomEngine &_rnd) const {
+    std::uniform_real_distribution<float> dist(0, 1);
+    float u1 = dist(_rnd), u2 = dist(_rnd), u3 = dist(_rnd);
+    float alpha = Microfacet.Alpha, eta = Microfacet.Eta;
+
+    DirectX::SimpleMath::Vector3 wo = ToLocal(-View);
+    if (wo.z <= 0.0f) {
+      return {View, 0.0f, InteractionType::Specular};
+    }
+
+    DirectX::SimpleMath::Vector3 wi;
+    if (Kind == MaterialKind::Plastic &&
+        u3 >= PlasticSpecularProbability(MaterialTables::Get().CoatingAlbedo(wo.z, alpha, eta))) {
+      STAT_INC(DiffuseSamples);
+      float s, c;
+      SinCos2Pi(u2, s, c);
+      float r = std::sqrt(u1);
+      wi = DirectX::SimpleMath::Vector3(r * c, r * s, std::sqrt(std::max(0.0f, 1.0f - u1)));
+    } else {
+      STAT_INC(SpecularSamples);
+      DirectX::SimpleMath::Vector3 wm = SampleGGXVNDF(wo, alpha, u1, u2);
+      float dotO = wo.Dot(wm);
+
+      bool reflect = true;
+      if (Kind == MaterialKind::Dielectric) {
+        float fresnel = FresnelDielectric(dotO, eta);
+        // Reuse u3 for the lobe choice
+        reflect = u3 < fresnel;
+      }
+
+      if (reflect) {
+        wi = wm * (2.0f * dotO) - wo;
+      } else {
+        float sin2ThetaT = (1.0f - dotO * dotO) / (eta * eta);
+        float cosThetaT = std::sqrt(std::max(0.0f, 1.0f - sin2ThetaT));
+        wi = -wo / eta + wm * (dotO / eta - cosThetaT);
+      }
+    }
+
+    DirectX::SimpleMath::Vector3 out = FromLocal(wi);
+    out.Normalize();
+
+    float pdf;
+    EvaluateMicrofacet(View, out, pdf);
+    return {out, pdf * XM_PI, Type};
+  }
+
+  // Phong lobes around the mirror and refraction directions
+  void PrepareLobes(float _kd, float _ks, float _kt, float _roughness) {
+    float total = _kd + _ks + _kt;
+    Phong.Kd = _kd / total;
+    Phong.Ks = _ks / total;
+    Phong.Kt = _kt / total;
+    Phong.Roughness = _roughness;
+
+    const float ior = 1.5f;
+    float eta = Inside < 0 ? 1.0f / ior : ior;
+    Phong.Reflected = DirectX::SimpleMath::Vector3::Reflect(View, -Inside * Normal);
+    Phong.Refracted = DirectX::SimpleMath::Vector3::Refract(View, -Inside * Normal, eta);
+    if (Phong.Refracted.LengthSquared() < 0.5f) {
+      Phong.Refracted = Phong.Reflected;
+    }
+  }
+
+  float Lobe(DirectX::SimpleMath::Vector3 _center,
+             DirectX::SimpleMath::Vector3 _out) const {
+    float dot = std::abs(_center.Dot(_out));
+    if (Phong.Roughness == 0) {
+      return dot > 0.99 ? 1.0f : 0.0f;
+    }
+    return pow(dot, 1.0f / Phong.Roughness);
+  }
+
+  BRDFSample Sample(RandomEngine &_rnd) const {
+    std::uniform_real_distribution<float> dist(0, 1);
+
+    if (Passthrough > 0.0f && dist(_rnd) < Passthrough) {
+      STAT_INC(PassthroughSamples);
+      return {View, 1.0, InteractionType::Passthrough};
+    }
+
+    if (IsMicrofacet()) {
+      return SampleMicrofacet(_rnd);
+    }
+
+    switch (Kind) {
+    case MaterialKind::Specular: {
+      float u = dist(_rnd);
+      if (u < Phong.Kd) {
+        STAT_INC(DiffuseSamples);
+        auto sample = BRDFDiffuse(-Inside * Normal, View, _rnd);
+        sample.PDF *= Phong.Kd;
+        return sample;
+      }
+
+      STAT_INC(SpecularSamples);
+      bool reflect = u < Phong.Kd + Phong.Ks;
+      DirectX::SimpleMath::Vector3 center = reflect ? Phong.Reflected : Phong.Refracted;
+      float fac = reflect ? Phong.Ks : Phong.Kt;
+
+      DirectX::SimpleMath::Vector3 out = center;
+      if (Phong.Roughness != 0) {
+        float n = 1.0f / Phong.Roughness;
+        float u1 = dist(_rnd), u2 = dist(_rnd);
+        float theta = acosf(pow(u1, 1.0f / (n + 1)));
+        float phi = 2 * XM_PI * u2;
+        out = HemisphereSample(theta, phi, center);
+      }
+
+      return {out, Lobe(center, out) * fac, InteractionType::Specular};
+    }
+    case MaterialKind::Diffuse:
+      STAT_INC(DiffuseSamples);
+      return BRDFDiffuse(Normal, View, _rnd);
+    default:
+      return BRDFDiffuse(Normal, View, _rnd);
+    }
+  }
+
+  // Scattering factor for _out relative to View, see GetColor
+  float F(DirectX::SimpleMath::Vector3 _out) const {
+    switch (Kind) {
+    case MaterialKind::Specular: {
+      float gs = std::abs(_out.Dot(Normal));
+      return Phong.Kd +
+             (Lobe(Phong.Reflected, _out) * Phong.Ks + Lobe(Phong.Refracted, _out) * Phong.Kt) / gs;
+    }
+    case MaterialKind::Emission:
+      return std::abs(Normal.Dot(_out));
+    default:
+      return 1.0f;
+    }
+  }
+
+  DirectX::SimpleMath::Color GetColor(InteractionType _type) const {
+    switch (_type) {
+    case InteractionType::Diffuse:
+      return Diffuse;
+    case InteractionType::Passthrough:
+      return Passthrough > 0.0f ? Opacity : Specular;
+    default:
+      return Specular;
+    }
+  }
+
+  // Path weight of a sample, F * color * cos / pdf
+  DirectX::SimpleMath::Color Throughput(const BRDFSample &_sample) const {
+    if (IsMicrofacet() && _sample.Type != InteractionType::Passthrough) {
+      float pdf;
+      DirectX::SimpleMath::Color f = EvaluateMicrofacet(View, _sample.Direction, pdf);
+      if (pdf <= 0.0f) {
+        return DirectX::SimpleMath::Color(0.0f, 0.0f, 0.0f);
+      }
+      return f * (std::abs(_sample.Direction.Dot(Normal)) / pdf);
+    }
+    return F(_sample.Direction) * GetColor(_sample.Type) *
+           std::abs(_sample.Direction.Dot(Normal)) / _sample.PDF;
+  }
+
+  // BSDF for arbitrary directions, scaled by pi. _in points towards the
+  // surface, _out away from it. The Phong model can't be evaluated.
+  DirectX::SimpleMath::Color Evaluate(DirectX::SimpleMath::Vector3 _in,
+                                      DirectX::SimpleMath::Vector3 _out) const {
+    if (Type == InteractionType::Diffuse) {
+      STAT_INC(DiffuseEvaluations);
+    } else if (Type == InteractionType::Glossy) {
+      STAT_INC(GlossyEvaluations);
+    } else {
+      STAT_INC(SpecularEvaluations);
+    }
+
+    if (IsMicrofacet()) {
+      float pdf;
+      return EvaluateMicrofacet(_in, _out, pdf) * (XM_PI * (1.0f - Passthrough));
+    }
+    if (Kind != MaterialKind::Diffuse ||
+        _in.Dot(Normal) * _out.Dot(Normal) >= 0) {
+      return DirectX::SimpleMath::Color(0.0f, 0.0f, 0.0f);
+    }
+    return Diffuse * (1.0f - Passthrough);
+  }
+
+  // Solid angle density of Sample returning _out, scaled by pi like
+  // BRDFSample::PDF
+  float Pdf(DirectX::SimpleMath::Vector3 _in,
+            DirectX::SimpleMath::Vector3 _out) const {
+    if (IsMicrofacet()) {
+      float pdf;
+      EvaluateMicrofacet(_in, _out, pdf);
+      return pdf * XM_PI * (1.0f - Passthrough);
+    }
+    if (Kind != MaterialKind::Diffuse ||
+        _in.Dot(Normal) * _out.Dot(Normal) >= 0) {
+      return 0.0f;
+    }
+    return std::abs(_out.Dot(Normal)) * (1.0f - Passthrough);
+  }
+};
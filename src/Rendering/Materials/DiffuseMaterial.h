@@ -5,22 +5,14 @@
 struct DiffuseMaterial : public Material {
 
   std::shared_ptr<Texture> DiffuseColor;
-  DiffuseMaterial(std::shared_ptr<Texture> _color) : DiffuseColor(_color){
-    type = InteractionType::Diffuse;
-  };
+  DiffuseMaterial(std::shared_ptr<Texture> _color)
+      : Material(MaterialKind::Diffuse, InteractionType::Diffuse), DiffuseColor(_color) {};
 
-  virtual float F(DirectX::SimpleMath::Vector3 _in, DirectX::SimpleMath::Vector3 _out, DirectX::SimpleMath::Vector3 _normal) const {
-    return 1.0f;
-  }
-
-  inline virtual BRDFSample
-  Sample(const Intersection &_intersect, DirectX::SimpleMath::Vector3 _view,
-         std::default_random_engine &_rnd) const override {
-    return BRDFDiffuse(_intersect.normal, _view, _rnd);
-  }
-
-  inline virtual Color GetColor(const Intersection &_intersect, InteractionType type) const override {
-    return DiffuseColor->Sample(_intersect.uv);
+  inline void Prepare(const Intersection &_intersect, BSDF &_bsdf) const {
+    _bsdf.Kind = MaterialKind::Diffuse;
+    _bsdf.Type = type;
+    _bsdf.Diffuse = DiffuseColor->Sample(_intersect.uv, _intersect.footprint);
+    _bsdf.Specular = _bsdf.Diffuse;
   }
 
   inline virtual DiffuseMaterial *Copy() { return new DiffuseMaterial(*this); };
@@ -6,22 +6,16 @@ struct EmissionMaterial : public Material {
   std::shared_ptr<Texture> Emittance;
   float strength;
 
-  EmissionMaterial(std::shared_ptr<Texture> _color, float strength) : Emittance(_color), strength(strength) {};
+  EmissionMaterial(std::shared_ptr<Texture> _color, float strength)
+      : Material(MaterialKind::Emission, InteractionType::Diffuse), Emittance(_color),
+        strength(strength) {};
 
-  virtual float F(DirectX::SimpleMath::Vector3 _in, DirectX::SimpleMath::Vector3 _out, DirectX::SimpleMath::Vector3 _normal) const {
-	return std::abs((_normal).Dot(_out));
-  }
-
-  virtual BRDFSample
-  Sample(const Intersection &_intersect, DirectX::SimpleMath::Vector3 _view,
-         std::default_random_engine &_rnd) const override {
-    return BRDFDiffuse(_intersect.normal, _view, _rnd);
-  }
-
-  virtual bool IsLight() const override { return true; }
-
-  virtual Color GetColor(const Intersection &_intersect, InteractionType type) const override {
-    return Emittance->Sample(_intersect.uv) * strength;
+  inline void Prepare(const Intersection &_intersect, BSDF &_bsdf) const {
+    _bsdf.Kind = MaterialKind::Emission;
+    _bsdf.Type = type;
+    _bsdf.Emission = Emittance->Sample(_intersect.uv, _intersect.footprint) * strength;
+    _bsdf.Diffuse = _bsdf.Emission;
+    _bsdf.Specular = _bsdf.Emission;
   }
 
   virtual EmissionMaterial *Copy() {
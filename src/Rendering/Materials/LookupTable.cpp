@@ -0,0 +1,61 @@
+#include "LookupTable.h"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <xmmintrin.h>
+
+LookupTable::LookupTable(int x, int y, int z)
+    : m_Size{x, y, z}, m_Data(size_t(x) * y * z, 0.0f) {}
+
+// Node index and interpolation weight along one dimension
+static inline int Locate(float coordinate, int size, float &t) {
+  if (size < 2) {
+    t = 0.0f;
+    return 0;
+  }
+  float f = std::max(0.0f, std::min(1.0f, coordinate)) * (size - 1);
+  int i = std::min(int(f), size - 2);
+  t = f - i;
+  return i;
+}
+
+float LookupTable::Lookup(float x, float y, float z) const {
+  float tx, ty, tz;
+  int ix = Locate(x, m_Size[0], tx);
+  int iy = Locate(y, m_Size[1], ty);
+  int iz = Locate(z, m_Size[2], tz);
+
+  // Strides to the next node, 0 along unused dimensions
+  const int dx = m_Size[0] > 1 ? 1 : 0;
+  const int dy = m_Size[1] > 1 ? m_Size[0] : 0;
+  const int dz = m_Size[2] > 1 ? m_Size[0] * m_Size[1] : 0;
+
+  const float *p = m_Data.data() + ix + m_Size[0] * (iy + m_Size[1] * iz);
+
+  // Interpolate along z for the four xy corners at once, then weight them
+  __m128 low = _mm_setr_ps(p[0], p[dx], p[dy], p[dx + dy]);
+  __m128 high = _mm_setr_ps(p[dz], p[dz + dx], p[dz + dy], p[dz + dx + dy]);
+  __m128 v = _mm_add_ps(low, _mm_mul_ps(_mm_sub_ps(high, low), _mm_set1_ps(tz)));
+
+  __m128 wx = _mm_setr_ps(1.0f - tx, tx, 1.0f - tx, tx);
+  __m128 wy = _mm_setr_ps(1.0f - ty, 1.0f - ty, ty, ty);
+  v = _mm_mul_ps(v, _mm_mul_ps(wx, wy));
+
+  __m128 sum = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum);
+}
+
+void LookupTable::Write(std::ostream &out) const {
+  out.write((const char *)m_Size, sizeof(m_Size));
+  out.write((const char *)m_Data.data(), m_Data.size() * sizeof(float));
+}
+
+bool LookupTable::Read(std::istream &in) {
+  int size[3];
+  if (!in.read((char *)size, sizeof(size)) || size[0] != m_Size[0] ||
+      size[1] != m_Size[1] || size[2] != m_Size[2]) {
+    return false;
+  }
+  return bool(in.read((char *)m_Data.data(), m_Data.size() * sizeof(float)));
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <iosfwd>
+#include <vector>
+
+/********************************************
+** LookupTable
+** Up to three dimensional table of floats over
+** the unit cube, sampled with SSE trilinear
+** interpolation. Unused dimensions have size 1.
+*********************************************/
+
+class LookupTable {
+  int m_Size[3];
+  std::vector<float> m_Data;
+
+public:
+  LookupTable() : m_Size{0, 0, 0} {}
+  LookupTable(int x, int y = 1, int z = 1);
+
+  int Size(int dimension) const { return m_Size[dimension]; }
+
+  // Coordinate of a node along a dimension in [0, 1]
+  float Coordinate(int dimension, int index) const {
+    return m_Size[dimension] > 1 ? float(index) / (m_Size[dimension] - 1) : 0.0f;
+  }
+
+  float &At(int x, int y = 0, int z = 0) {
+    return m_Data[x + m_Size[0] * (y + m_Size[1] * z)];
+  }
+
+  float At(int x, int y = 0, int z = 0) const {
+    return m_Data[x + m_Size[0] * (y + m_Size[1] * z)];
+  }
+
+  // Coordinates are clamped to [0, 1]
+  float Lookup(float x, float y = 0.0f, float z = 0.0f) const;
+
+  void Write(std::ostream &out) const;
+  bool Read(std::istream &in);
+};
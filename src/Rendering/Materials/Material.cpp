@@ -0,0 +1,37 @@
+#include "Material.h"
+#include "DiffuseMaterial.h"
+#include "SpecularMaterial.h"
+#include "EmissionMaterial.h"
+#include "TransparentMaterial.h"
+#include "MicrofacetMaterial.h"
+#include "../../Geometry/Intersection.h"
+
+using namespace DirectX::SimpleMath;
+
+BSDF Material::Evaluate(const Intersection &_intersect, Vector3 _view) const {
+  BSDF bsdf(_intersect.normal, _view);
+  Prepare(_intersect, bsdf);
+  return bsdf;
+}
+
+void Material::Prepare(const Intersection &_intersect, BSDF &_bsdf) const {
+  switch (kind) {
+  case MaterialKind::Diffuse:
+    static_cast<const DiffuseMaterial *>(this)->Prepare(_intersect, _bsdf);
+    break;
+  case MaterialKind::Specular:
+    static_cast<const SpecularMaterial *>(this)->Prepare(_intersect, _bsdf);
+    break;
+  case MaterialKind::Emission:
+    static_cast<const EmissionMaterial *>(this)->Prepare(_intersect, _bsdf);
+    break;
+  case MaterialKind::Transparent:
+    static_cast<const TransparentMaterial *>(this)->Prepare(_intersect, _bsdf);
+    break;
+  case MaterialKind::Conductor:
+  case MaterialKind::Dielectric:
+  case MaterialKind::Plastic:
+    static_cast<const MicrofacetMaterial *>(this)->Prepare(_intersect, _bsdf);
+    break;
+  }
+}
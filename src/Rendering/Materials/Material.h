@@ -2,25 +2,34 @@
 #include <memory>
 #include "../../SimpleMath.h"
 #include "../BRDFs.h"
+#include "../Statistics.h"
+#include "BSDF.h"
 
 struct Intersection;
 
+/********************************************
+** Material
+** Scene side description of a surface. The
+** shading code lives in the BSDF closure,
+** materials only fill it in, selected by
+** their kind tag.
+*********************************************/
+
 struct Material {
+  MaterialKind kind;
   InteractionType type;
 
-  virtual float Material::F(DirectX::SimpleMath::Vector3 _in, DirectX::SimpleMath::Vector3 _out, DirectX::SimpleMath::Vector3 _normal) const {
-    return 1.0f;
-  }
-
-  virtual BRDFSample
-  Material::Sample(const Intersection &_intersect,
-                   DirectX::SimpleMath::Vector3 _view,
-                   std::default_random_engine &_rnd) const {
-    return BRDFSample();
-  }
-  virtual bool Material::IsLight() const { return false; }
-  virtual DirectX::SimpleMath::Color GetColor(const Intersection &_intersect, InteractionType type) const {
-    return Color(0.0f, 0.0f, 0.0f);
-  }
-  virtual Material *Copy() { return new Material(*this); };
-};
\ No newline at end of file
+  Material(MaterialKind _kind, InteractionType _type) : kind(_kind), type(_type) {}
+  virtual ~Material() {}
+
+  // Shading closure for a hit, _view being the incoming ray direction
+  BSDF Evaluate(const Intersection &_intersect,
+                DirectX::SimpleMath::Vector3 _view = DirectX::SimpleMath::Vector3(0, 0, 0)) const;
+
+  // Adds the surface to a closure, dispatched on kind
+  void Prepare(const Intersection &_intersect, BSDF &_bsdf) const;
+
+  bool IsLight() const { return kind == MaterialKind::Emission; }
+
+  virtual Material *Copy() = 0;
+};
@@ -0,0 +1,193 @@
+#include "MaterialTables.h"
+#include "BSDF.h"
+#include <chrono>
+#include <complex>
+#include <fstream>
+#include <iostream>
+
+using namespace DirectX::SimpleMath;
+
+// Relative to the working directory
+#define TABLES_FILE "material_tables.bin"
+#define TABLES_VERSION 1
+#define TABLE_SIZE 32
+// Stratified directions per table entry, squared
+#define TABLE_STRATA 32
+
+// Parameter ranges mapped to [0, 1]
+#define MAX_CONDUCTOR_ETA 4.0f
+#define MAX_CONDUCTOR_K 10.0f
+#define MIN_COATING_ETA 1.0f
+#define MAX_COATING_ETA 3.0f
+
+static float CoatingCoordinate(float eta) {
+  return (eta - MIN_COATING_ETA) / (MAX_COATING_ETA - MIN_COATING_ETA);
+}
+
+// Unpolarized Fresnel reflectance of a conductor with complex index eta + ik
+static float FresnelComplex(float cosThetaI, float eta, float k) {
+  using complex = std::complex<float>;
+  cosThetaI = std::max(0.0f, std::min(1.0f, cosThetaI));
+  complex n(eta, k);
+  complex sin2ThetaT = (1.0f - cosThetaI * cosThetaI) / (n * n);
+  complex cosThetaT = std::sqrt(1.0f - sin2ThetaT);
+
+  complex parallel = (n * cosThetaI - cosThetaT) / (n * cosThetaI + cosThetaT);
+  complex perpendicular = (cosThetaI - n * cosThetaT) / (cosThetaI + n * cosThetaT);
+  return 0.5f * (std::norm(parallel) + std::norm(perpendicular));
+}
+
+// Reflected energy of GGX for one direction, weighted by the Fresnel term
+// of the dielectric eta, or 1 when eta is 0. Stratified visible normals.
+static float IntegrateAlbedo(float cosTheta, float alpha, float eta) {
+  cosTheta = std::max(cosTheta, 1e-3f);
+  alpha = std::max(alpha, MIN_ALPHA);
+  Vector3 wo(std::sqrt(1.0f - cosTheta * cosTheta), 0.0f, cosTheta);
+  float lambdaO = GGXLambda(wo, alpha);
+
+  double sum = 0.0;
+  for (int i = 0; i < TABLE_STRATA; i++) {
+    for (int j = 0; j < TABLE_STRATA; j++) {
+      Vector3 wm = SampleGGXVNDF(wo, alpha, (i + 0.5f) / TABLE_STRATA,
+                                 (j + 0.5f) / TABLE_STRATA);
+      float dotO = wo.Dot(wm);
+      Vector3 wi = wm * (2.0f * dotO) - wo;
+      if (wi.z <= 0.0f) {
+        continue;
+      }
+      // f cos / pdf of visible normal sampling is F G2 / G1
+      float weight = (1.0f + lambdaO) / (1.0f + lambdaO + GGXLambda(wi, alpha));
+      sum += eta > 0.0f ? weight * FresnelDielectric(dotO, eta) : weight;
+    }
+  }
+  return float(sum / (TABLE_STRATA * TABLE_STRATA));
+}
+
+// 2 * integral of f(mu) mu over [0, 1] from the nodes along x of a table
+static float CosineAverage(const LookupTable &table, int y, int z) {
+  int n = table.Size(0);
+  float sum = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float weight = i == 0 || i == n - 1 ? 0.5f : 1.0f;
+    sum += weight * table.At(i, y, z) * table.Coordinate(0, i);
+  }
+  return 2.0f * sum / (n - 1);
+}
+
+MaterialTables::MaterialTables()
+    : m_Albedo(TABLE_SIZE, TABLE_SIZE), m_AverageAlbedo(TABLE_SIZE),
+      m_Fresnel(TABLE_SIZE, TABLE_SIZE, TABLE_SIZE), m_AverageFresnel(TABLE_SIZE, TABLE_SIZE),
+      m_Coating(TABLE_SIZE, TABLE_SIZE, TABLE_SIZE), m_AverageCoating(TABLE_SIZE, TABLE_SIZE) {}
+
+const MaterialTables &MaterialTables::Get() {
+  static MaterialTables tables = [] {
+    MaterialTables t;
+    if (!t.Load(TABLES_FILE)) {
+      std::cout << "Precomputing material tables" << std::endl;
+      auto start = std::chrono::high_resolution_clock::now();
+      t.Compute();
+      auto end = std::chrono::high_resolution_clock::now();
+      std::cout << "Material tables took "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
+                << "ms" << std::endl;
+      if (!t.Save(TABLES_FILE)) {
+        std::cout << "Could not write " << TABLES_FILE << std::endl;
+      }
+    }
+    return t;
+  }();
+  return tables;
+}
+
+void MaterialTables::Compute() {
+  const int n = TABLE_SIZE;
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int y = 0; y < n; y++) {
+    for (int x = 0; x < n; x++) {
+      m_Albedo.At(x, y) = IntegrateAlbedo(m_Albedo.Coordinate(0, x), m_Albedo.Coordinate(1, y), 0.0f);
+    }
+  }
+  for (int y = 0; y < n; y++) {
+    m_AverageAlbedo.At(y) = CosineAverage(m_Albedo, y, 0);
+  }
+
+#pragma omp parallel for schedule(static)
+  for (int z = 0; z < n; z++) {
+    float k = m_Fresnel.Coordinate(2, z) * MAX_CONDUCTOR_K;
+    for (int y = 0; y < n; y++) {
+      float eta = m_Fresnel.Coordinate(1, y) * MAX_CONDUCTOR_ETA;
+      for (int x = 0; x < n; x++) {
+        m_Fresnel.At(x, y, z) = FresnelComplex(m_Fresnel.Coordinate(0, x), eta, k);
+      }
+      m_AverageFresnel.At(y, z) = CosineAverage(m_Fresnel, y, z);
+    }
+  }
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int z = 0; z < n; z++) {
+    float eta = MIN_COATING_ETA + m_Coating.Coordinate(2, z) * (MAX_COATING_ETA - MIN_COATING_ETA);
+    for (int y = 0; y < n; y++) {
+      for (int x = 0; x < n; x++) {
+        m_Coating.At(x, y, z) =
+            IntegrateAlbedo(m_Coating.Coordinate(0, x), m_Coating.Coordinate(1, y), eta);
+      }
+      m_AverageCoating.At(y, z) = CosineAverage(m_Coating, y, z);
+    }
+  }
+}
+
+bool MaterialTables::Load(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  int version, size;
+  if (!in.read((char *)&version, sizeof(version)) || !in.read((char *)&size, sizeof(size)) ||
+      version != TABLES_VERSION || size != TABLE_SIZE) {
+    return false;
+  }
+  return m_Albedo.Read(in) && m_AverageAlbedo.Read(in) && m_Fresnel.Read(in) &&
+         m_AverageFresnel.Read(in) && m_Coating.Read(in) && m_AverageCoating.Read(in);
+}
+
+bool MaterialTables::Save(const std::string &path) const {
+  std::ofstream out(path, std::ios::binary);
+  int version = TABLES_VERSION, size = TABLE_SIZE;
+  out.write((const char *)&version, sizeof(version));
+  out.write((const char *)&size, sizeof(size));
+  m_Albedo.Write(out);
+  m_AverageAlbedo.Write(out);
+  m_Fresnel.Write(out);
+  m_AverageFresnel.Write(out);
+  m_Coating.Write(out);
+  m_AverageCoating.Write(out);
+  return bool(out);
+}
+
+float MaterialTables::Albedo(float _cosTheta, float _alpha) const {
+  return m_Albedo.Lookup(_cosTheta, _alpha);
+}
+
+float MaterialTables::AverageAlbedo(float _alpha) const {
+  return m_AverageAlbedo.Lookup(_alpha);
+}
+
+Color MaterialTables::ConductorFresnel(float _cosTheta, Color _eta, Color _k) const {
+  auto lookup = [&](float eta, float k) {
+    return m_Fresnel.Lookup(_cosTheta, eta / MAX_CONDUCTOR_ETA, k / MAX_CONDUCTOR_K);
+  };
+  return Color(lookup(_eta.R(), _k.R()), lookup(_eta.G(), _k.G()), lookup(_eta.B(), _k.B()));
+}
+
+Color MaterialTables::AverageConductorFresnel(Color _eta, Color _k) const {
+  auto lookup = [&](float eta, float k) {
+    return m_AverageFresnel.Lookup(eta / MAX_CONDUCTOR_ETA, k / MAX_CONDUCTOR_K);
+  };
+  return Color(lookup(_eta.R(), _k.R()), lookup(_eta.G(), _k.G()), lookup(_eta.B(), _k.B()));
+}
+
+float MaterialTables::CoatingAlbedo(float _cosTheta, float _alpha, float _eta) const {
+  return m_Coating.Lookup(_cosTheta, _alpha, CoatingCoordinate(_eta));
+}
+
+float MaterialTables::AverageCoatingAlbedo(float _alpha, float _eta) const {
+  return m_AverageCoating.Lookup(_alpha, CoatingCoordinate(_eta));
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include "LookupTable.h"
+#include <string>
+
+/********************************************
+** MaterialTables
+** Directional albedo and Fresnel integrals of
+** the microfacet models, too expensive to
+** integrate per hit. Computed on first use and
+** cached in the working directory.
+*********************************************/
+
+class MaterialTables {
+  // GGX albedo with F = 1 over (cos theta, alpha) and its cosine weighted
+  // average over alpha, for multiple scattering compensation
+  LookupTable m_Albedo, m_AverageAlbedo;
+  // Conductor Fresnel over (cos theta, eta, k) and its cosine weighted average
+  LookupTable m_Fresnel, m_AverageFresnel;
+  // Albedo of a GGX dielectric coating over (cos theta, alpha, eta) and its
+  // average, the energy left for the base of plastic
+  LookupTable m_Coating, m_AverageCoating;
+
+  MaterialTables();
+
+  void Compute();
+  bool Load(const std::string &path);
+  bool Save(const std::string &path) const;
+
+public:
+  static const MaterialTables &Get();
+
+  float Albedo(float _cosTheta, float _alpha) const;
+  float AverageAlbedo(float _alpha) const;
+
+  DirectX::SimpleMath::Color ConductorFresnel(float _cosTheta, DirectX::SimpleMath::Color _eta,
+                                              DirectX::SimpleMath::Color _k) const;
+  DirectX::SimpleMath::Color AverageConductorFresnel(DirectX::SimpleMath::Color _eta,
+                                                     DirectX::SimpleMath::Color _k) const;
+
+  float CoatingAlbedo(float _cosTheta, float _alpha, float _eta) const;
+  float AverageCoatingAlbedo(float _alpha, float _eta) const;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include "Material.h"
+#include "MaterialTables.h"
+#include "../Textures/Texture.h"
+
+/********************************************
+** MicrofacetMaterial
+** GGX conductor, dielectric and plastic with
+** visible normal sampling. Tint is the
+** specular reflectance of conductors and
+** dielectrics and the diffuse base of plastic.
+*********************************************/
+
+struct MicrofacetMaterial : public Material {
+  std::shared_ptr<Texture> Tint;
+  float Alpha;
+  // Interior over exterior index of refraction
+  float IOR;
+  // Conductor reflectance at normal incidence, or the complex index of
+  // refraction when ComplexIOR is set
+  Color F0;
+  Color ConductorEta, ConductorK;
+  bool ComplexIOR;
+  // Energy compensation looked up from MaterialTables, see BSDF
+  Color Compensation;
+
+  MicrofacetMaterial(MaterialKind _kind, std::shared_ptr<Texture> _tint, float _alpha,
+                     float _ior, Color _f0 = Color(1.0f, 1.0f, 1.0f))
+      : Material(_kind, LobeType(_kind, _alpha)), Tint(_tint), Alpha(_alpha),
+        IOR(_ior), F0(_f0), ComplexIOR(false) {
+    PrepareCompensation();
+  };
+
+  // Conductor with a measured complex index of refraction
+  MicrofacetMaterial(std::shared_ptr<Texture> _tint, float _alpha, Color _eta, Color _k)
+      : Material(MaterialKind::Conductor, LobeType(MaterialKind::Conductor, _alpha)), Tint(_tint),
+        Alpha(_alpha), IOR(1.0f), ConductorEta(_eta), ConductorK(_k), ComplexIOR(true) {
+    PrepareCompensation();
+  };
+
+  // The Lambertian base of plastic is never delta like
+  static InteractionType LobeType(MaterialKind _kind, float _alpha) {
+    return _kind == MaterialKind::Plastic || _alpha >= GLOSSY_ALPHA ? InteractionType::Glossy
+                                                                     : InteractionType::Specular;
+  }
+
+  void PrepareCompensation() {
+    const MaterialTables &tables = MaterialTables::Get();
+    float alpha = std::max(Alpha, MIN_ALPHA);
+    Compensation = Color(0.0f, 0.0f, 0.0f);
+
+    if (kind == MaterialKind::Conductor) {
+      float average = tables.AverageAlbedo(alpha);
+      if (average < 0.9999f) {
+        Color fresnel = ComplexIOR ? tables.AverageConductorFresnel(ConductorEta, ConductorK)
+                                   : F0 + (Color(1.0f, 1.0f, 1.0f) - F0) * (1.0f / 21.0f);
+        // Fresnel tinted sum of all bounces after the first
+        auto bounces = [average](float f) {
+          return f * f * average / ((1.0f - f * (1.0f - average)) * XM_PI * (1.0f - average));
+        };
+        Compensation = Color(bounces(fresnel.R()), bounces(fresnel.G()), bounces(fresnel.B()));
+      }
+    } else if (kind == MaterialKind::Plastic) {
+      float coating = tables.AverageCoatingAlbedo(alpha, IOR);
+      Compensation = Color(1.0f, 1.0f, 1.0f) * (1.0f / (XM_PI * (1.0f - coating)));
+    }
+  }
+
+  inline void Prepare(const Intersection &_intersect, BSDF &_bsdf) const {
+    _bsdf.Kind = kind;
+    _bsdf.Type = type;
+
+    _bsdf.Diffuse = Tint->Sample(_intersect.uv, _intersect.footprint);
+    _bsdf.Specular = kind == MaterialKind::Plastic ? Color(1.0f, 1.0f, 1.0f) : _bsdf.Diffuse;
+
+    // Only dielectrics have an inside, the others are two sided
+    float eta = kind == MaterialKind::Dielectric && _bsdf.Inside > 0 ? 1.0f / IOR : IOR;
+    _bsdf.PrepareMicrofacet(Alpha, eta);
+    if (ComplexIOR) {
+      _bsdf.Microfacet.ConductorEta = ConductorEta;
+      _bsdf.Microfacet.ConductorK = ConductorK;
+    } else {
+      _bsdf.Microfacet.F0 = F0;
+    }
+    _bsdf.Microfacet.ComplexIOR = ComplexIOR;
+    _bsdf.Microfacet.Compensation = Compensation;
+  }
+
+  virtual MicrofacetMaterial *Copy() {
+    return new MicrofacetMaterial(*this);
+  };
+};
@@ -7,37 +7,18 @@ struct TransparentMaterial : public Material {
   std::shared_ptr<Texture> Opacity;
   Material* ChildMat;
 
-  TransparentMaterial(std::shared_ptr<Texture> _opacity, Material* _childMat) : Opacity(_opacity), ChildMat(_childMat) {
-    type = ChildMat->type;
-  };
-
-  virtual float F(DirectX::SimpleMath::Vector3 _in, DirectX::SimpleMath::Vector3 _out, DirectX::SimpleMath::Vector3 _normal) const {
-    return ChildMat->F(_in, _out, _normal);
-  }
-
-  inline virtual BRDFSample
-  Sample(const Intersection &_intersect, DirectX::SimpleMath::Vector3 _view,
-         std::default_random_engine &_rnd) const override {
-    auto opacity = Opacity->Sample(_intersect.uv);
-
-    auto prob = opacity.R() + opacity.G() + opacity.B();
-
-    prob *= 1.0f / 3.0f;
-
-    std::uniform_real_distribution<float> dist(0, 1);
-
-    auto fac = dist(_rnd);
-
-    if (fac < prob) {
-        return{ _view, 1.0, InteractionType::Passthrough };
-    } else {
-        return ChildMat->Sample(_intersect, _view, _rnd);
+  TransparentMaterial(std::shared_ptr<Texture> _opacity, Material* _childMat)
+      : Material(MaterialKind::Transparent, _childMat->type), Opacity(_opacity), ChildMat(_childMat) {};
+
+  // The child fills the closure, only its non passthrough part is evaluated.
+  // Hits kept by the alpha filter of Embree are opaque.
+  inline void Prepare(const Intersection &_intersect, BSDF &_bsdf) const {
+    ChildMat->Prepare(_intersect, _bsdf);
+    if (_intersect.alphaTested) {
+      return;
     }
-
-  }
-
-	virtual DirectX::SimpleMath::Color GetColor(const Intersection &_intersect, InteractionType type) const override {
-    return type == InteractionType::Passthrough ? Opacity->Sample(_intersect.uv) : ChildMat->GetColor(_intersect, type);
+    _bsdf.Opacity = Opacity->Sample(_intersect.uv, _intersect.footprint);
+    _bsdf.Passthrough = _bsdf.Opacity.ToVector3().Dot(Vector3(1.0f / 3.0f));
   }
 
   inline virtual TransparentMaterial *Copy() { return new TransparentMaterial(*this); };
@@ -0,0 +1,201 @@
+#include "Denoiser.h"
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX::SimpleMath;
+
+#define ALBEDO_EPSILON 0.01f
+
+Denoiser::Denoiser(int w, int h, int iterations, float sigmaLuminance,
+                   float sigmaDepth)
+    : m_Width(w), m_Height(h), m_Iterations(iterations),
+      m_SigmaLuminance(sigmaLuminance), m_SigmaDepth(sigmaDepth) {}
+
+// exp(x) for x <= 0, Cephes polynomial on x - n ln 2 scaled by 2^n
+static inline __m128 ExpNegative(__m128 x) {
+  x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+  // Truncating x / ln 2 - 0.5 rounds to nearest for x <= 0
+  __m128i n = _mm_cvttps_epi32(
+      _mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(0.5f)));
+  __m128 r = _mm_sub_ps(x, _mm_mul_ps(_mm_cvtepi32_ps(n), _mm_set1_ps(0.693147181f)));
+
+  __m128 p = _mm_set1_ps(1.9875691500e-4f);
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.3981999507e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+  p = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+
+  __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+  return _mm_mul_ps(p, scale);
+}
+
+// Four values of a plane, a single load when the indices are consecutive
+static inline __m128 Gather(const float *plane, const int *index, bool consecutive) {
+  return consecutive ? _mm_loadu_ps(plane + index[0])
+                     : _mm_setr_ps(plane[index[0]], plane[index[1]], plane[index[2]],
+                                   plane[index[3]]);
+}
+
+static inline __m128 Abs(__m128 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+static inline __m128 Luminance(__m128 r, __m128 g, __m128 b) {
+  return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.2126f), r),
+                               _mm_mul_ps(_mm_set1_ps(0.7152f), g)),
+                    _mm_mul_ps(_mm_set1_ps(0.0722f), b));
+}
+
+// Rows run in parallel, every tap is applied to four pixels of a row at a
+// time with SSE. Only the image borders need gathered loads.
+void Denoiser::Iterate(int step, const Planes &in, Planes &out) const {
+  const int w = m_Width, h = m_Height;
+  // Row buffers cover whole groups of four, the lanes past the row repeat
+  // its last pixel and are never written out
+  const int paddedWidth = (w + 3) & ~3;
+  const float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+
+#pragma omp parallel
+  {
+    std::vector<float> sumR(paddedWidth), sumG(paddedWidth), sumB(paddedWidth);
+    std::vector<float> sumVariance(paddedWidth), sumWeight(paddedWidth);
+    std::vector<float> sigma(paddedWidth);
+
+#pragma omp for schedule(static)
+    for (int y = 0; y < h; y++) {
+      const int row = y * w;
+
+      std::fill(sumR.begin(), sumR.end(), 0.0f);
+      std::fill(sumG.begin(), sumG.end(), 0.0f);
+      std::fill(sumB.begin(), sumB.end(), 0.0f);
+      std::fill(sumVariance.begin(), sumVariance.end(), 0.0f);
+      std::fill(sumWeight.begin(), sumWeight.end(), 0.0f);
+
+      for (int x = 0; x < paddedWidth; x++) {
+        float luminanceStd = std::sqrt(std::max(in.Variance[row + std::min(x, w - 1)], 0.0f));
+        sigma[x] = 1.0f / (m_SigmaLuminance * luminanceStd + 1e-4f);
+      }
+
+      for (int dy = -2; dy <= 2; dy++) {
+        int qy = std::max(0, std::min(h - 1, y + dy * step));
+        for (int dx = -2; dx <= 2; dx++) {
+          const __m128 h2 = _mm_set1_ps(kernel[std::abs(dx)] * kernel[std::abs(dy)]);
+          const int offset = dx * step;
+
+          for (int x = 0; x < w; x += 4) {
+            int p[4], q[4];
+            for (int i = 0; i < 4; i++) {
+              int px = std::min(x + i, w - 1);
+              p[i] = row + px;
+              q[i] = qy * w + std::max(0, std::min(w - 1, px + offset));
+            }
+            bool consecutiveP = x + 3 < w;
+            bool consecutiveQ = consecutiveP && x + offset >= 0 && x + 3 + offset < w;
+
+            // Normal weight, dot^128 by squaring. Misses have no normal and
+            // only blend with each other.
+            __m128 dot = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(Gather(m_NormalX.data(), p, consecutiveP),
+                                      Gather(m_NormalX.data(), q, consecutiveQ)),
+                           _mm_mul_ps(Gather(m_NormalY.data(), p, consecutiveP),
+                                      Gather(m_NormalY.data(), q, consecutiveQ))),
+                _mm_mul_ps(Gather(m_NormalZ.data(), p, consecutiveP),
+                           Gather(m_NormalZ.data(), q, consecutiveQ)));
+            dot = _mm_max_ps(dot, zero);
+            for (int i = 0; i < 7; i++) {
+              dot = _mm_mul_ps(dot, dot);
+            }
+            __m128 depthP = Gather(m_Depth.data(), p, consecutiveP);
+            __m128 depthQ = Gather(m_Depth.data(), q, consecutiveQ);
+            __m128 bothMissed =
+                _mm_and_ps(_mm_and_ps(_mm_cmple_ps(depthP, zero), _mm_cmple_ps(depthQ, zero)), one);
+            __m128 weightNormal = _mm_max_ps(dot, bothMissed);
+
+            // Depth and luminance weights share one exp
+            __m128 rQ = Gather(in.R.data(), q, consecutiveQ);
+            __m128 gQ = Gather(in.G.data(), q, consecutiveQ);
+            __m128 bQ = Gather(in.B.data(), q, consecutiveQ);
+            __m128 luminanceP = Luminance(Gather(in.R.data(), p, consecutiveP),
+                                          Gather(in.G.data(), p, consecutiveP),
+                                          Gather(in.B.data(), p, consecutiveP));
+            __m128 depthScale = _mm_add_ps(
+                _mm_mul_ps(_mm_set1_ps(m_SigmaDepth * step), depthP), _mm_set1_ps(1e-4f));
+            __m128 exponent = _mm_add_ps(
+                _mm_div_ps(Abs(_mm_sub_ps(depthP, depthQ)), depthScale),
+                _mm_mul_ps(Abs(_mm_sub_ps(luminanceP, Luminance(rQ, gQ, bQ))),
+                           _mm_loadu_ps(&sigma[x])));
+            __m128 weight = _mm_mul_ps(_mm_mul_ps(h2, weightNormal),
+                                       ExpNegative(_mm_sub_ps(zero, exponent)));
+
+            _mm_storeu_ps(&sumR[x], _mm_add_ps(_mm_loadu_ps(&sumR[x]), _mm_mul_ps(weight, rQ)));
+            _mm_storeu_ps(&sumG[x], _mm_add_ps(_mm_loadu_ps(&sumG[x]), _mm_mul_ps(weight, gQ)));
+            _mm_storeu_ps(&sumB[x], _mm_add_ps(_mm_loadu_ps(&sumB[x]), _mm_mul_ps(weight, bQ)));
+            __m128 varianceQ = Gather(in.Variance.data(), q, consecutiveQ);
+            _mm_storeu_ps(&sumVariance[x],
+                          _mm_add_ps(_mm_loadu_ps(&sumVariance[x]),
+                                     _mm_mul_ps(_mm_mul_ps(weight, weight), varianceQ)));
+            _mm_storeu_ps(&sumWeight[x], _mm_add_ps(_mm_loadu_ps(&sumWeight[x]), weight));
+          }
+        }
+      }
+
+      for (int x = 0; x < w; x++) {
+        // The center tap always has a positive weight
+        float inverse = 1.0f / sumWeight[x];
+        out.R[row + x] = sumR[x] * inverse;
+        out.G[row + x] = sumG[x] * inverse;
+        out.B[row + x] = sumB[x] * inverse;
+        out.Variance[row + x] = sumVariance[x] * inverse * inverse;
+      }
+    }
+  }
+}
+
+void Denoiser::Denoise(const Color *color, const Color *albedo, const Color *normal,
+                       const float *depth, const float *variance, Color *result) {
+  const int n = m_Width * m_Height;
+
+  m_NormalX.resize(n);
+  m_NormalY.resize(n);
+  m_NormalZ.resize(n);
+  m_Depth.assign(depth, depth + n);
+
+  Planes a(n), b(n);
+
+  // Demodulate the albedo, the variance is in luminance of the color
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++) {
+    Vector3 nrm(normal[i].x, normal[i].y, normal[i].z);
+    float length = nrm.Length();
+    nrm = length > 0.0f ? nrm / length : Vector3(0, 0, 0);
+    m_NormalX[i] = nrm.x;
+    m_NormalY[i] = nrm.y;
+    m_NormalZ[i] = nrm.z;
+
+    float ar = std::max(albedo[i].R(), ALBEDO_EPSILON);
+    float ag = std::max(albedo[i].G(), ALBEDO_EPSILON);
+    float ab = std::max(albedo[i].B(), ALBEDO_EPSILON);
+    a.R[i] = color[i].R() / ar;
+    a.G[i] = color[i].G() / ag;
+    a.B[i] = color[i].B() / ab;
+
+    float albedoLuminance = 0.2126f * ar + 0.7152f * ag + 0.0722f * ab;
+    a.Variance[i] = variance[i] / (albedoLuminance * albedoLuminance);
+  }
+
+  Planes *in = &a, *out = &b;
+  for (int i = 0; i < m_Iterations; i++) {
+    Iterate(1 << i, *in, *out);
+    std::swap(in, out);
+  }
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++) {
+    result[i] = Color(in->R[i] * std::max(albedo[i].R(), ALBEDO_EPSILON),
+                      in->G[i] * std::max(albedo[i].G(), ALBEDO_EPSILON),
+                      in->B[i] * std::max(albedo[i].B(), ALBEDO_EPSILON), color[i].A());
+  }
+}
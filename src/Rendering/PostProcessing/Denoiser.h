@@ -0,0 +1,42 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include <vector>
+
+/********************************************
+** Denoiser
+** Edge avoiding a-trous wavelet filter
+** (Dammertz et al. 2010) guided by first hit
+** normals and depth and by the per pixel
+** variance. Texture detail is kept by
+** filtering color divided by albedo.
+*********************************************/
+
+class Denoiser {
+  struct Planes {
+    std::vector<float> R, G, B, Variance;
+
+    explicit Planes(int n) : R(n), G(n), B(n), Variance(n) {}
+  };
+
+  int m_Width, m_Height;
+  int m_Iterations;
+
+  // Edge stopping: luminance in standard deviations, relative depth
+  float m_SigmaLuminance;
+  float m_SigmaDepth;
+
+  std::vector<float> m_NormalX, m_NormalY, m_NormalZ, m_Depth;
+
+  // One filter level with taps 'step' pixels apart
+  void Iterate(int step, const Planes &in, Planes &out) const;
+
+public:
+  Denoiser(int w, int h, int iterations = 5, float sigmaLuminance = 4.0f,
+           float sigmaDepth = 0.02f);
+
+  // variance is the variance of the pixel mean, misses have zero depth
+  void Denoise(const DirectX::SimpleMath::Color *color,
+               const DirectX::SimpleMath::Color *albedo,
+               const DirectX::SimpleMath::Color *normal, const float *depth,
+               const float *variance, DirectX::SimpleMath::Color *result);
+};
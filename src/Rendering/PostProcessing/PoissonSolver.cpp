@@ -0,0 +1,130 @@
+#include "PoissonSolver.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX::SimpleMath;
+
+static float Channel(const Color &c, int channel) {
+  return channel == 0 ? c.R() : (channel == 1 ? c.G() : c.B());
+}
+
+PoissonSolver::PoissonSolver(int w, int h, float alpha, int maxIterations,
+                             float tolerance)
+    : m_Width(w), m_Height(h), m_Alpha(alpha), m_MaxIterations(maxIterations),
+      m_Tolerance(tolerance) {}
+
+void PoissonSolver::Apply(const std::vector<float> &x,
+                          std::vector<float> &out) const {
+  const int w = m_Width, h = m_Height;
+  const float alpha2 = m_Alpha * m_Alpha;
+
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < h; y++) {
+    const float *row = x.data() + y * w;
+    float *outRow = out.data() + y * w;
+    for (int px = 0; px < w; px++) {
+      float center = row[px];
+      float v = alpha2 * center;
+      // Every existing difference contributes (x_p - x_q)
+      if (px > 0) v += center - row[px - 1];
+      if (px < w - 1) v += center - row[px + 1];
+      if (y > 0) v += center - row[px - w];
+      if (y < h - 1) v += center - row[px + w];
+      outRow[px] = v;
+    }
+  }
+}
+
+double PoissonSolver::Dot(const std::vector<float> &a,
+                          const std::vector<float> &b) const {
+  const int n = (int)a.size();
+  double sum = 0;
+#pragma omp parallel for reduction(+ : sum) schedule(static)
+  for (int i = 0; i < n; i++) {
+    sum += double(a[i]) * b[i];
+  }
+  return sum;
+}
+
+int PoissonSolver::SolveChannel(const Color *primal, const Color *dx,
+                                const Color *dy, int channel,
+                                std::vector<float> &x) const {
+  const int w = m_Width, h = m_Height, n = w * h;
+  const float alpha2 = m_Alpha * m_Alpha;
+
+  std::vector<float> b(n), r(n), p(n), Ap(n);
+
+  // b = a^2 P + L^T G, start from the primal image
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < h; y++) {
+    for (int px = 0; px < w; px++) {
+      int i = px + y * w;
+      float v = alpha2 * Channel(primal[i], channel);
+      if (px > 0) v += Channel(dx[i - 1], channel);
+      if (px < w - 1) v -= Channel(dx[i], channel);
+      if (y > 0) v += Channel(dy[i - w], channel);
+      if (y < h - 1) v -= Channel(dy[i], channel);
+      b[i] = v;
+      x[i] = Channel(primal[i], channel);
+    }
+  }
+
+  Apply(x, Ap);
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; i++) {
+    r[i] = b[i] - Ap[i];
+    p[i] = r[i];
+  }
+
+  double rr = Dot(r, r);
+  double threshold = m_Tolerance * m_Tolerance * std::max(Dot(b, b), 1e-20);
+
+  int iteration = 0;
+  for (; iteration < m_MaxIterations && rr > threshold; iteration++) {
+    Apply(p, Ap);
+    double pAp = Dot(p, Ap);
+    if (pAp <= 0) {
+      break;
+    }
+
+    float step = float(rr / pAp);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+      x[i] += step * p[i];
+      r[i] -= step * Ap[i];
+    }
+
+    double rrNew = Dot(r, r);
+    float beta = float(rrNew / rr);
+    rr = rrNew;
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < n; i++) {
+      p[i] = r[i] + beta * p[i];
+    }
+  }
+
+  return iteration;
+}
+
+void PoissonSolver::Solve(const Color *primal, const Color *dx, const Color *dy,
+                          Color *result) const {
+  const int n = m_Width * m_Height;
+  std::vector<float> x(n);
+
+  for (int channel = 0; channel < 3; channel++) {
+    SolveChannel(primal, dx, dy, channel, x);
+
+    for (int i = 0; i < n; i++) {
+      float v = std::max(0.0f, x[i]);
+      if (channel == 0) result[i].x = v;
+      if (channel == 1) result[i].y = v;
+      if (channel == 2) result[i].z = v;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    result[i].w = 1.0f;
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "../../SimpleMath.h"
+#include <vector>
+
+/********************************************
+** PoissonSolver
+** Reconstructs an image from a noisy primal
+** estimate and its forward differences by
+** solving the L2 screened Poisson problem
+**   min a^2 |I - P|^2 + |dI - G|^2
+** with matrix free conjugate gradients.
+*********************************************/
+
+class PoissonSolver {
+  int m_Width, m_Height;
+
+  // Weight of the primal image relative to the gradients
+  float m_Alpha;
+  int m_MaxIterations;
+  float m_Tolerance;
+
+  // (a^2 + L^T L) x, L being the forward difference operator
+  void Apply(const std::vector<float> &x, std::vector<float> &out) const;
+
+  double Dot(const std::vector<float> &a, const std::vector<float> &b) const;
+
+  int SolveChannel(const DirectX::SimpleMath::Color *primal,
+                   const DirectX::SimpleMath::Color *dx,
+                   const DirectX::SimpleMath::Color *dy, int channel,
+                   std::vector<float> &x) const;
+
+public:
+  PoissonSolver(int w, int h, float alpha = 0.2f, int maxIterations = 200,
+                float tolerance = 1e-4f);
+
+  // dx(x, y) ~ I(x + 1, y) - I(x, y), dy(x, y) ~ I(x, y + 1) - I(x, y)
+  void Solve(const DirectX::SimpleMath::Color *primal,
+             const DirectX::SimpleMath::Color *dx,
+             const DirectX::SimpleMath::Color *dy,
+             DirectX::SimpleMath::Color *result) const;
+};
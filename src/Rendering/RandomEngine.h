@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <random>
+
+/********************************************
+** PrimarySampleSource
+** Replaces the random numbers of a
+** RandomEngine, e.g. with the primary
+** sample vector of a Markov chain.
+*********************************************/
+
+class PrimarySampleSource {
+public:
+  // Next value in [0, 1)
+  virtual float Next() = 0;
+};
+
+/********************************************
+** RandomEngine
+** Random bit generator handed to all sampling
+** code. Forwards to std::default_random_engine
+** unless a PrimarySampleSource is attached.
+*********************************************/
+
+class RandomEngine {
+  std::default_random_engine m_Engine;
+  PrimarySampleSource *m_Source = nullptr;
+
+public:
+  typedef std::default_random_engine::result_type result_type;
+
+  RandomEngine() {}
+  explicit RandomEngine(result_type seed) : m_Engine(seed) {}
+
+  static constexpr result_type min() { return std::default_random_engine::min(); }
+  static constexpr result_type max() { return std::default_random_engine::max(); }
+
+  void SetSource(PrimarySampleSource *source) { m_Source = source; }
+
+  result_type operator()() {
+    if (!m_Source) {
+      return m_Engine();
+    }
+
+    // Same range as the engine so distributions consume the same number of
+    // values in both modes
+    double range = double(max()) - double(min()) + 1.0;
+    double value = double(min()) + double(m_Source->Next()) * range;
+    return value >= double(max()) ? max() : result_type(value);
+  }
+};
@@ -8,9 +8,21 @@
 #include <iostream>
 #include "../IO/SceneLoader.h"
 #include "../IO/pfm.h"
+#include "../IO/ExrWriter.h"
+#include "Statistics.h"
+#include <chrono>
+#include "Materials/Material.h"
+#ifdef DENOISE
+#include "PostProcessing/Denoiser.h"
+#endif
+#include "../Geometry/Intersection.h"
 
 using namespace DirectX::SimpleMath;
 
+static float Luminance(const Color &c) {
+  return 0.2126f * c.R() + 0.7152f * c.G() + 0.0722f * c.B();
+}
+
 Raytracer::Raytracer(void) {}
 
 bool Raytracer::Initialize(int _width, int _height, std::string _integrator,
@@ -35,6 +47,11 @@ bool Raytracer::Initialize(int _width, int _height, std::string _integrator,
 
   m_RawPixels = new Color[m_Width * m_Height * 4]{};
 
+  m_Albedo.resize(m_Width * m_Height);
+  m_Normals.resize(m_Width * m_Height);
+  m_Depth.resize(m_Width * m_Height);
+  m_VarianceM2.resize(m_Width * m_Height);
+
   std::cout << "Loading scene..." << std::endl;
   Camera *cam = nullptr;
   std::vector<BaseObject *> objects;
@@ -48,21 +65,35 @@ bool Raytracer::Initialize(int _width, int _height, std::string _integrator,
   m_pScene = std::make_unique<Scene>(m_pCamera.get(), objects);
   m_pIntegrator.reset(IntegratorFactory(_integrator, m_pScene.get(), m_pCamera.get(), m_Width, m_Height));
 
+  // Only tiled renders in a window get a preview pass, everything else
+  // skips the irradiance cache
+  m_pPreviewIntegrator.reset();
+#if !defined(HEADLESS) && defined(MULTI_THREADED)
+  if (!m_pIntegrator->IsProgressive()) {
+    m_pPreviewIntegrator.reset(
+        IntegratorFactory("IC", m_pScene.get(), m_pCamera.get(), m_Width, m_Height));
+  }
+#endif
+
   return true;
 }
 
-void Raytracer::Wait() {
-  for (int i = 0; i < m_ThreadCount; i++) {
-    m_Threads[i].join();
+void Raytracer::JoinThreads() {
+  for (auto &thread : m_Threads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
   }
-
-  m_IsShutDown = true;
+  m_Threads.clear();
 }
 
+void Raytracer::Wait() { JoinThreads(); }
+
 void Raytracer::Shutdown(void) {
   if (!m_IsShutDown) {
     m_IsShutDown = true;
     Wait();
+    FlushImages();
   }
 
 #ifndef HEADLESS
@@ -80,24 +111,98 @@ void Raytracer::Shutdown(void) {
 
 void Raytracer::SetFOV(float _fov) { m_FOV = _fov; }
 
-void Raytracer::RenderPart(int _x, int _y, int _width, int _height, int _spp) {
+void Raytracer::RecordFeatures(float _x, float _y, int _sampleIndex,
+                               RandomEngine &_rnd) {
+  Ray ray;
+  Intersection hit;
+  bool found;
+
+  const Scene::PrimaryHit &primary = Scene::TakePrimaryHit();
+  if (primary.Recorded) {
+    ray = primary.CameraRay;
+    hit = primary.Hit;
+    found = primary.Found;
+  } else {
+    // Progressive integrators trace their camera rays in BeginPass
+    float weight;
+    ray = m_pCamera->GetRay(_x, _y, m_Width, m_Height, _rnd, weight);
+    found = m_pScene->Trace(ray, hit);
+  }
+
+  Color albedo(0, 0, 0, 1);
+  Color normal(0, 0, 0, 1);
+  float depth = 0.0f;
+
+  if (found) {
+    BSDF bsdf = hit.material->Evaluate(hit, ray.direction);
+    albedo = bsdf.IsLight() ? Color(1, 1, 1) : bsdf.GetColor(bsdf.Type);
+    Vector3 n = hit.normal.Dot(ray.direction) > 0 ? -hit.normal : hit.normal;
+    normal = Color(n.x, n.y, n.z, 1);
+    depth = (hit.position - ray.position).Length();
+  }
+
+  int index = int(_x + 0.5f) + m_Width * int(_y + 0.5f);
+  index = std::max(0, std::min(m_Width * m_Height - 1, index));
+  float t = 1.0f / float(_sampleIndex + 1);
+  m_Albedo[index] += (albedo - m_Albedo[index]) * t;
+  m_Normals[index] += (normal - m_Normals[index]) * t;
+  m_Depth[index] += (depth - m_Depth[index]) * t;
+}
+
+void Raytracer::RenderPart(int _x, int _y, int _width, int _height, int _spp,
+                           int _sampleOffset, bool _preview) {
   assert(_x + _width <= m_Width);
   assert(_y + _height <= m_Height);
 
   std::random_device d;
-  std::default_random_engine rnd(d());
+  RandomEngine rnd(d());
 
   std::uniform_real_distribution<float> pixel_dist(-0.5, 0.5);
 
+  Integrator *integrator =
+      _preview && m_pPreviewIntegrator ? m_pPreviewIntegrator.get() : m_pIntegrator.get();
+
+#ifdef PROFILING
+  std::vector<float> pixelCost(size_t(_width) * _height, 0.0f);
+#endif
+
   for (int i = 0; i < _spp; i++) {
     for (int x = _x; x < _x + _width; x++) {
       for (int y = _y; y < _y + _height; y++) {
         int pixelIndex = (x + m_Width * y) * 4;
-        
-        Color rayColor = m_pIntegrator->Sample(x + pixel_dist(rnd), y + pixel_dist(rnd), m_Width, m_Height, rnd);
+
+#ifdef PROFILING
+        double pixelStart = m_Profiler.Now();
+#endif
+
+        int sampleIndex = _sampleOffset + i;
+        float sampleX = x + pixel_dist(rnd);
+        float sampleY = y + pixel_dist(rnd);
+
+        // The preview is replaced by the first final sample, features too
+        bool recordFeatures = !_preview && sampleIndex < FEATURE_SAMPLES;
+        if (recordFeatures) {
+          Scene::ArmPrimaryHit();
+        }
+
+        Color rayColor = integrator->Sample(sampleX, sampleY, m_Width, m_Height, rnd);
+
+        if (recordFeatures) {
+          RecordFeatures(sampleX, sampleY, sampleIndex, rnd);
+        }
 
         Color *pixelAddress = m_RawPixels + x + m_Width * y;
-        *pixelAddress += (rayColor - *pixelAddress) / float(i + 1);
+        float luminance = Luminance(rayColor);
+        float meanBefore = sampleIndex ? Luminance(*pixelAddress) : luminance;
+        *pixelAddress += (rayColor - *pixelAddress) / float(sampleIndex + 1);
+
+        float &m2 = m_VarianceM2[x + m_Width * y];
+        m2 = (sampleIndex ? m2 : 0.0f) +
+             (luminance - meanBefore) * (luminance - Luminance(*pixelAddress));
+
+#ifdef PROFILING
+        pixelCost[(x - _x) + (y - _y) * _width] += float(m_Profiler.Now() - pixelStart);
+#endif
 
 #ifndef HEADLESS
         Color current = *pixelAddress;
@@ -116,17 +221,26 @@ void Raytracer::RenderPart(int _x, int _y, int _width, int _height, int _spp) {
     }
 
     if (m_IsShutDown) {
-      return;
+      break;
     }
   }
+
+#ifdef PROFILING
+  m_Profiler.AddTileCost(_x, _y, _width, _height, pixelCost.data());
+#endif
 }
 
 void Raytracer::EmptyQueue(int threadIndex) {
   TileInfo toRender;
-  int tileIndex;
   while (!m_IsShutDown) {
+#ifdef PROFILING
+    double waitStart = m_Profiler.Now();
+#endif
     {
       std::lock_guard<std::mutex> lock(m_TileMutex);
+#ifdef PROFILING
+      m_Profiler.RecordWait(threadIndex, waitStart, m_Profiler.Now());
+#endif
       if (m_TilesToRender.size() == 0) {
         break;
       }
@@ -134,20 +248,90 @@ void Raytracer::EmptyQueue(int threadIndex) {
       toRender = m_TilesToRender.back();
       m_TilesInProgress++;
       m_TilesToRender.pop_back();
-      tileIndex = m_TilesToRender.size();
-      if (tileIndex == 0)
-        m_IsRendering = false;
     }
 
+#ifdef PROFILING
+    RenderProfiler::TileRecord record = {
+        toRender.X,   toRender.Y,       toRender.Width, toRender.Height,
+        toRender.SPP, m_Profiler.Now(), 0,              Scene::GetThreadRayCount()};
+#endif
+
     RenderPart(toRender.X, toRender.Y, toRender.Width, toRender.Height,
-               toRender.SPP);
+               toRender.SPP, toRender.SampleOffset, toRender.Preview);
+
+#ifdef PROFILING
+    record.End = m_Profiler.Now();
+    record.Rays = Scene::GetThreadRayCount() - record.Rays;
+    m_Profiler.RecordTile(threadIndex, record);
+#endif
+
     m_TilesInProgress--;
   }
+
+#ifdef PROFILING
+  m_Profiler.RecordThreadFinish(threadIndex);
+#endif
+}
+
+void Raytracer::RunWorkers() {
+  std::vector<std::thread> workers;
+  for (int i = 0; i < m_ThreadCount; i++) {
+    workers.push_back(std::thread(&Raytracer::EmptyQueue, this, i));
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void Raytracer::RenderTiles(std::vector<TileInfo> _preview, std::vector<TileInfo> _final) {
+  // The preview finishes before the final tiles start, their first sample
+  // replaces whatever the preview wrote
+  for (auto tiles : {&_preview, &_final}) {
+    if (m_IsShutDown) {
+      break;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_TileMutex);
+      m_TilesToRender = std::move(*tiles);
+    }
+    RunWorkers();
+  }
+
+  m_IsRendering = false;
+}
+
+void Raytracer::RenderPasses() {
+  for (int pass = 0; pass < m_SPP && !m_IsShutDown; pass++) {
+    m_pIntegrator->BeginPass(pass, m_ThreadCount);
+
+    {
+      std::lock_guard<std::mutex> lock(m_TileMutex);
+      for (int x = 0; x < m_Width; x += m_TileSize) {
+        int width = std::min(m_TileSize, (m_Width - x));
+        for (int y = 0; y < m_Height; y += m_TileSize) {
+          int height = std::min(m_TileSize, (m_Height - y));
+          m_TilesToRender.push_back({x, y, width, height, 1, pass, false});
+        }
+      }
+    }
+
+    RunWorkers();
+  }
+
+  m_IsRendering = false;
 }
 
+void Raytracer::PrepareFrame(int frameIndex) { m_pScene->PrepareTime(frameIndex); }
+
 void Raytracer::Render(int frameIndex) {
+  JoinThreads();
+
   m_IsRendering = true;
   m_pScene->SetTime(frameIndex);
+  m_pIntegrator->BeginFrame();
+  if (m_pPreviewIntegrator) {
+    m_pPreviewIntegrator->BeginFrame();
+  }
   memset(m_RawPixels, 0, m_Height * m_Width * sizeof(Color));
 
   m_pIntegrator->Reset();
@@ -157,83 +341,240 @@ void Raytracer::Render(int frameIndex) {
 #endif
 
 #ifdef MULTI_THREADED
+  if (m_pIntegrator->IsProgressive()) {
+    std::cout << "Rendering " << m_SPP << " progressive passes on "
+              << m_ThreadCount << " threads." << std::endl;
+
+    m_TilesInProgress = 0;
+
+#ifdef PROFILING
+    m_Profiler.BeginFrame(m_ThreadCount, m_Width, m_Height);
+#endif
+
+    m_Threads.push_back(std::thread(&Raytracer::RenderPasses, this));
+    return;
+  }
+
   std::cout << "Start rendering..." << std::endl;
-  // Spawn rendering threads
+  std::vector<TileInfo> finalTiles;
   for (int x = 0; x < m_Width; x += m_TileSize) {
     int width = std::min(m_TileSize, (m_Width - x));
     for (int y = 0; y < m_Height; y += m_TileSize) {
       int height = std::min(m_TileSize, (m_Height - y));
-      m_TilesToRender.push_back({x, y, width, height, m_SPP - 5});
+      finalTiles.push_back({x, y, width, height, m_SPP, 0, false});
     }
   }
 
-  // Preview render
-  for (int x = 0; x < m_Width; x += m_TileSize * 2) {
-    int width = std::min(m_TileSize * 2, (m_Width - x));
-    for (int y = 0; y < m_Height; y += m_TileSize * 2) {
-      int height = std::min(m_TileSize * 2, (m_Height - y));
-      m_TilesToRender.push_back({x, y, width, height, 5});
+  // Quick preview for the window, replaced by the first sample of the
+  // final tiles. Headless renders have nobody to show it to.
+  std::vector<TileInfo> previewTiles;
+  if (m_pPreviewIntegrator) {
+    for (int x = 0; x < m_Width; x += m_TileSize * 2) {
+      int width = std::min(m_TileSize * 2, (m_Width - x));
+      for (int y = 0; y < m_Height; y += m_TileSize * 2) {
+        int height = std::min(m_TileSize * 2, (m_Height - y));
+        previewTiles.push_back({x, y, width, height, 1, 0, true});
+      }
     }
   }
 
-  std::cout << "Rendering " << m_TilesToRender.size() << " tiles ("
+  std::cout << "Rendering " << finalTiles.size() << " tiles ("
             << m_TileSize << ") on " << m_ThreadCount << " threads."
             << std::endl;
 
   m_TilesInProgress = 0;
 
-  {
-    m_Threads.reserve(m_ThreadCount);
-    std::lock_guard<std::mutex> lock(m_TileMutex);
-    for (int i = 0; i < m_ThreadCount; i++) {
-      m_Threads.push_back(std::thread(&Raytracer::EmptyQueue, this, i));
-    }
-  }
+#ifdef PROFILING
+  m_Profiler.BeginFrame(m_ThreadCount, m_Width, m_Height);
+#endif
+
+  m_Threads.push_back(std::thread(&Raytracer::RenderTiles, this, std::move(previewTiles),
+                                  std::move(finalTiles)));
 
 #else
-  RenderPart(0, 0, m_Width, m_Height, m_SPP);
+  if (m_pIntegrator->IsProgressive()) {
+    for (int pass = 0; pass < m_SPP; pass++) {
+      m_pIntegrator->BeginPass(pass, 1);
+      RenderPart(0, 0, m_Width, m_Height, 1, pass, false);
+    }
+  } else {
+    RenderPart(0, 0, m_Width, m_Height, m_SPP, 0, false);
+  }
+  m_IsRendering = false;
 #endif
 }
 
-void Raytracer::SaveImages(std::string basename) {
+struct Raytracer::FrameImages {
+  int Width, Height;
+  std::vector<Color> Pixels;
+  std::vector<OutputImage> Outputs;
+  std::vector<Color> Albedo, Normals;
+  std::vector<float> Depth, Variance;
+};
 
+std::shared_ptr<Raytracer::FrameImages> Raytracer::CaptureImages() {
   m_pIntegrator->Finalize(m_SPP);
+  m_pIntegrator->ResolveSplats(GetRawPixels(), m_SPP);
+
+  int pixelCount = m_Width * m_Height;
+  auto images = std::make_shared<FrameImages>();
+  images->Width = m_Width;
+  images->Height = m_Height;
+  images->Pixels.assign(GetRawPixels(), GetRawPixels() + pixelCount);
+
+  // The integrator reuses its buffers for the next frame
+  for (auto &output : m_pIntegrator->getOutputs()) {
+    std::shared_ptr<Color> data(new Color[pixelCount], std::default_delete<Color[]>());
+    std::copy(output.Data.get(), output.Data.get() + pixelCount, data.get());
+    images->Outputs.push_back({data, output.name, output.format});
+  }
 
-  stbi_write_hdr((basename + ".hdr").c_str(),
-    m_Width, m_Height, 4, (float *)GetRawPixels());
+  images->Albedo = m_Albedo;
+  images->Normals = m_Normals;
+  images->Depth = m_Depth;
+
+  // Variance of the pixel mean
+  images->Variance.resize(pixelCount);
+  float samples = float(std::max(m_SPP, 1));
+  for (int i = 0; i < pixelCount; i++) {
+    images->Variance[i] = m_VarianceM2[i] / (std::max(samples - 1.0f, 1.0f) * samples);
+  }
+
+  return images;
+}
+
+void Raytracer::WriteImages(const FrameImages &images, const std::string &basename) {
+  int width = images.Width;
+  int height = images.Height;
+  int pixelCount = width * height;
+
+#ifdef DENOISE
+  auto denoiseStart = std::chrono::high_resolution_clock::now();
+  std::vector<Color> denoised(pixelCount);
+  Denoiser denoiser(width, height);
+  denoiser.Denoise(images.Pixels.data(), images.Albedo.data(), images.Normals.data(),
+                   images.Depth.data(), images.Variance.data(), denoised.data());
+  std::chrono::duration<double> denoiseTime =
+      std::chrono::high_resolution_clock::now() - denoiseStart;
+  std::cout << "Denoised in " << denoiseTime.count() << "s" << std::endl;
+#endif
 
-  auto outputs = m_pIntegrator->getOutputs();
+#ifdef EXR_OUTPUT
+#ifdef EXR_HALF
+  const bool half = true;
+#else
+  const bool half = false;
+#endif
 
-  for (auto& output : outputs) {
+  ExrWriter exr(width, height);
+  exr.AddLayer("", images.Pixels.data(), true, half);
+  for (auto &output : images.Outputs) {
+    if (output.format == OutputFormat::PNG) {
+      stbi_write_png((basename + "-" + output.name + ".png").c_str(),
+        width, height, 4, output.Data.get(), 0);
+    } else {
+      exr.AddLayer(output.name, output.Data.get(), false, half);
+    }
+  }
+#ifdef DENOISE
+  exr.AddLayer("denoised", denoised.data(), false, half);
+#endif
+  exr.AddLayer("albedo", images.Albedo.data(), false, half);
+  exr.AddLayer("normal", "XYZ", (const float *)images.Normals.data(), 4, half);
+  // Half floats lack the range for depth and the precision for variance
+  exr.AddLayer("depth", "Z", images.Depth.data(), 1, false);
+  exr.AddLayer("variance", "Y", images.Variance.data(), 1, false);
+  exr.Write(basename + ".exr");
+#else
+  stbi_write_hdr((basename + ".hdr").c_str(),
+    width, height, 4, (float *)images.Pixels.data());
+
+  for (auto& output : images.Outputs) {
     Color* data = output.Data.get();
     switch (output.format) {
       case OutputFormat::HDR:
         stbi_write_hdr((basename + "-" + output.name + ".hdr").c_str(),
-          m_Width, m_Height, 4, (float*)data);
+          width, height, 4, (float*)data);
         break;
       case OutputFormat::PNG:
         stbi_write_png((basename + "-" + output.name + ".png").c_str(),
-          m_Width, m_Height, 4, data, 0);
+          width, height, 4, data, 0);
         break;
       case OutputFormat::PFM:
-        float* data3 = (float*)malloc(m_Width * m_Height * 3 * sizeof(float));
-        for (int x = 0; x < m_Width; x++) {
-          for (int y = 0; y < m_Height; y++) {
-            int i = x + m_Width * (m_Height - y - 1);
-            int j = x + m_Width * y;
-            Color col = data[j];
-            data3[i * 3 + 0] = col.R();
-            data3[i * 3 + 1] = col.G();
-            data3[i * 3 + 2] = col.B();
+        // PFM rows go bottom up
+        std::vector<float> data3(pixelCount * 3);
+        for (int y = 0; y < height; y++) {
+          const Color *row = data + width * (height - y - 1);
+          for (int x = 0; x < width; x++) {
+            data3[(x + width * y) * 3 + 0] = row[x].R();
+            data3[(x + width * y) * 3 + 1] = row[x].G();
+            data3[(x + width * y) * 3 + 2] = row[x].B();
           }
         }
-        
-        write_pfm_file3((basename + "-" + output.name + ".pfm").c_str(), data3, m_Width, m_Height);
-        free(data3);
+        write_pfm_file3((basename + "-" + output.name + ".pfm").c_str(), data3.data(), width, height);
         break;
     }
   }
 
+  // Feature AOVs and the denoised image
+  std::vector<Color> depth(pixelCount), normals(pixelCount);
+  for (int i = 0; i < pixelCount; i++) {
+    depth[i] = Color(images.Depth[i], images.Depth[i], images.Depth[i], 1);
+    normals[i] = Color(images.Normals[i].ToVector3() * 0.5f + Vector3(0.5f, 0.5f, 0.5f));
+  }
+
+#ifdef DENOISE
+  stbi_write_hdr((basename + "-denoised.hdr").c_str(), width, height, 4,
+                 (float *)denoised.data());
+#endif
+  stbi_write_hdr((basename + "-albedo.hdr").c_str(), width, height, 4,
+                 (float *)images.Albedo.data());
+  stbi_write_hdr((basename + "-normal.hdr").c_str(), width, height, 4,
+                 (float *)normals.data());
+  stbi_write_hdr((basename + "-depth.hdr").c_str(), width, height, 4,
+                 (float *)depth.data());
+  stbi_write_hdr((basename + "-variance.hdr").c_str(), width, height, 1,
+                 images.Variance.data());
+#endif
+}
+
+void Raytracer::WriteReports(const std::string &basename) {
+#ifdef PROFILING
+  m_Profiler.PrintSummary();
+  m_Profiler.WriteTrace(basename + "-trace.json");
+  m_Profiler.WriteHeatmap(basename + "-cost.png");
+#endif
+
+#ifdef STATISTICS
+  auto stats = Statistics::Collect();
+  Statistics::PrintReport(stats, std::cout);
+  Statistics::WriteJson(stats, basename + "-stats.json");
+#endif
+}
+
+void Raytracer::SaveImages(std::string basename) {
+  FlushImages();
+  WriteImages(*CaptureImages(), basename);
+  WriteReports(basename);
+}
+
+void Raytracer::SaveImagesAsync(std::string basename) {
+  auto images = CaptureImages();
+
+  // Frames are written in order, at most one is in flight
+  FlushImages();
+  m_PendingWrite = std::async(std::launch::async, [images, basename] {
+    WriteImages(*images, basename);
+  });
+
+  // Reports read state the next frame resets, they can't wait
+  WriteReports(basename);
+}
+
+void Raytracer::FlushImages() {
+  if (m_PendingWrite.valid()) {
+    m_PendingWrite.get();
+  }
 }
 
 #ifndef HEADLESS
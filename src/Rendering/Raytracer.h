@@ -4,7 +4,13 @@
 #include <mutex>
 #include <atomic>
 #include <vector>
+#include <future>
 #include "../IO/stb_image_write.h"
+#include "RandomEngine.h"
+
+#ifdef PROFILING
+#include "RenderProfiler.h"
+#endif
 
 #ifndef HEADLESS
 #include <SFML/Graphics.hpp>
@@ -16,6 +22,13 @@ class Integrator;
 
 #define MULTI_THREADED
 #define BOUNCES 8
+// Samples per pixel that also record first hit features for the denoiser
+#define FEATURE_SAMPLES 4
+// Frames are written as one multi-layer EXR instead of a file per image,
+// PNG outputs stay separate
+#define EXR_OUTPUT
+// Color layers of the EXR as half floats
+#define EXR_HALF
 
 /********************************************
 ** Raytracer
@@ -27,6 +40,10 @@ class Raytracer {
 private:
   struct TileInfo {
     int X, Y, Width, Height, SPP;
+    // Samples already accumulated in the pixels of this tile
+    int SampleOffset;
+    // Rendered with the preview integrator
+    bool Preview;
   };
 
 #ifndef HEADLESS
@@ -35,9 +52,20 @@ private:
 
   DirectX::SimpleMath::Color *m_RawPixels;
 
+  // First hit albedo, shading normal and distance, averaged over the
+  // feature samples
+  std::vector<DirectX::SimpleMath::Color> m_Albedo;
+  std::vector<DirectX::SimpleMath::Color> m_Normals;
+  std::vector<float> m_Depth;
+  // Sum of squared luminance deviations of the samples (Welford)
+  std::vector<float> m_VarianceM2;
+
   std::unique_ptr<Camera> m_pCamera;
   std::unique_ptr<Scene> m_pScene;
   std::unique_ptr<Integrator> m_pIntegrator;
+  // Irradiance cache integrator for the quick first pass over the image,
+  // null when no preview pass runs (headless or progressive renders)
+  std::unique_ptr<Integrator> m_pPreviewIntegrator;
 
   float m_FOV;
   int m_Width;
@@ -55,11 +83,41 @@ private:
 
   std::mutex m_TileMutex;
 
+  // Images of a finished frame, written while the next one renders
+  struct FrameImages;
+  std::future<void> m_PendingWrite;
+
+#ifdef PROFILING
+  RenderProfiler m_Profiler;
+#endif
+
   // Render a part of the image (for multy threading)
-  void RenderPart(int _x, int _y, int _width, int _height, int _spp);
+  void RenderPart(int _x, int _y, int _width, int _height, int _spp,
+                  int _sampleOffset, bool _preview);
+
+  // Add the first hit of the sample's camera ray to the features, traced
+  // again only if the integrator didn't
+  void RecordFeatures(float _x, float _y, int _sampleIndex, RandomEngine &_rnd);
    
   void EmptyQueue(int threadIndex);
 
+  // Renders the queued tiles on m_ThreadCount workers and waits for them
+  void RunWorkers();
+
+  // Drives tiled rendering, the preview tiles before the final ones
+  void RenderTiles(std::vector<TileInfo> _preview, std::vector<TileInfo> _final);
+
+  // Drives progressive integrators, one pass over all tiles per sample
+  void RenderPasses();
+
+  void JoinThreads();
+
+  // Resolves the frame and copies everything SaveImages writes
+  std::shared_ptr<FrameImages> CaptureImages();
+  static void WriteImages(const FrameImages &images, const std::string &basename);
+  // Profiling and statistics reports of the frame
+  void WriteReports(const std::string &basename);
+
 public:
   Raytracer(void);
   bool Initialize(int _width, int _height, std::string _integrator,
@@ -76,7 +134,16 @@ public:
 
   void Render(int frameIndex);
 
+  // Builds the geometry of a later frame while the current one renders,
+  // Render picks it up when it gets there
+  void PrepareFrame(int frameIndex);
+
   void SaveImages(std::string basename);
+  // Same as SaveImages, but denoising and writing happen on an I/O thread.
+  // The frame is copied first, Render can start right away.
+  void SaveImagesAsync(std::string basename);
+  // Waits for the images of the last SaveImagesAsync
+  void FlushImages();
 
 #ifndef HEADLESS
   sf::Uint8 *GetPixels(void) const;
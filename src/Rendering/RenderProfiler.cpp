@@ -0,0 +1,126 @@
+#include "RenderProfiler.h"
+#include "../IO/stb_image_write.h"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+RenderProfiler::RenderProfiler() : m_Width(0), m_Height(0) {}
+
+void RenderProfiler::BeginFrame(int threadCount, int width, int height) {
+  m_Width = width;
+  m_Height = height;
+  m_Threads.assign(threadCount, ThreadRecords{{}, {}, 0});
+  m_PixelCost.assign(size_t(width) * height, 0.0f);
+  m_FrameStart = Clock::now();
+}
+
+void RenderProfiler::AddTileCost(int x, int y, int width, int height,
+                                 const float *seconds) {
+  std::lock_guard<std::mutex> lock(m_PixelCostMutex);
+  for (int j = 0; j < height; j++) {
+    float *row = m_PixelCost.data() + x + size_t(y + j) * m_Width;
+    for (int i = 0; i < width; i++) {
+      row[i] += seconds[i + j * width];
+    }
+  }
+}
+
+bool RenderProfiler::WriteTrace(const std::string &filename) const {
+  std::ofstream out(filename);
+  if (!out.is_open()) {
+    std::cerr << "Couldn't write render trace " << filename << std::endl;
+    return false;
+  }
+
+  // trace_event timestamps are in microseconds
+  out << std::fixed << std::setprecision(1);
+  out << "{\"traceEvents\":[\n";
+
+  bool first = true;
+  auto separator = [&]() -> const char * {
+    const char *sep = first ? "" : ",\n";
+    first = false;
+    return sep;
+  };
+
+  for (size_t t = 0; t < m_Threads.size(); t++) {
+    out << separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+        << "\"tid\":" << t << ",\"args\":{\"name\":\"Render thread " << t
+        << "\"}}";
+
+    for (const auto &tile : m_Threads[t].Tiles) {
+      out << separator() << "{\"name\":\"tile " << tile.X << "," << tile.Y
+          << "\",\"cat\":\"tile\",\"ph\":\"X\",\"pid\":0,\"tid\":" << t
+          << ",\"ts\":" << tile.Start * 1e6
+          << ",\"dur\":" << (tile.End - tile.Start) * 1e6
+          << ",\"args\":{\"x\":" << tile.X << ",\"y\":" << tile.Y
+          << ",\"width\":" << tile.Width << ",\"height\":" << tile.Height
+          << ",\"spp\":" << tile.SPP << ",\"rays\":" << tile.Rays << "}}";
+    }
+
+    for (const auto &wait : m_Threads[t].Waits) {
+      out << separator()
+          << "{\"name\":\"wait for tile\",\"cat\":\"wait\",\"ph\":\"X\","
+          << "\"pid\":0,\"tid\":" << t << ",\"ts\":" << wait.Start * 1e6
+          << ",\"dur\":" << (wait.End - wait.Start) * 1e6 << "}";
+    }
+
+    out << separator() << "{\"name\":\"thread finished\",\"ph\":\"i\","
+        << "\"s\":\"t\",\"pid\":0,\"tid\":" << t
+        << ",\"ts\":" << m_Threads[t].Finish * 1e6 << "}";
+  }
+
+  out << "\n]}\n";
+  return true;
+}
+
+bool RenderProfiler::WriteHeatmap(const std::string &filename) const {
+  if (m_PixelCost.empty()) {
+    return false;
+  }
+
+  float maxCost = *std::max_element(m_PixelCost.begin(), m_PixelCost.end());
+  float scale = maxCost > 0 ? 1.0f / maxCost : 0.0f;
+
+  // Black -> red -> yellow -> white ramp over the normalized cost
+  std::vector<unsigned char> pixels(m_PixelCost.size() * 4);
+  for (size_t i = 0; i < m_PixelCost.size(); i++) {
+    float t = m_PixelCost[i] * scale * 3.0f;
+    pixels[i * 4 + 0] = (unsigned char)(std::min(1.0f, t) * 255);
+    pixels[i * 4 + 1] = (unsigned char)(std::min(1.0f, std::max(0.0f, t - 1)) * 255);
+    pixels[i * 4 + 2] = (unsigned char)(std::min(1.0f, std::max(0.0f, t - 2)) * 255);
+    pixels[i * 4 + 3] = 255;
+  }
+
+  return stbi_write_png(filename.c_str(), m_Width, m_Height, 4, pixels.data(),
+                        0) != 0;
+}
+
+void RenderProfiler::PrintSummary() const {
+  double frameEnd = 0;
+  for (const auto &thread : m_Threads) {
+    frameEnd = std::max(frameEnd, thread.Finish);
+  }
+
+  std::cout << "Render profile (" << std::fixed << std::setprecision(3)
+            << frameEnd << "s):" << std::endl;
+
+  for (size_t t = 0; t < m_Threads.size(); t++) {
+    const auto &thread = m_Threads[t];
+    double busy = 0, waiting = 0;
+    uint64_t rays = 0;
+    for (const auto &tile : thread.Tiles) {
+      busy += tile.End - tile.Start;
+      rays += tile.Rays;
+    }
+    for (const auto &wait : thread.Waits) {
+      waiting += wait.End - wait.Start;
+    }
+
+    std::cout << "  thread " << std::setw(2) << t << ": " << std::setw(4)
+              << thread.Tiles.size() << " tiles, busy " << busy << "s, lock "
+              << waiting << "s, idle tail " << frameEnd - thread.Finish
+              << "s, " << rays << " rays" << std::endl;
+  }
+}
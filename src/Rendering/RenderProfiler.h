@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/********************************************
+** RenderProfiler
+** Records per tile and per thread timings of
+** a frame (only in PROFILING builds). Exports
+** a Chrome trace_event JSON file and a per
+** pixel cost heatmap.
+*********************************************/
+
+class RenderProfiler {
+public:
+  struct TileRecord {
+    int X, Y, Width, Height, SPP;
+    double Start, End;
+    uint64_t Rays;
+  };
+
+  struct WaitRecord {
+    double Start, End;
+  };
+
+private:
+  typedef std::chrono::high_resolution_clock Clock;
+
+  struct ThreadRecords {
+    std::vector<TileRecord> Tiles;
+    std::vector<WaitRecord> Waits;
+    double Finish;
+  };
+
+  Clock::time_point m_FrameStart;
+  int m_Width, m_Height;
+
+  // One entry per thread so recording never needs a lock
+  std::vector<ThreadRecords> m_Threads;
+  std::vector<float> m_PixelCost;
+  std::mutex m_PixelCostMutex;
+
+public:
+  RenderProfiler();
+
+  void BeginFrame(int threadCount, int width, int height);
+
+  // Seconds since the start of the frame
+  double Now() const {
+    return std::chrono::duration<double>(Clock::now() - m_FrameStart).count();
+  }
+
+  void RecordTile(int threadIndex, const TileRecord &tile) {
+    m_Threads[threadIndex].Tiles.push_back(tile);
+  }
+
+  void RecordWait(int threadIndex, double start, double end) {
+    m_Threads[threadIndex].Waits.push_back({start, end});
+  }
+
+  void RecordThreadFinish(int threadIndex) {
+    m_Threads[threadIndex].Finish = Now();
+  }
+
+  // Merges the per pixel cost of a tile, tiles of different passes may
+  // overlap
+  void AddTileCost(int x, int y, int width, int height, const float *seconds);
+
+  bool WriteTrace(const std::string &filename) const;
+  bool WriteHeatmap(const std::string &filename) const;
+  void PrintSummary() const;
+};
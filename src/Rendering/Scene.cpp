@@ -4,7 +4,6 @@
 #include "../Objects/Box.h"
 #include "../Objects/Mesh.h"
 #include "Cameras/Camera.h"
-#include "Accelerators/LightCache.h"
 #include <stdlib.h>
 #include <iostream>
 #include <string>
@@ -14,11 +13,13 @@
 #include "Materials/SpecularMaterial.h"
 #include "Materials/EmissionMaterial.h"
 
-#define USE_LIGHTCACHE 0
-
 using namespace DirectX;
 using namespace DirectX::SimpleMath;
 
+static bool IsAnimatedGeometry(RenderObject *obj) {
+  return obj->HasBuffers() && (obj->IsAnimated() || obj->IsDeforming());
+}
+
 Scene::Scene(Camera *_cam, std::vector<BaseObject *> &sceneObjects) {
   // Initialize object lists
   m_SceneObjects = std::move(sceneObjects);
@@ -28,12 +29,29 @@ Scene::Scene(Camera *_cam, std::vector<BaseObject *> &sceneObjects) {
 
   m_TotalLightWeight = 0;
 
+  m_Transforms.Build(m_SceneObjects);
+  m_Transforms.Update();
+
+  m_HasDeformingObjects = false;
+  for (auto obj : m_SceneObjects) {
+    auto renderObject = dynamic_cast<RenderObject *>(obj);
+    if (renderObject && IsAnimatedGeometry(renderObject)) {
+      m_AnimatedObjects.push_back(renderObject);
+      m_HasDeformingObjects |= renderObject->IsDeforming();
+    }
+  }
+  m_FrontScene = 0;
+  m_PreparedFrame = -1;
+  EmbreeScene &embreeScene = m_EmbreeScenes[m_FrontScene];
+  embreeScene.Clear(!m_AnimatedObjects.empty());
+  m_EmbreeScenes[1 - m_FrontScene].Clear(!m_AnimatedObjects.empty());
+
   for (auto obj : m_SceneObjects) {
 
 		auto renderObject = dynamic_cast<RenderObject*>(obj);
 		if (!renderObject) continue;
 
-    if (!m_EmbreeScene.AddObject(renderObject)) {
+    if (!embreeScene.AddObject(renderObject, 0, 0, IsAnimatedGeometry(renderObject))) {
       m_CustomIntersectObjects.push_back(renderObject);
     }
 
@@ -48,7 +66,7 @@ Scene::Scene(Camera *_cam, std::vector<BaseObject *> &sceneObjects) {
     }
   }
 
-  m_EmbreeScene.CommitScene();
+  embreeScene.CommitScene();
 
   m_SampleDist = std::discrete_distribution<>(std::begin(m_LightWeights),
                                               std::end(m_LightWeights));
@@ -58,14 +76,13 @@ Scene::Scene(Camera *_cam, std::vector<BaseObject *> &sceneObjects) {
 
   // Set the camera pointer and move the camera to it's start position
   m_pCamera = _cam;
-
-  m_LightCache =
-      new LightCache(BoundingBox(Vector3(0, 0, 0), Vector3(20, 20, 20)));
+  m_GeometryVersion = 0;
 }
 
-Ray Scene::SampleLight(std::default_random_engine &_rnd, RenderObject **_outLight,
+Ray Scene::SampleLight(RandomEngine &_rnd, RenderObject **_outLight,
                        float &le) const {
   assert(m_SceneLights.size() > 0);
+  STAT_INC(LightSamples);
   int lightIndex = (int)m_SampleDist(_rnd);
   *_outLight = m_SceneLights[lightIndex];
   le = m_LightWeights[lightIndex] / m_TotalLightWeight;
@@ -73,25 +90,119 @@ Ray Scene::SampleLight(std::default_random_engine &_rnd, RenderObject **_outLigh
 }
 
 void Scene::SetTime(int frameIndex) {
-  m_EmbreeScene.Clear();
-  for (auto obj : m_SceneObjects) {
-	  obj->SetTime(frameIndex);
+  JoinPrepare();
 
-		auto renderObject = dynamic_cast<RenderObject*>(obj);
-		if (!renderObject) continue;
+  // Timelines only touch their own object, evaluate them all in parallel.
+  // World transforms depend on parents and are composed level by level.
+  int objectCount = int(m_SceneObjects.size());
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int i = 0; i < objectCount; i++) {
+    m_SceneObjects[i]->SetTime(frameIndex);
+  }
+  // Custom intersect objects move without touching Embree, caches have to
+  // see those too
+  if (m_Transforms.Update() || m_HasDeformingObjects) {
+    m_GeometryVersion++;
+  }
+
+  // Static geometry keeps its BVH
+  if (m_AnimatedObjects.empty()) {
+    return;
+  }
+
+  if (m_PreparedFrame == frameIndex) {
+    m_FrontScene = 1 - m_FrontScene;
+  } else {
+    BuildFrame(m_EmbreeScenes[m_FrontScene], frameIndex);
+  }
+  m_PreparedFrame = -1;
+}
+
+void Scene::PrepareTime(int frameIndex) {
+  if (m_AnimatedObjects.empty()) {
+    return;
+  }
+
+  JoinPrepare();
+  m_PreparedFrame = frameIndex;
+  m_PrepareThread = std::thread([this, frameIndex] {
+    BuildFrame(m_EmbreeScenes[1 - m_FrontScene], frameIndex);
+  });
+}
+
+void Scene::Rebuild(int frameIndex) {
+  JoinPrepare();
+  m_PreparedFrame = -1;
+  BuildFrame(m_EmbreeScenes[m_FrontScene], frameIndex, true);
+}
+
+void Scene::JoinPrepare() {
+  if (m_PrepareThread.joinable()) {
+    m_PrepareThread.join();
+  }
+}
 
-	  m_EmbreeScene.AddObject(renderObject);
+void Scene::BuildFrame(EmbreeScene &embreeScene, int frameIndex, bool _rebuild) {
+  // Geometry is blurred over the shutter around the frame, everything else
+  // (lights, custom intersect objects) stays at the frame
+  float shutter = m_pCamera->GetShutter();
+
+  // Rewrite the vertices of animated objects and refit, unless one of them
+  // changed its buffers or motion steps
+  bool refit = !_rebuild;
+  for (auto obj : m_AnimatedObjects) {
+    if (!refit) {
+      break;
+    }
+    refit = embreeScene.UpdateObject(obj, frameIndex, shutter);
   }
-  m_EmbreeScene.CommitScene();
+
+  if (!refit) {
+    embreeScene.Clear(!m_AnimatedObjects.empty());
+    for (auto obj : m_SceneObjects) {
+      auto renderObject = dynamic_cast<RenderObject *>(obj);
+      if (!renderObject) continue;
+
+      embreeScene.AddObject(renderObject, frameIndex, shutter,
+                            IsAnimatedGeometry(renderObject));
+    }
+  }
+  embreeScene.CommitScene();
+}
+
+static thread_local Scene::PrimaryHit s_PrimaryHit = {};
+
+void Scene::ArmPrimaryHit() {
+  s_PrimaryHit.Armed = true;
+  s_PrimaryHit.Recorded = false;
+}
+
+const Scene::PrimaryHit &Scene::TakePrimaryHit() {
+  s_PrimaryHit.Armed = false;
+  return s_PrimaryHit;
 }
 
+#ifdef PROFILING
+static thread_local uint64_t s_ThreadRayCount = 0;
+
+uint64_t Scene::GetThreadRayCount() { return s_ThreadRayCount; }
+#endif
+
 bool Scene::Trace(const DirectX::SimpleMath::Ray &_ray,
                   Intersection &minIntersect) const {
+#ifdef PROFILING
+  s_ThreadRayCount++;
+#endif
+  STAT_INC(RaysTraced);
+  STAT_ADD(CustomIntersectTests, m_CustomIntersectObjects.size());
+
   float minDist = FLT_MAX;
   Intersection intersect;
   bool intersectFound = false;
 
-  if (m_EmbreeScene.Trace(_ray, intersect)) {
+  STAT_INC(EmbreeTraversals);
+  if (m_EmbreeScenes[m_FrontScene].Trace(_ray, Camera::GetRayTime(), Camera::GetPixelSpread(),
+                                          intersect)) {
     float dist = (intersect.position - _ray.position).LengthSquared();
     minDist = dist;
     intersectFound = true;
@@ -107,14 +218,54 @@ bool Scene::Trace(const DirectX::SimpleMath::Ray &_ray,
         intersectFound = true;
         minIntersect = intersect;
         minIntersect.hitObject = obj;
+        minIntersect.alphaTested = false;
+        minIntersect.footprint = 0.0f;
       }
     }
   }
 
+  if (s_PrimaryHit.Armed && _ray.position == Camera::GetLastRay().position &&
+      _ray.direction == Camera::GetLastRay().direction) {
+    s_PrimaryHit.Armed = false;
+    s_PrimaryHit.Recorded = true;
+    s_PrimaryHit.Found = intersectFound;
+    s_PrimaryHit.CameraRay = _ray;
+    if (intersectFound) {
+      s_PrimaryHit.Hit = minIntersect;
+    }
+  }
+
   return intersectFound;
 }
 
+bool Scene::Occluded(const DirectX::SimpleMath::Ray &_ray, float _distance) const {
+#ifdef PROFILING
+  s_ThreadRayCount++;
+#endif
+  STAT_INC(RaysTraced);
+
+  if (_distance <= 0.0f) {
+    return false;
+  }
+  STAT_INC(EmbreeTraversals);
+  if (m_EmbreeScenes[m_FrontScene].Occluded(_ray, Camera::GetRayTime(), _distance)) {
+    return true;
+  }
+
+  STAT_ADD(CustomIntersectTests, m_CustomIntersectObjects.size());
+  Intersection intersect;
+  for (auto obj : m_CustomIntersectObjects) {
+    if (obj->Intersect(_ray, intersect) &&
+        (intersect.position - _ray.position).LengthSquared() < _distance * _distance) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Scene::~Scene(void) {
+  JoinPrepare();
+
   for (auto obj : m_SceneObjects) {
     delete obj;
   }
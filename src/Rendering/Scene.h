@@ -3,13 +3,16 @@
 #include <vector>
 #include <time.h>
 #include <random>
+#include <thread>
+#include "RandomEngine.h"
 #include "../Geometry/Intersection.h"
 #include "Accelerators/EmbreeScene.h"
+#include "../Objects/TransformHierarchy.h"
+#include "Statistics.h"
 
 class BaseObject;
 class Camera;
 class Light;
-class LightCache;
 
 /********************************************
 ** Scene
@@ -23,6 +26,9 @@ class Scene {
   std::vector<BaseObject *> m_SceneObjects;
   std::vector<RenderObject *> m_SceneLights;
   std::vector<RenderObject *> m_CustomIntersectObjects;
+  // Embree objects that move or deform, refit in place every frame
+  std::vector<RenderObject *> m_AnimatedObjects;
+  bool m_HasDeformingObjects;
 
   std::vector<float> m_LightWeights;
   float m_TotalLightWeight;
@@ -34,33 +40,104 @@ class Scene {
 
   // Pointer to the current renderer camera
   Camera *m_pCamera;
-  LightCache *m_LightCache;
 
-  EmbreeScene m_EmbreeScene;
+  TransformHierarchy m_Transforms;
+  // Rays trace the front scene while the back one is built for a later
+  // frame, SetTime swaps them when it reaches that frame
+  EmbreeScene m_EmbreeScenes[2];
+  int m_FrontScene;
+  // Frame the back scene is built for, -1 if it's stale
+  int m_PreparedFrame;
+  std::thread m_PrepareThread;
+
+  // Refits or rebuilds the animated geometry of a scene for the frame,
+  // _rebuild skips the refit
+  void BuildFrame(EmbreeScene &embreeScene, int frameIndex, bool _rebuild = false);
+  void JoinPrepare();
+
+  // Bumped whenever SetTime moves geometry
+  uint64_t m_GeometryVersion;
 
 public:
   Scene(Camera *_cam, std::vector<BaseObject *> &sceneObjects);
-  DirectX::SimpleMath::Ray SampleLight(std::default_random_engine &_rnd,
+  DirectX::SimpleMath::Ray SampleLight(RandomEngine &_rnd,
                                        RenderObject **_outLight,
                                        float &le) const;
 
+  // Area density of the positions returned by SampleLight, lights are
+  // picked proportional to their world space area (CalculateWeight) and
+  // sample their surface uniformly
+  float LightPdfA() const { return 1.0f / m_TotalLightWeight; }
+
   void SetTime(int frameIndex);
 
+  // Starts building the acceleration structure of a later frame in the
+  // background. Only reads the objects, so rendering can go on meanwhile.
+  void PrepareTime(int frameIndex);
+
+  // Changes when geometry moved, caches of static scenes stay valid as
+  // long as it doesn't
+  uint64_t GetGeometryVersion() const { return m_GeometryVersion; }
+
+  // Builds the acceleration structure of the frame from scratch, even for
+  // static scenes that SetTime leaves alone (benchmarks)
+  void Rebuild(int frameIndex);
+
+  // Time spent building the acceleration structure for the current frame
+  double GetBuildTime() const { return m_EmbreeScenes[m_FrontScene].GetLastCommitTime(); }
+
   bool Trace(const DirectX::SimpleMath::Ray &_ray,
              Intersection &minIntersect) const;
 
+  // Any hit query along a normalized ray, cheaper than Trace since the
+  // closest hit isn't needed
+  bool Occluded(const DirectX::SimpleMath::Ray &_ray, float _distance) const;
+
+  // First hit of a camera ray, Trace records it for the calling thread
+  // after ArmPrimaryHit. The denoiser features come from the integrator's
+  // own camera ray this way.
+  struct PrimaryHit {
+    bool Armed;
+    bool Recorded;
+    bool Found;
+    DirectX::SimpleMath::Ray CameraRay;
+    Intersection Hit;
+  };
+
+  static void ArmPrimaryHit();
+  // Disarms again, Recorded is false if the camera ray wasn't traced
+  static const PrimaryHit &TakePrimaryHit();
+
+#ifdef PROFILING
+  // Number of rays traced by the calling thread
+  static uint64_t GetThreadRayCount();
+#endif
+
   inline bool Test(DirectX::SimpleMath::Vector3 _p1,
                    DirectX::SimpleMath::Vector3 _p2) const {
+    STAT_INC(ShadowRays);
+
+    auto dir = _p2 - _p1;
+    float distance = dir.Length();
+    dir /= distance;
+
+    // Hits within 0.1 of _p2 belong to its surface
+    DirectX::SimpleMath::Ray r = {_p1 + dir * 0.001f, dir};
+    return !Occluded(r, distance - 0.101f);
+  }
+
+  // True if something lies between the two points, _p2 doesn't have to be
+  // on a surface
+  inline bool Occluded(DirectX::SimpleMath::Vector3 _p1,
+                       DirectX::SimpleMath::Vector3 _p2) const {
+    STAT_INC(ShadowRays);
+
     auto dir = _p2 - _p1;
-    dir.Normalize();
+    float distance = dir.Length();
+    dir /= distance;
 
     DirectX::SimpleMath::Ray r = {_p1 + dir * 0.001f, dir};
-    Intersection intersect;
-    if (!Trace(r, intersect)) {
-      return false;
-    }
-    return DirectX::SimpleMath::Vector3::DistanceSquared(intersect.position,
-                                                         _p2) < 0.01f;
+    return Occluded(r, distance - 0.011f);
   }
 
   ~Scene(void);
@@ -0,0 +1,172 @@
+#include "Statistics.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+void StatCounters::Clear() {
+  std::fill(std::begin(Values), std::end(Values), 0);
+  std::fill(std::begin(PathLengths), std::end(PathLengths), 0);
+}
+
+void StatCounters::Merge(const StatCounters &other) {
+  for (int i = 0; i < (int)Stat::Count; i++) {
+    Values[i] += other.Values[i];
+  }
+  for (int i = 0; i < STAT_MAX_PATH_LENGTH; i++) {
+    PathLengths[i] += other.PathLengths[i];
+  }
+}
+
+#ifdef STATISTICS
+
+namespace {
+struct Registry {
+  std::mutex Mutex;
+  std::vector<StatCounters *> Live;
+  // Counters of threads that exited since the last Collect
+  StatCounters Retired;
+
+  Registry() { Retired.Clear(); }
+};
+
+Registry &GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+const char *StatNames[] = {"camera_rays",
+                           "shadow_rays",
+                           "rays_traced",
+                           "bvh_traversals",
+                           "custom_intersect_tests",
+                           "diffuse_samples",
+                           "specular_samples",
+                           "passthrough_samples",
+                           "diffuse_evaluations",
+                           "glossy_evaluations",
+                           "specular_evaluations",
+                           "alpha_rejections",
+                           "russian_roulette_terminations",
+                           "light_samples"};
+
+static_assert(sizeof(StatNames) / sizeof(StatNames[0]) == (size_t)Stat::Count,
+              "Every statistic needs a name");
+}
+
+Statistics::ThreadCounters::ThreadCounters() {
+  Counters.Clear();
+  auto &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  registry.Live.push_back(&Counters);
+}
+
+Statistics::ThreadCounters::~ThreadCounters() {
+  auto &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+  registry.Retired.Merge(Counters);
+  registry.Live.erase(
+      std::remove(registry.Live.begin(), registry.Live.end(), &Counters),
+      registry.Live.end());
+}
+
+StatCounters Statistics::Collect() {
+  auto &registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.Mutex);
+
+  StatCounters total = registry.Retired;
+  registry.Retired.Clear();
+
+  for (auto counters : registry.Live) {
+    total.Merge(*counters);
+    counters->Clear();
+  }
+
+  return total;
+}
+
+void Statistics::PrintReport(const StatCounters &stats, std::ostream &out) {
+  uint64_t traced = stats.Get(Stat::RaysTraced);
+  uint64_t camera = stats.Get(Stat::CameraRays);
+  uint64_t shadow = stats.Get(Stat::ShadowRays);
+  // Every traced ray that is neither a camera nor a shadow ray continues a path
+  uint64_t bounce = traced > camera + shadow ? traced - camera - shadow : 0;
+
+  uint64_t paths = 0, pathVertices = 0;
+  int longest = 0;
+  for (int i = 0; i < STAT_MAX_PATH_LENGTH; i++) {
+    paths += stats.PathLengths[i];
+    pathVertices += stats.PathLengths[i] * i;
+    if (stats.PathLengths[i] > 0) {
+      longest = i;
+    }
+  }
+
+  out << "Statistics:" << std::endl;
+  out << "  Rays traced           " << std::setw(14) << traced << std::endl;
+  out << "    camera              " << std::setw(14) << camera << std::endl;
+  out << "    bounce              " << std::setw(14) << bounce << std::endl;
+  out << "    shadow              " << std::setw(14) << shadow << std::endl;
+  out << "  BVH traversals        " << std::setw(14)
+      << stats.Get(Stat::EmbreeTraversals) << std::endl;
+  out << "  Custom intersections  " << std::setw(14)
+      << stats.Get(Stat::CustomIntersectTests);
+  if (traced > 0) {
+    out << "  (" << std::fixed << std::setprecision(1)
+        << double(stats.Get(Stat::CustomIntersectTests)) / traced
+        << " per ray)";
+  }
+  out << std::endl;
+  out << "  Material samples" << std::endl;
+  out << "    diffuse             " << std::setw(14)
+      << stats.Get(Stat::DiffuseSamples) << std::endl;
+  out << "    specular            " << std::setw(14)
+      << stats.Get(Stat::SpecularSamples) << std::endl;
+  out << "    passthrough         " << std::setw(14)
+      << stats.Get(Stat::PassthroughSamples) << std::endl;
+  out << "  Material evaluations" << std::endl;
+  out << "    diffuse             " << std::setw(14)
+      << stats.Get(Stat::DiffuseEvaluations) << std::endl;
+  out << "    glossy              " << std::setw(14)
+      << stats.Get(Stat::GlossyEvaluations) << std::endl;
+  out << "    specular            " << std::setw(14)
+      << stats.Get(Stat::SpecularEvaluations) << std::endl;
+  out << "  Alpha rejections      " << std::setw(14)
+      << stats.Get(Stat::AlphaRejections) << std::endl;
+  out << "  Russian roulette      " << std::setw(14)
+      << stats.Get(Stat::RussianRouletteTerminations) << std::endl;
+  out << "  Light samples         " << std::setw(14)
+      << stats.Get(Stat::LightSamples) << std::endl;
+  out << "  Paths                 " << std::setw(14) << paths;
+  if (paths > 0) {
+    out << "  (avg length " << std::fixed << std::setprecision(2)
+        << double(pathVertices) / paths << ", max " << longest << ")";
+  }
+  out << std::endl;
+}
+
+bool Statistics::WriteJson(const StatCounters &stats,
+                           const std::string &filename) {
+  std::ofstream out(filename);
+  if (!out.is_open()) {
+    std::cerr << "Couldn't write statistics " << filename << std::endl;
+    return false;
+  }
+
+  out << "{\n";
+  for (int i = 0; i < (int)Stat::Count; i++) {
+    out << "  \"" << StatNames[i] << "\": " << stats.Values[i] << ",\n";
+  }
+
+  out << "  \"path_lengths\": [";
+  for (int i = 0; i < STAT_MAX_PATH_LENGTH; i++) {
+    out << (i ? ", " : "") << stats.PathLengths[i];
+  }
+  out << "]\n}\n";
+
+  return true;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <ostream>
+#include <algorithm>
+
+/********************************************
+** Statistics
+** Per thread hot path counters (rays, BVH
+** calls, material samples, path lengths...)
+** that are merged once per frame. Only
+** compiled in when STATISTICS is defined,
+** the STAT_* macros vanish otherwise.
+*********************************************/
+
+enum class Stat {
+  CameraRays,
+  ShadowRays,
+  RaysTraced,
+  EmbreeTraversals,
+  CustomIntersectTests,
+  DiffuseSamples,
+  SpecularSamples,
+  PassthroughSamples,
+  DiffuseEvaluations,
+  GlossyEvaluations,
+  SpecularEvaluations,
+  AlphaRejections,
+  RussianRouletteTerminations,
+  LightSamples,
+  Count
+};
+
+#define STAT_MAX_PATH_LENGTH 32
+
+struct StatCounters {
+  uint64_t Values[(int)Stat::Count];
+  uint64_t PathLengths[STAT_MAX_PATH_LENGTH];
+
+  uint64_t Get(Stat stat) const { return Values[(int)stat]; }
+
+  void Clear();
+  void Merge(const StatCounters &other);
+};
+
+#ifdef STATISTICS
+
+class Statistics {
+  // Registers itself so Collect can find the counters of running threads
+  struct ThreadCounters {
+    StatCounters Counters;
+    ThreadCounters();
+    ~ThreadCounters();
+  };
+
+public:
+  static StatCounters &Local() {
+    static thread_local ThreadCounters counters;
+    return counters.Counters;
+  }
+
+  // Sums the counters of all threads and resets them
+  static StatCounters Collect();
+
+  static void PrintReport(const StatCounters &stats, std::ostream &out);
+  static bool WriteJson(const StatCounters &stats, const std::string &filename);
+};
+
+#define STAT_INC(stat) (++Statistics::Local().Values[(int)Stat::stat])
+#define STAT_ADD(stat, n) (Statistics::Local().Values[(int)Stat::stat] += (n))
+#define STAT_PATH_LENGTH(n)                                                    \
+  (++Statistics::Local().PathLengths[std::min<int>(                           \
+      (n), STAT_MAX_PATH_LENGTH - 1)])
+
+#else
+
+#define STAT_INC(stat) ((void)0)
+#define STAT_ADD(stat, n) ((void)0)
+#define STAT_PATH_LENGTH(n) ((void)0)
+
+#endif
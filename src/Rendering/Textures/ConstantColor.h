@@ -7,7 +7,7 @@ private:
     Color color;
 public:
     ConstantColor(Color color) : color(color) { }
-    virtual Color Sample(Vector2 uv) const override {
+    virtual Color Sample(Vector2 uv, float footprint) const override {
         return color;
     }
 };
\ No newline at end of file
@@ -27,7 +27,7 @@ public:
     TextureWrapMode wrapMode;
     TextureFilterMode filterMode;
 
-    virtual Color Sample(Vector2 uv) const override {
+    virtual Color Sample(Vector2 uv, float footprint) const override {
 
         if (wrapMode == TextureWrapMode::Wrap) {
             uv = { std::fmod(uv.x, 1.0f), std::fmod(uv.y, 1.0f) };
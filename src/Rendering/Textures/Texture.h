@@ -6,5 +6,7 @@ using namespace DirectX::SimpleMath;
 
 class Texture {
 public:
-    virtual Color Sample(Vector2 uv) const = 0;
+    // footprint is the width of the lookup in uv units, filtered textures
+    // pick their MIP level from it
+    virtual Color Sample(Vector2 uv, float footprint = 0.0f) const = 0;
 };
\ No newline at end of file
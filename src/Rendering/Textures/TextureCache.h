@@ -7,10 +7,12 @@
 #include <IO/tinyexr.h>
 
 #include "TextureData.h"
+#include "../../IO/TiledTextureFile.h"
 
 class TextureCache {
     std::string workingDir;
     std::unordered_map<std::string, std::shared_ptr<const TextureData>> cache;
+    std::unordered_map<std::string, std::shared_ptr<const TiledTextureFile>> tiledCache;
 public:
     static TextureCache& Instance() {
         static TextureCache instance;
@@ -19,34 +21,43 @@ public:
 
     void SetWorkingDir(std::string dir) { workingDir = dir; }
     
-    std::shared_ptr<const TextureData> Get(std::string filename) {
-        std::string key = workingDir + "\\" + filename;
-        if (cache.find(key) == cache.end()) {
-            TextureData data;
-            std::string imageFileFormat = filename.substr(filename.find_last_of('.') + 1);
+    // Decodes a PNG, JPG, EXR, ... file into RGBA floats.
+    static bool Load(const std::string& path, TextureData& data) {
+        std::string imageFileFormat = path.substr(path.find_last_of('.') + 1);
 
-            if (imageFileFormat == "exr") {
-                float* out; // width * height * RGBA
-                const char* err;
+        if (imageFileFormat == "exr") {
+            float* out; // width * height * RGBA
+            const char* err;
 
-                int ret = LoadEXR(&out, &data.width, &data.height, key.c_str(), &err);
-                if (ret != 0) {
-                    std::cerr << err << std::endl;
-                    return nullptr;
-                }
+            int ret = LoadEXR(&out, &data.width, &data.height, path.c_str(), &err);
+            if (ret != 0) {
+                std::cerr << err << std::endl;
+                return false;
+            }
 
-                data.pixels = std::move(std::shared_ptr<Color>((Color*)out));
+            data.pixels = std::move(std::shared_ptr<Color>((Color*)out));
 
-            } else {
-                int comp;
-                auto imgData = stbi_loadf(key.c_str(), &data.width, &data.height, &comp, 4);
+        } else {
+            int comp;
+            auto imgData = stbi_loadf(path.c_str(), &data.width, &data.height, &comp, 4);
 
-                if (!imgData) {
-                    std::cerr << stbi_failure_reason() << std::endl;
-                    return nullptr;
-                }
+            if (!imgData) {
+                std::cerr << stbi_failure_reason() << std::endl;
+                return false;
+            }
 
-                data.pixels = std::move(std::shared_ptr<Color>((Color*)imgData));
+            data.pixels = std::move(std::shared_ptr<Color>((Color*)imgData));
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const TextureData> Get(std::string filename) {
+        std::string key = workingDir + "\\" + filename;
+        if (cache.find(key) == cache.end()) {
+            TextureData data;
+            if (!Load(key, data)) {
+                return nullptr;
             }
             
             cache[key] = std::make_shared<const TextureData>(data);
@@ -54,4 +65,20 @@ public:
 
         return cache.find(key)->second;
     }
+
+    // Looks for a pre-tiled version (<filename>.ztx, written by zaphod_tex)
+    // of the texture. Returns null if there is none.
+    std::shared_ptr<const TiledTextureFile> GetTiled(std::string filename) {
+        std::string key = workingDir + "\\" + filename;
+        if (key.substr(key.find_last_of('.') + 1) != "ztx") {
+            key += ".ztx";
+        }
+
+        auto it = tiledCache.find(key);
+        if (it == tiledCache.end()) {
+            it = tiledCache.insert({ key, TiledTextureFile::Open(key) }).first;
+        }
+
+        return it->second;
+    }
 };
\ No newline at end of file
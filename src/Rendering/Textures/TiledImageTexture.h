@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Texture.h"
+#include "ImageTexture.h"
+#include "../../IO/TiledTextureFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+class TiledImageTexture : public Texture {
+private:
+    std::shared_ptr<const TiledTextureFile> texFile;
+
+    Color Nearest(int level, Vector2 uv) const {
+        auto pixel = uv * Vector2{ (float)texFile->GetWidth(level) - 1, (float)texFile->GetHeight(level) - 1 };
+        return texFile->Fetch(level, int(pixel.x), int(pixel.y));
+    }
+
+    Color Bilinear(int level, Vector2 uv) const {
+        int width = texFile->GetWidth(level);
+        int height = texFile->GetHeight(level);
+        auto pixel = uv * Vector2{ (float)width - 1, (float)height - 1 };
+
+        int x0 = int(pixel.x), y0 = int(pixel.y);
+        int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+        float fx = pixel.x - x0, fy = pixel.y - y0;
+
+        Color top = texFile->Fetch(level, x0, y0) * (1 - fx) + texFile->Fetch(level, x1, y0) * fx;
+        Color bottom = texFile->Fetch(level, x0, y1) * (1 - fx) + texFile->Fetch(level, x1, y1) * fx;
+        return top * (1 - fy) + bottom * fy;
+    }
+
+public:
+    TiledImageTexture(std::shared_ptr<const TiledTextureFile> file)
+        : texFile(file), wrapMode(TextureWrapMode::Wrap), filterMode(TextureFilterMode::Trilinear) {}
+
+    TextureWrapMode wrapMode;
+    TextureFilterMode filterMode;
+
+    virtual Color Sample(Vector2 uv, float footprint) const override {
+
+        if (wrapMode == TextureWrapMode::Wrap) {
+            uv = { std::fmod(uv.x, 1.0f), std::fmod(uv.y, 1.0f) };
+            if (uv.x < 0) uv.x += 1;
+            if (uv.y < 0) uv.y += 1;
+        }
+
+        uv.Clamp(Vector2(0, 0), Vector2(1, 1));
+
+        uv.y = 1.0f - uv.y;
+
+        // Level whose texels are as wide as the footprint
+        int lastLevel = texFile->GetLevelCount() - 1;
+        float texels = footprint * std::max(texFile->GetWidth(), texFile->GetHeight());
+        float level = texels > 1.0f ? std::min(std::log2(texels), float(lastLevel)) : 0.0f;
+
+        switch (filterMode) {
+        case TextureFilterMode::Point:
+            return Nearest(int(level + 0.5f), uv);
+        case TextureFilterMode::Bilinear:
+            return Bilinear(int(level + 0.5f), uv);
+        default: {
+            int lower = int(level);
+            float t = level - lower;
+            if (t <= 0.0f) {
+                return Bilinear(lower, uv);
+            }
+            return Bilinear(lower, uv) * (1 - t) + Bilinear(std::min(lower + 1, lastLevel), uv) * t;
+        }
+        }
+    }
+};
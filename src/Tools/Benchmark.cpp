@@ -0,0 +1,212 @@
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#include "../IO/SceneLoader.h"
+#include "../Rendering/Scene.h"
+#include "../Rendering/BRDFs.h"
+#include "../Rendering/Cameras/Camera.h"
+#include "../Rendering/ComponentFactories.h"
+#include "../Objects/RenderObject.h"
+#include "ToolUtils.h"
+
+using namespace DirectX::SimpleMath;
+
+// Micro benchmarks for the ray tracing kernels and integrators. Results are
+// written as JSON so they can be compared across versions.
+
+const std::string USAGE = "[scene file] [--width <n>] [--height <n>] "
+                          "[--spp <n>] [--threads <n>] [--out <json file>]";
+
+struct BenchSettings {
+  std::string SceneFile = "data/cornellbox_bench.zsf";
+  std::string OutFile;
+  int Width = 256;
+  int Height = 256;
+  int SPP = 4;
+  int ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+};
+
+static double MRaysPerSecond(size_t rays, double seconds) {
+  return seconds > 0 ? rays / seconds * 1e-6 : 0;
+}
+
+int main(int argc, char **argv) {
+  BenchSettings settings;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--width" && hasValue) {
+      settings.Width = std::stoi(argv[++i]);
+    } else if (arg == "--height" && hasValue) {
+      settings.Height = std::stoi(argv[++i]);
+    } else if (arg == "--spp" && hasValue) {
+      settings.SPP = std::stoi(argv[++i]);
+    } else if (arg == "--threads" && hasValue) {
+      settings.ThreadCount = std::stoi(argv[++i]);
+    } else if (arg == "--out" && hasValue) {
+      settings.OutFile = argv[++i];
+    } else if (arg[0] != '-') {
+      settings.SceneFile = arg;
+    } else {
+      std::cout << "Unknown argument: " << arg << std::endl;
+      std::cout << USAGE << std::endl;
+      return -1;
+    }
+  }
+
+  std::cerr << "Loading scene " << settings.SceneFile << "..." << std::endl;
+
+  Camera *cam = nullptr;
+  std::vector<BaseObject *> objects;
+  if (!LoadScene(settings.SceneFile, objects, &cam) || !cam) {
+    std::cout << "Failed to load " << settings.SceneFile << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<Camera> camera(cam);
+  Scene scene(camera.get(), objects);
+
+  // BVH build, measured on a few full rebuilds of the same frame. SetTime
+  // would keep a static BVH and only refit an animated one.
+  const int buildRuns = 5;
+  double buildTimeMin = scene.GetBuildTime();
+  double buildTimeSum = 0;
+  for (int i = 0; i < buildRuns; i++) {
+    scene.Rebuild(0);
+    buildTimeMin = std::min(buildTimeMin, scene.GetBuildTime());
+    buildTimeSum += scene.GetBuildTime();
+  }
+
+  int w = settings.Width, h = settings.Height;
+  size_t rayCount = size_t(w) * h * settings.SPP;
+
+  // Generate all rays up front so only the traversal is timed
+  std::vector<Ray> primaryRays(rayCount);
+  RunParallel(settings.ThreadCount, rayCount,
+              [&](int threadIndex, size_t begin, size_t end) {
+                RandomEngine rnd(threadIndex);
+                std::uniform_real_distribution<float> pixelDist(-0.5f, 0.5f);
+                float weight;
+                for (size_t i = begin; i < end; i++) {
+                  size_t pixel = i % (size_t(w) * h);
+                  float x = float(pixel % w) + pixelDist(rnd);
+                  float y = float(pixel / w) + pixelDist(rnd);
+                  primaryRays[i] = camera->GetRay(x, y, w, h, rnd, weight);
+                }
+              });
+
+  std::vector<Intersection> primaryHits(rayCount);
+  std::vector<char> primaryHitFound(rayCount);
+
+  double primaryTime = RunParallel(
+      settings.ThreadCount, rayCount,
+      [&](int threadIndex, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          primaryHitFound[i] = scene.Trace(primaryRays[i], primaryHits[i]);
+        }
+      });
+
+  // Secondary rays start at the primary hits: one uniformly random
+  // direction and one shadow ray towards a sampled light per hit.
+  std::vector<Ray> randomRays;
+  std::vector<std::pair<Vector3, Vector3>> shadowRays;
+  for (size_t i = 0; i < rayCount; i++) {
+    if (!primaryHitFound[i]) {
+      continue;
+    }
+    const auto &hit = primaryHits[i];
+    RandomEngine rnd((unsigned)i);
+    Vector3 dir = UniformHemisphereSample(hit.normal, rnd);
+    if (dir.Dot(hit.normal) * primaryRays[i].direction.Dot(hit.normal) > 0) {
+      dir = -dir;
+    }
+    randomRays.push_back(Ray(hit.position + dir * 0.001f, dir));
+
+    RenderObject *light;
+    float le;
+    Ray lightSample = scene.SampleLight(rnd, &light, le);
+    shadowRays.push_back({hit.position, lightSample.position});
+  }
+
+  double randomTime = RunParallel(
+      settings.ThreadCount, randomRays.size(),
+      [&](int threadIndex, size_t begin, size_t end) {
+        Intersection intersect;
+        for (size_t i = begin; i < end; i++) {
+          scene.Trace(randomRays[i], intersect);
+        }
+      });
+
+  double shadowTime = RunParallel(
+      settings.ThreadCount, shadowRays.size(),
+      [&](int threadIndex, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          scene.Test(shadowRays[i].first, shadowRays[i].second);
+        }
+      });
+
+  // Full integrator samples, one image worth of pixels per sample
+  const char *integrators[] = {"PT", "BDPT", "GDPT"};
+  std::vector<std::pair<std::string, double>> integratorResults;
+  for (auto name : integrators) {
+    std::unique_ptr<Integrator> integrator(
+        IntegratorFactory(name, &scene, camera.get(), w, h));
+
+    size_t pixelCount = size_t(w) * h;
+    double time = RunParallel(
+        settings.ThreadCount, pixelCount,
+        [&](int threadIndex, size_t begin, size_t end) {
+          RandomEngine rnd(threadIndex);
+          std::uniform_real_distribution<float> pixelDist(-0.5f, 0.5f);
+          for (int s = 0; s < settings.SPP; s++) {
+            for (size_t i = begin; i < end; i++) {
+              integrator->Sample(float(i % w) + pixelDist(rnd),
+                                 float(i / w) + pixelDist(rnd), w, h, rnd);
+            }
+          }
+        });
+
+    integratorResults.push_back(
+        {name, time > 0 ? pixelCount * settings.SPP / time : 0});
+  }
+
+  std::stringstream json;
+  json << std::fixed << std::setprecision(4);
+  json << "{\n";
+  json << "  \"scene\": \"" << settings.SceneFile << "\",\n";
+  json << "  \"width\": " << w << ",\n";
+  json << "  \"height\": " << h << ",\n";
+  json << "  \"spp\": " << settings.SPP << ",\n";
+  json << "  \"threads\": " << settings.ThreadCount << ",\n";
+  json << "  \"bvh_build_ms\": { \"min\": " << buildTimeMin * 1000
+       << ", \"avg\": " << buildTimeSum / buildRuns * 1000 << " },\n";
+  json << "  \"primary_mrays_per_sec\": " << MRaysPerSecond(rayCount, primaryTime)
+       << ",\n";
+  json << "  \"random_mrays_per_sec\": "
+       << MRaysPerSecond(randomRays.size(), randomTime) << ",\n";
+  json << "  \"shadow_mrays_per_sec\": "
+       << MRaysPerSecond(shadowRays.size(), shadowTime) << ",\n";
+  json << "  \"integrator_samples_per_sec\": {";
+  for (size_t i = 0; i < integratorResults.size(); i++) {
+    json << (i ? ", " : " ") << "\"" << integratorResults[i].first
+         << "\": " << integratorResults[i].second;
+  }
+  json << " }\n";
+  json << "}\n";
+
+  std::cout << json.str();
+
+  if (!settings.OutFile.empty()) {
+    std::ofstream out(settings.OutFile);
+    out << json.str();
+  }
+
+  return 0;
+}
@@ -0,0 +1,247 @@
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+
+#include "../IO/SceneLoader.h"
+#include "../Rendering/Scene.h"
+#include "../Rendering/Cameras/Camera.h"
+#include "../Rendering/ComponentFactories.h"
+#include "../Rendering/Textures/TextureCache.h"
+#include "ToolUtils.h"
+
+using namespace DirectX::SimpleMath;
+
+// Renders a scene with each integrator/sampler combination at doubling
+// sample counts and measures the error against a reference image after every
+// step. The resulting error-vs-time curves are written as CSV.
+
+const std::string USAGE =
+    "<scene file> <reference image> [--integrators PT,BDPT,GDPT] "
+    "[--samplers independent,stratified] [--max-spp <n>] [--time <seconds>] "
+    "[--threads <n>] [--out <csv file>]";
+
+enum class PixelSampler { Independent, Stratified };
+
+struct ErrorMetrics {
+  double RMSE;
+  double RelMSE;
+  double Flip;
+};
+
+static std::vector<std::string> SplitList(const std::string &list) {
+  std::vector<std::string> result;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      result.push_back(item);
+    }
+  }
+  return result;
+}
+
+// Exposure-free tone mapping followed by sRGB -> CIELAB (D65)
+static Vector3 ToLab(const Color &c) {
+  auto toneMap = [](float v) {
+    v = std::max(0.0f, v);
+    return std::pow(v / (1.0f + v), 1.0f / 2.2f);
+  };
+  auto linearize = [](float v) {
+    return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+  };
+
+  float r = linearize(toneMap(c.x));
+  float g = linearize(toneMap(c.y));
+  float b = linearize(toneMap(c.z));
+
+  float X = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+  float Y = (0.2126f * r + 0.7152f * g + 0.0722f * b);
+  float Z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+
+  auto f = [](float t) {
+    return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+  };
+
+  return Vector3(116.0f * f(Y) - 16.0f, 500.0f * (f(X) - f(Y)),
+                 200.0f * (f(Y) - f(Z)));
+}
+
+// relMSE and RMSE on the linear values. The FLIP-style error is the HyAB
+// colour difference of the tone mapped images, normalized to [0, 1]; it
+// skips FLIP's spatial filtering and feature detection.
+static ErrorMetrics ComputeError(const std::vector<Color> &image,
+                                 const Color *reference, size_t pixelCount) {
+  double squaredError = 0;
+  double relSquaredError = 0;
+  double flip = 0;
+
+  const float maxHyAB = 180.0f;
+
+  for (size_t i = 0; i < pixelCount; i++) {
+    const Color &a = image[i];
+    const Color &b = reference[i];
+    for (int c = 0; c < 3; c++) {
+      double diff = (&a.x)[c] - (&b.x)[c];
+      double ref = (&b.x)[c];
+      squaredError += diff * diff;
+      relSquaredError += diff * diff / (ref * ref + 0.01);
+    }
+
+    Vector3 labA = ToLab(a);
+    Vector3 labB = ToLab(b);
+    float hyab = std::abs(labA.x - labB.x) +
+                 std::sqrt((labA.y - labB.y) * (labA.y - labB.y) +
+                           (labA.z - labB.z) * (labA.z - labB.z));
+    flip += std::min(1.0f, hyab / maxHyAB);
+  }
+
+  double count = double(pixelCount) * 3;
+  return {std::sqrt(squaredError / count), relSquaredError / count,
+          flip / pixelCount};
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "Wrong number of arguments!" << std::endl;
+    std::cout << USAGE << std::endl;
+    return -1;
+  }
+
+  std::string sceneFile = argv[1];
+  std::string referenceFile = argv[2];
+  std::string outFile = "convergence.csv";
+  std::vector<std::string> integratorNames = {"PT", "BDPT", "GDPT"};
+  std::vector<std::string> samplerNames = {"independent", "stratified"};
+  int maxSPP = 256;
+  double timeBudget = 0;
+  int threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 3; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--integrators" && hasValue) {
+      integratorNames = SplitList(argv[++i]);
+    } else if (arg == "--samplers" && hasValue) {
+      samplerNames = SplitList(argv[++i]);
+    } else if (arg == "--max-spp" && hasValue) {
+      maxSPP = std::stoi(argv[++i]);
+    } else if (arg == "--time" && hasValue) {
+      timeBudget = std::stod(argv[++i]);
+    } else if (arg == "--threads" && hasValue) {
+      threadCount = std::stoi(argv[++i]);
+    } else if (arg == "--out" && hasValue) {
+      outFile = argv[++i];
+    } else {
+      std::cout << "Unknown argument: " << arg << std::endl;
+      std::cout << USAGE << std::endl;
+      return -1;
+    }
+  }
+
+  TextureData reference;
+  if (!TextureCache::Load(referenceFile, reference)) {
+    std::cout << "Couldn't load reference " << referenceFile << std::endl;
+    return -1;
+  }
+
+  int w = reference.width, h = reference.height;
+  size_t pixelCount = size_t(w) * h;
+
+  Camera *cam = nullptr;
+  std::vector<BaseObject *> objects;
+  if (!LoadScene(sceneFile, objects, &cam) || !cam) {
+    std::cout << "Failed to load " << sceneFile << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<Camera> camera(cam);
+  Scene scene(camera.get(), objects);
+
+  std::ofstream csv(outFile);
+  csv << "integrator,sampler,spp,seconds,rmse,relmse,flip\n";
+
+  for (auto &integratorName : integratorNames) {
+    for (auto &samplerName : samplerNames) {
+      PixelSampler sampler;
+      if (samplerName == "independent") {
+        sampler = PixelSampler::Independent;
+      } else if (samplerName == "stratified") {
+        sampler = PixelSampler::Stratified;
+      } else {
+        std::cout << "Unknown sampler: " << samplerName << std::endl;
+        return -1;
+      }
+
+      std::unique_ptr<Integrator> integrator(
+          IntegratorFactory(integratorName, &scene, camera.get(), w, h));
+
+      std::cout << "Rendering " << integratorName << " / " << samplerName
+                << "..." << std::endl;
+
+      std::vector<Color> sum(pixelCount, Color(0, 0, 0, 0));
+      std::vector<Color> image(pixelCount);
+      double renderTime = 0;
+      int nextCheckpoint = 1;
+
+      for (int spp = 1; spp <= maxSPP; spp++) {
+        auto passStart = Clock::now();
+        integrator->BeginPass(spp - 1, threadCount);
+        renderTime += SecondsSince(passStart);
+
+        renderTime += RunParallel(
+            threadCount, pixelCount,
+            [&](int threadIndex, size_t begin, size_t end) {
+              RandomEngine rnd(spp * 7919 + threadIndex);
+              std::uniform_real_distribution<float> dist(0, 1);
+
+              // Stratified: each sample index lands in a different cell of a
+              // 4x4 grid over the pixel
+              int cellX = (spp - 1) % 4, cellY = ((spp - 1) / 4) % 4;
+
+              for (size_t i = begin; i < end; i++) {
+                float jx = dist(rnd), jy = dist(rnd);
+                if (sampler == PixelSampler::Stratified) {
+                  jx = (cellX + jx) / 4.0f;
+                  jy = (cellY + jy) / 4.0f;
+                }
+                sum[i] += integrator->Sample(float(i % w) + jx - 0.5f,
+                                             float(i / w) + jy - 0.5f, w, h,
+                                             rnd);
+              }
+            });
+
+        bool outOfTime = timeBudget > 0 && renderTime >= timeBudget;
+        if (spp != nextCheckpoint && spp != maxSPP && !outOfTime) {
+          continue;
+        }
+        nextCheckpoint *= 2;
+
+        for (size_t i = 0; i < pixelCount; i++) {
+          image[i] = sum[i] * (1.0f / spp);
+        }
+        integrator->ResolveSplats(image.data(), spp);
+
+        auto error = ComputeError(image, reference.pixels.get(), pixelCount);
+        csv << integratorName << "," << samplerName << "," << spp << ","
+            << renderTime << "," << error.RMSE << "," << error.RelMSE << ","
+            << error.Flip << "\n";
+        csv.flush();
+
+        std::cout << "  " << std::setw(5) << spp << " spp  " << std::fixed
+                  << std::setprecision(2) << renderTime << "s  relMSE "
+                  << std::setprecision(5) << error.RelMSE << std::endl;
+
+        if (outOfTime) {
+          break;
+        }
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <string>
+#include <iostream>
+
+#include "../IO/TiledTextureFile.h"
+#include "../Rendering/Textures/TextureCache.h"
+
+// Offline converter from PNG, JPG, EXR, ... into the tiled, MIP-mapped
+// .ztx container the renderer memory maps (see TextureCache::GetTiled).
+
+const std::string USAGE = "<input image> [output file] [--tile-size <n>] "
+                          "[--half]";
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "Wrong number of arguments!" << std::endl;
+    std::cout << USAGE << std::endl;
+    return -1;
+  }
+
+  std::string input = argv[1];
+  std::string output = input + ".ztx";
+  int tileSize = 64;
+  TiledTextureFormat format = TiledTextureFormat::Float;
+
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--tile-size" && i + 1 < argc) {
+      tileSize = std::stoi(argv[++i]);
+    } else if (arg == "--half") {
+      format = TiledTextureFormat::Half;
+    } else if (i == 2) {
+      output = arg;
+    } else {
+      std::cout << "Unknown argument: " << arg << std::endl;
+      std::cout << USAGE << std::endl;
+      return -1;
+    }
+  }
+
+  if (tileSize <= 0) {
+    std::cout << "Invalid tile size: " << tileSize << std::endl;
+    return -1;
+  }
+
+  TextureData data;
+  if (!TextureCache::Load(input, data)) {
+    std::cout << "Couldn't load " << input << std::endl;
+    return -1;
+  }
+
+  std::cout << "Converting " << input << " (" << data.width << "x"
+            << data.height << ") to " << output << "..." << std::endl;
+
+  if (!TiledTextureFile::Write(output, data.pixels.get(), data.width,
+                               data.height, tileSize, format)) {
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+// Small helpers shared by the command line tools.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+inline double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Splits [0, count) into one contiguous range per thread and runs them in
+// parallel. Returns the wall clock time.
+inline double RunParallel(int threadCount, size_t count,
+                          std::function<void(int, size_t, size_t)> fn) {
+  std::vector<std::thread> threads;
+  size_t chunk = (count + threadCount - 1) / threadCount;
+
+  auto start = Clock::now();
+  for (int i = 0; i < threadCount; i++) {
+    size_t begin = std::min(count, i * chunk);
+    size_t end = std::min(count, begin + chunk);
+    threads.push_back(std::thread(fn, i, begin, end));
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return SecondsSince(start);
+}
@@ -73,7 +73,7 @@ int display_window(int width, int height, Raytracer &rt) {
 
 
       auto filename = std::string(scene_file) + " " + frameIndexStr;
-      rt.SaveImages(filename);
+      rt.SaveImagesAsync(filename);
 
       auto img = tex.copyToImage();
       img.saveToFile(filename + ".png");
@@ -81,6 +81,9 @@ int display_window(int width, int height, Raytracer &rt) {
       FrameIndex++;
       if (FrameIndex <= FrameEnd) {
         rt.Render(FrameIndex);
+        if (FrameIndex < FrameEnd) {
+          rt.PrepareFrame(FrameIndex + 1);
+        }
       } else if (batchmode) {
         window.close();
       }
@@ -131,8 +134,12 @@ int main(int argc, char **argv) {
     return -1;
   }
 
-  // Update the pixel array
+  // Frames are pipelined: while frame N renders, frame N - 1 is written and
+  // the geometry of frame N + 1 is built
   rt.Render(FrameIndex);
+  if (FrameIndex < FrameEnd) {
+    rt.PrepareFrame(FrameIndex + 1);
+  }
 
 #ifndef HEADLESS
   display_window(width, height, rt);
@@ -145,19 +152,15 @@ int main(int argc, char **argv) {
     std::string frameIndexStr = std::to_string(FrameIndex);
     padTo(frameIndexStr, 5, '0');
 
-    stbi_write_hdr(
-      (std::string(scene_file) + " " + frameIndexStr + ".hdr")
-      .c_str(),
-      width, height, 4, (float *)rt.GetRawPixels());
-
-
-
     auto filename = std::string(scene_file) + " " + frameIndexStr;
-    rt.SaveImages(filename);
+    rt.SaveImagesAsync(filename);
 
     if (FrameIndex < FrameEnd) {
       FrameIndex++;
       rt.Render(FrameIndex);
+      if (FrameIndex < FrameEnd) {
+        rt.PrepareFrame(FrameIndex + 1);
+      }
     } else {
       break;
     }